@@ -46,8 +46,42 @@
 #define OVER_PROVISION_RATE         (3)
 /* more pmt cache would decrease WA */
 #define PMT_CACHE_COUNT             (4)
+/* journal blocks written in turn by the die scheduler. More blocks use
+ * more dice and bandwidth, but spread a sequential range over more
+ * blocks, and rewriting part of the range would increase WA.
+ */
+#define WRITE_STRIPE_BLOCKS         (2)
+/* data streams to separate data by lifetime, placed by the temperature
+ * from HDI or the stream id from host.
+ */
+#define DATA_STREAM_COUNT           (4)
+/* generations of reclaimed data: pages surviving a reclaim are copied to
+ * the journal of the next generation, up to the last one.
+ */
+#define RECLAIM_GENERATION_COUNT    (3)
+/* logical sector of host: 9 for 512B, 12 for 4KB (4Kn). A MPP holds one
+ * or more logical sectors, the NAND sector stays SECTOR_SIZE_SHIFT.
+ */
+#define LBA_SIZE_SHIFT              (9)
+/* inline dedup: the hashes of written pages are indexed in ram, and a page
+ * with the same data as an indexed page is mapped to it. Only a record of
+ * the share is logged for replay. It can be enabled in the build, as the
+ * debug build of sim does to run its test.
+ */
+#ifndef DEDUP_ENABLE
+#define DEDUP_ENABLE                (FALSE)
+#endif
+/* more entries find more duplicates, 8 bytes each. The index is only in
+ * ram: an entry replaced in its slot is lost, since no overflow of the
+ * index is kept in NAND, and the index is empty after init.
+ */
+#define DEDUP_INDEX_COUNT           (1024)
 
-/* choose different nand configuration */
+/* choose different nand configuration.
+ * PAGE_PER_BLOCK_SHIFT is the bits of page in the row address. Define
+ * CFG_PAGE_PER_BLOCK if a block has less pages than the bits can address,
+ * e.g. 1152 pages in a TLC block addressed with 11 bits.
+ */
 #define  SIM_NAND             (0)
 #define  K9WAG08              (1)
 #define  K9MBG08              (2)
@@ -57,7 +91,7 @@
 #if (CFG_NAND_TYPE == K9WAG08)
 #define SECTOR_SIZE_SHIFT           (9)   /* fixed */
 #define SECTOR_PER_PAGE_SHIFT       (2)   /* 2, 3, 4 */
-#define PAGE_PER_BLOCK_SHIFT        (6)   /* <=8 */
+#define PAGE_PER_BLOCK_SHIFT        (6)   /* any */
 #define BLOCK_PER_PLANE_SHIFT       (11)  /* >=7 */
 #define PLANE_PER_DIE_SHIFT         (1)   /* 0 or 1 */
 #define DIE_PER_CHIP_SHIFT          (0)   /* 0 or 1 */
@@ -66,13 +100,26 @@
 #define CFG_NAND_COL_CYCLE          (2)
 #define CFG_NAND_ROW_CYCLE          (3)
 
+/* spare is protected with data by controller ECC, can not be rewritten
+ * alone in copy back.
+ */
+#define CFG_NAND_COPYBACK_SPARE     (FALSE)
+
+/* typical timing in us for the die scheduler. TXFER is to move one
+ * multi-plane page on the bus.
+ */
+#define CFG_NAND_TR_US              (25)
+#define CFG_NAND_TPROG_US           (200)
+#define CFG_NAND_TBERS_US           (2000)
+#define CFG_NAND_TXFER_US           (100)
+
 #endif
 
 
 #if (CFG_NAND_TYPE == K9MBG08)
 #define SECTOR_SIZE_SHIFT           (9)   /* fixed */
 #define SECTOR_PER_PAGE_SHIFT       (2)   /* 2, 3, 4 */
-#define PAGE_PER_BLOCK_SHIFT        (7)   /* <=8 */
+#define PAGE_PER_BLOCK_SHIFT        (7)   /* any */
 #define BLOCK_PER_PLANE_SHIFT       (10)  /* >=7 */
 #define PLANE_PER_DIE_SHIFT         (1)   /* 0 or 1 */
 #define DIE_PER_CHIP_SHIFT          (1)   /* 0 or 1 */
@@ -81,13 +128,24 @@
 #define CFG_NAND_COL_CYCLE          (2)
 #define CFG_NAND_ROW_CYCLE          (3)
 
+/* spare is protected with data by controller ECC, can not be rewritten
+ * alone in copy back.
+ */
+#define CFG_NAND_COPYBACK_SPARE     (FALSE)
+
+/* timing in us */
+#define CFG_NAND_TR_US              (60)
+#define CFG_NAND_TPROG_US           (800)
+#define CFG_NAND_TBERS_US           (1500)
+#define CFG_NAND_TXFER_US           (100)
+
 #endif
 
 
 #if (CFG_NAND_TYPE == SIM_NAND)
 #define SECTOR_SIZE_SHIFT           (9)   /* fixed */
 #define SECTOR_PER_PAGE_SHIFT       (3)   /* 2, 3, 4 */
-#define PAGE_PER_BLOCK_SHIFT        (5)   /* <=8 */
+#define PAGE_PER_BLOCK_SHIFT        (5)   /* any */
 #define BLOCK_PER_PLANE_SHIFT       (7)  /* >=7 */
 #define PLANE_PER_DIE_SHIFT         (1)   /* 0 or 1 */
 #define DIE_PER_CHIP_SHIFT          (1)   /* 0 or 1 */
@@ -96,6 +154,14 @@
 #define CFG_NAND_COL_CYCLE          (2)
 #define CFG_NAND_ROW_CYCLE          (4)
 
+#define CFG_NAND_COPYBACK_SPARE     (TRUE)
+
+/* timing in us */
+#define CFG_NAND_TR_US              (50)
+#define CFG_NAND_TPROG_US           (600)
+#define CFG_NAND_TBERS_US           (3000)
+#define CFG_NAND_TXFER_US           (200)
+
 #endif
 
 #endif
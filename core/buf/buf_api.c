@@ -53,7 +53,7 @@ static PAGE_BUFFER      pb_pool[BUFFER_COUNT];
 
 static BOOL             pb_pool_used[BUFFER_COUNT];
 
-static BOOL             sector_written[SECTOR_PER_MPP];
+static BOOL             sector_written[LBA_PER_MPP];
 
 static void*            write_buffer;
 static void*            merge_buffer;
@@ -75,7 +75,7 @@ void BUF_Init()
       pb_pool_used[i] = FALSE;
    }
 
-   for (i=0; i<SECTOR_PER_MPP; i++)
+   for (i=0; i<LBA_PER_MPP; i++)
    {
       sector_written[i] = FALSE;
    }
@@ -91,16 +91,16 @@ void BUF_PutSector(LSADDR addr, void* sector)
 
    if (buf_end_addr == INVALID_LSADDR)
    {
-      buf_start_addr = addr & (~(SECTOR_PER_MPP-1));
-      buf_end_addr = addr | (SECTOR_PER_MPP-1);
+      buf_start_addr = addr & (~(LBA_PER_MPP-1));
+      buf_end_addr = addr | (LBA_PER_MPP-1);
    }
 
    if (addr >= buf_start_addr && addr <= buf_end_addr)
    {
       /* can put to ram write_buffer */
-      memcpy(&(((UINT8*)write_buffer)[(addr-buf_start_addr)*SECTOR_SIZE]),
+      memcpy(&(((UINT8*)write_buffer)[(addr-buf_start_addr)*LBA_SIZE]),
              sector,
-             SECTOR_SIZE);
+             LBA_SIZE);
       sector_written[addr-buf_start_addr] = TRUE;
    }
    else
@@ -115,12 +115,13 @@ void BUF_GetPage(PGADDR* addr, void** buffer)
 {
    UINT32   i;
    BOOL     need_merge = FALSE;
-   PGADDR   page_addr = buf_start_addr>>SECTOR_PER_MPP_SHIFT;
+   PGADDR   page_addr = (PGADDR)(buf_start_addr>>LBA_PER_MPP_SHIFT);
    STATUS   ret;
 
    ASSERT(buf_start_addr != INVALID_LSADDR);
+   ASSERT((buf_start_addr>>LBA_PER_MPP_SHIFT) < FTL_Capacity());
 
-   for (i=0; i<SECTOR_PER_MPP; i++)
+   for (i=0; i<LBA_PER_MPP; i++)
    {
       if (sector_written[i] == FALSE)
       {
@@ -138,13 +139,13 @@ void BUF_GetPage(PGADDR* addr, void** buffer)
       ret = FTL_Read(page_addr, merge_buffer);
       if (ret == STATUS_SUCCESS)
       {
-         for (i=0; i<SECTOR_PER_MPP; i++)
+         for (i=0; i<LBA_PER_MPP; i++)
          {
             if (sector_written[i] == TRUE)
             {
-               memcpy(&(((UINT8*)merge_buffer)[i*SECTOR_SIZE]),
-                      &(((UINT8*)write_buffer)[i*SECTOR_SIZE]),
-                      SECTOR_SIZE);
+               memcpy(&(((UINT8*)merge_buffer)[i*LBA_SIZE]),
+                      &(((UINT8*)write_buffer)[i*LBA_SIZE]),
+                      LBA_SIZE);
             }
          }
       }
@@ -171,7 +172,7 @@ void BUF_GetPage(PGADDR* addr, void** buffer)
    buf_start_addr = INVALID_LSADDR;
    buf_end_addr = INVALID_LSADDR;
 
-   for (i=0; i<SECTOR_PER_MPP; i++)
+   for (i=0; i<LBA_PER_MPP; i++)
    {
       sector_written[i] = FALSE;
    }
@@ -30,6 +30,7 @@
 
 
 #include <core\inc\cmn.h>
+#include <core\inc\buf.h>
 #include <core\inc\ftl.h>
 #include <core\inc\ubi.h>
 #include <core\inc\mtd.h>
@@ -46,16 +47,30 @@
  * - DATA Journal: commit
  * - Init: read BDT, ROOT, PMT, Journal info, ...
  * - Reclaim
- * - Meta Data Page: in last page in PMT blocks and data blocks.
+ * - Meta Data Page: in last page in PMT blocks. Data blocks keep the meta
+ *   data in the spare of each page.
  * - choose journal block on erase and write, according to die index
  *
  * TODO: advanced features:
  * - sanitizing
- * - bg erase
  * - check wp/trim, ...
  */
 
 
+/* no program or erase is done after a read-only init */
+static BOOL    ftl_read_only = FALSE;
+
+
+static
+STATUS ftl_init(BOOL read_only);
+
+static
+STATUS ftl_finish_replay();
+
+static
+BOOL ftl_get_pattern(void* buffer, UINT8* pattern);
+
+
 STATUS FTL_Format()
 {
    STATUS            ret;
@@ -76,6 +91,11 @@ STATUS FTL_Format()
       ret = HDI_Format();
    }
 
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = SHARE_Format();
+   }
+
    if (ret == STATUS_SUCCESS)
    {
       ret = PMT_Format();
@@ -96,10 +116,39 @@ STATUS FTL_Format()
 
 
 STATUS FTL_Init()
+{
+   return ftl_init(FALSE);
+}
+
+
+STATUS FTL_InitReadOnly()
+{
+   return ftl_init(TRUE);
+}
+
+
+BOOL FTL_IsReadOnly()
+{
+   return ftl_read_only;
+}
+
+
+static
+STATUS ftl_init(BOOL read_only)
 {
    STATUS   ret;
 
-   ret = UBI_Init();
+   ftl_read_only = read_only;
+
+   if (read_only == TRUE)
+   {
+      ret = UBI_InitReadOnly();
+   }
+   else
+   {
+      ret = UBI_Init();
+   }
+
    if (ret == STATUS_SUCCESS)
    {
       /* scan tables on UBI, and copy to RAM */
@@ -123,61 +172,229 @@ STATUS FTL_Init()
 
    if (ret == STATUS_SUCCESS)
    {
-      ret = DATA_Replay(root_table.hot_journal);
+      ret = SHARE_Init();
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      DEDUP_Init();
+   }
+
+   if (ret == STATUS_SUCCESS && read_only == FALSE)
+   {
+      /* skip one page for possible PLR issue */
+      (void)ROOT_Commit();
+      (void)BDT_Commit();
+      (void)HDI_Commit(TRUE);
+      (void)SHARE_Commit(TRUE);
+      (void)PMT_CommitDirectory(TRUE);
    }
 
    if (ret == STATUS_SUCCESS)
    {
-      ret = DATA_Replay(root_table.cold_journal);
+      /* the reclaim PLR is not required: reclaim restarts from selecting
+       * the dirtiest block, and the copied pages are replayed. Init returns
+       * before pages are replayed, they are replayed in background tasks,
+       * or before the first access.
+       */
+      ret = DATA_Replay();
+   }
+
+   return ret;
+}
+
+
+STATUS FTL_Write(PGADDR addr, void* buffer)
+{
+   return FTL_WriteHint(addr, buffer, FTL_STREAM_NONE);
+}
+
+
+STATUS FTL_WriteHint(PGADDR addr, void* buffer, UINT32 stream_id)
+{
+   STATUS         ret = STATUS_SUCCESS;
+   UINT32         stream = 0;
+   BOOL           paid = FALSE;
+   BOOL           is_pattern = FALSE;
+   UINT8          pattern = 0;
+   UINT32         hash = 0;
+   PGADDR         dup_addr = INVALID_INDEX;
+
+   if (ftl_read_only == TRUE)
+   {
+      /* no write after a read-only init */
+      ret = STATUS_FAILURE;
+   }
+   else
+   {
+      ret = ftl_finish_replay();
    }
 
    if (ret == STATUS_SUCCESS)
    {
-      /* handle reclaim PLR: start reclaim again. Some data should
-       * be written in the same place, so just rewrite same data in the
-       * same page regardless this page is written or not.
+      if (stream_id != FTL_STREAM_NONE)
+      {
+         /* the stream from host overrides the temperature from HDI */
+         stream = (stream_id-1) % DATA_STREAM_COUNT;
+      }
+      else
+      {
+         /* only a write that is going on is counted in HDI */
+         stream = HDI_GetTemperature(addr);
+      }
+   }
+
+   if (ret == STATUS_SUCCESS && buffer != NULL)
+   {
+      /* a page filled with one byte is mapped to the byte in PMT. Only a
+       * record is logged for it, so no reclaim token is paid.
+       */
+      is_pattern = ftl_get_pattern(buffer, &pattern);
+      paid = is_pattern;
+   }
+
+   if (ret == STATUS_SUCCESS && buffer != NULL && is_pattern == FALSE &&
+       DEDUP_ENABLE == TRUE)
+   {
+      /* a page with the same data as an earlier page is shared with it.
+       * Only a record is logged for it, as for a pattern.
        */
+      hash = DEDUP_Hash(buffer);
+      ret = DEDUP_Search(addr, buffer, hash, &dup_addr);
+      paid = (dup_addr != INVALID_INDEX);
+   }
 
-      /* check if hot journal blocks are full */
-      if (DATA_IsFull(TRUE) == TRUE)
+   do
+   {
+      /* no free block for the full journal, reclaim before writing */
+      while (ret == STATUS_SUCCESS && DATA_IsFull(stream, 1) == TRUE)
       {
-         ret = DATA_Reclaim(TRUE);
-         if (ret == STATUS_SUCCESS)
+         ret = DATA_Reclaim(DATA_ReclaimBudget());
+      }
+
+      if (ret == STATUS_SUCCESS && buffer != NULL && paid == FALSE &&
+          DATA_IsBusy(stream) == TRUE)
+      {
+         /* the journal dice are busy, pay reclaim tokens now instead of
+          * waiting for them.
+          */
+         ret = DATA_Reclaim(DATA_ReclaimBudget());
+         if (ret == STATUS_RECLAIM_NONE)
          {
-            ret = DATA_Commit();
+            ret = STATUS_SUCCESS;
          }
+
+         paid = TRUE;
       }
 
-      /* check if cold journal blocks are full */
-      if (DATA_IsFull(FALSE) == TRUE)
+      if (ret == STATUS_SUCCESS)
       {
-         ret = DATA_Reclaim(FALSE);
-         if (ret == STATUS_SUCCESS)
+         /* a failed page may take the last room of the journal, then
+          * reclaim and write again.
+          */
+         if (is_pattern == TRUE)
+         {
+            ret = DATA_WritePattern(addr, pattern);
+         }
+         else if (dup_addr != INVALID_INDEX)
+         {
+            ret = DATA_WriteDuplicate(dup_addr, addr);
+            if (ret == STATUS_SHARE_FULL)
+            {
+               /* no share entry for the page, write its data and pay
+                * reclaim tokens for it.
+                */
+               dup_addr = INVALID_INDEX;
+               paid = FALSE;
+               ret = DATA_Write(addr, buffer, stream);
+            }
+         }
+         else
          {
-            ret = DATA_Commit();
+            ret = DATA_Write(addr, buffer, stream);
          }
       }
+   } while (ret == STATUS_JOURNAL_FULL);
+
+   if (is_pattern == TRUE || dup_addr != INVALID_INDEX)
+   {
+      /* nothing is programmed, release the buffer as after programming */
+      BUF_Free(buffer);
+   }
+
+   if (ret == STATUS_SUCCESS && buffer != NULL && paid == FALSE)
+   {
+      /* pay reclaim tokens for the written page, so that free blocks
+       * are ready before journals are full.
+       */
+      ret = DATA_Reclaim(DATA_ReclaimBudget());
+      if (ret == STATUS_RECLAIM_NONE)
+      {
+         ret = STATUS_SUCCESS;
+      }
+   }
+
+   if (ret == STATUS_SUCCESS && buffer != NULL && is_pattern == FALSE &&
+       dup_addr == INVALID_INDEX && DEDUP_ENABLE == TRUE)
+   {
+      DEDUP_Add(addr, hash);
    }
 
    return ret;
 }
 
 
-STATUS FTL_Write(PGADDR addr, void* buffer)
+STATUS FTL_WriteAtomic(PGADDR addr, UINT32 page_count, void* buffers[])
 {
+   UINT32         i;
+   UINT32         stream = 0;
    STATUS         ret;
-   BOOL           is_hot = HDI_IsHotPage(addr);
 
-   ret = DATA_Write(addr, buffer, is_hot);
+   if (ftl_read_only == TRUE || page_count == 0 ||
+       page_count > FTL_ATOMIC_MAX_PAGES)
+   {
+      ret = STATUS_FAILURE;
+   }
+   else
+   {
+      ret = ftl_finish_replay();
+   }
+
+   /* count the writes of all pages, and write in the hottest stream */
+   for (i=0; i<page_count && ret == STATUS_SUCCESS; i++)
+   {
+      stream = MAX(stream, HDI_GetTemperature(addr+i));
+   }
+
+   do
+   {
+      /* reclaim until all pages fit in the journal */
+      while (ret == STATUS_SUCCESS && DATA_IsFull(stream, page_count) == TRUE)
+      {
+         ret = DATA_Reclaim(DATA_ReclaimBudget());
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = DATA_WriteAtomic(addr, page_count, buffers, stream);
+      }
+   } while (ret == STATUS_JOURNAL_FULL);
+
    if (ret == STATUS_SUCCESS)
    {
-      if (DATA_IsFull(is_hot) == TRUE)
+      /* UBI may program a page again from its buffer after a failure, and
+       * the buffers belong to the caller, finish them before returning.
+       */
+      ret = UBI_Flush();
+   }
+
+   for (i=0; i<page_count && ret == STATUS_SUCCESS; i++)
+   {
+      /* pay reclaim tokens for the written pages */
+      ret = DATA_Reclaim(DATA_ReclaimBudget());
+      if (ret == STATUS_RECLAIM_NONE)
       {
-         ret = DATA_Reclaim(is_hot);
-         if (ret == STATUS_SUCCESS)
-         {
-            ret = DATA_Commit();
-         }
+         ret = STATUS_SUCCESS;
       }
    }
 
@@ -191,8 +408,27 @@ STATUS FTL_Read(PGADDR addr, void* buffer)
    PAGE_OFF    page;
    STATUS      ret;
 
-   ret = PMT_Search(addr, &block, &page);
+   /* the mapping of any page may be stale before the replay is done */
+   ret = ftl_finish_replay();
    if (ret == STATUS_SUCCESS)
+   {
+      ret = PMT_Search(addr, &block, &page);
+   }
+
+   if (ret != STATUS_SUCCESS && ftl_read_only == TRUE)
+   {
+      /* the PMT cache is full of replayed nodes, which can not be
+       * committed in read-only mode. Read the PMT page in the buffer.
+       */
+      ret = PMT_SearchBuffer(addr, &block, &page, buffer);
+   }
+
+   if (ret == STATUS_SUCCESS && block == PATTERN_BLOCK)
+   {
+      /* no data page for the pattern, fill the byte */
+      memset(buffer, (UINT8)page, MPP_SIZE);
+   }
+   else if (ret == STATUS_SUCCESS)
    {
       ret = UBI_Read(block, page, buffer, NULL);
    }
@@ -201,6 +437,61 @@ STATUS FTL_Read(PGADDR addr, void* buffer)
 }
 
 
+STATUS FTL_Copy(PGADDR src_addr, PGADDR dst_addr, UINT32 page_count)
+{
+   UINT32   i;
+   UINT32   offset;
+   void*    buffer;
+   STATUS   ret;
+
+   if (ftl_read_only == TRUE)
+   {
+      ret = STATUS_FAILURE;
+   }
+   else
+   {
+      ret = ftl_finish_replay();
+   }
+
+   for (i=0; i<page_count && src_addr != dst_addr && ret == STATUS_SUCCESS;
+        i++)
+   {
+      /* copy from the last page, if the destination overlaps the end of
+       * the source.
+       */
+      offset = (dst_addr > src_addr) ? page_count-1-i : i;
+
+      ret = DATA_Copy(src_addr+offset, dst_addr+offset);
+      if (ret == STATUS_SHARE_FULL)
+      {
+         /* no share entry for the page, copy its data in a buffer
+          * released by UBI after programming.
+          */
+         buffer = BUF_Allocate();
+         ASSERT(buffer != NULL);
+
+         ret = FTL_Read(src_addr+offset, buffer);
+         if (ret == STATUS_SUCCESS)
+         {
+            ret = FTL_Write(dst_addr+offset, buffer);
+         }
+         else
+         {
+            BUF_Free(buffer);
+         }
+      }
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      /* the copy is not in journals, commit it */
+      ret = DATA_Commit();
+   }
+
+   return ret;
+}
+
+
 STATUS FTL_Trim(PGADDR start, PGADDR end)
 {
    PGADDR   addr;
@@ -233,7 +524,31 @@ BOOL FTL_CheckWP(PGADDR laddr)
 
 STATUS FTL_BgTasks()
 {
-   return STATUS_SUCCESS;
+   STATUS   ret = STATUS_SUCCESS;
+
+   if (DATA_IsReplaying() == TRUE)
+   {
+      /* replay a slice after init */
+      ret = DATA_ReplayPages(REPLAY_BG_PAGES);
+   }
+   else if (ftl_read_only == FALSE)
+   {
+      /* program the records logged, and reclaim a slice in idle time.
+       * Reclaim stops when all free journal blocks are ready.
+       */
+      ret = DATA_WriteRecords();
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = DATA_Reclaim(RECLAIM_BG_TOKENS);
+      }
+
+      if (ret == STATUS_RECLAIM_NONE)
+      {
+         ret = STATUS_SUCCESS;
+      }
+   }
+
+   return ret;
 }
 
 
@@ -242,32 +557,51 @@ PGADDR FTL_Capacity()
    LOG_BLOCK   block;
 
    block = UBI_Capacity;
-   block -= JOURNAL_BLOCK_COUNT;                /* data hot journal */
-   block -= JOURNAL_BLOCK_COUNT;                /* data cold journal */
-   block -= JOURNAL_BLOCK_COUNT;                /* data reclaim journal */
+   block -= JOURNAL_BLOCK_COUNT*DATA_STREAM_COUNT; /* data stream journal */
+   block -= JOURNAL_BLOCK_COUNT*RECLAIM_GENERATION_COUNT; /* reclaim journal */
+   block -= JOURNAL_BLOCK_COUNT;                /* record journal */
    block -= PMT_BLOCK_COUNT;                    /* pmt blocks */
    block -= 2;                                  /* bdt blocks */
    block -= 2;                                  /* root blocks */
    block -= 2;                                  /* hdi reserved */
+   block -= 2;                                  /* pmt directory blocks */
+   block -= 2;                                  /* share table blocks */
    block -= block/100*OVER_PROVISION_RATE;      /* over provision */
 
-   /* last page in every block is reserved for meta data collection */
+   /* the last page of data blocks keeps data, not summary, but it is left
+    * for over provision.
+    */
    return block*(PAGE_PER_PHY_BLOCK-1);
 }
 
 
 STATUS FTL_Flush()
 {
-   STATUS   ret;
+   STATUS   ret = STATUS_SUCCESS;
 
-   ret = DATA_Commit();
-   if (ret == STATUS_SUCCESS)
+   /* nothing to flush in read-only mode */
+   if (ftl_read_only == FALSE)
    {
-      ret = UBI_Flush();
+      ret = ftl_finish_replay();
+      if (ret == STATUS_SUCCESS)
+      {
+         /* the lazy HDI is written on flush, committed with the data */
+         ret = HDI_Commit(TRUE);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = DATA_Commit();
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = UBI_Flush();
+      }
    }
 
 #if (SIM_TEST == TRUE)
-   if (ret == STATUS_SUCCESS)
+   if (ret == STATUS_SUCCESS && ftl_read_only == FALSE)
    {
       /* just test the SWL in sim tests. The SWL should be
        * called in real HW platform in background, and make sure
@@ -281,3 +615,31 @@ STATUS FTL_Flush()
 }
 
 
+static
+STATUS ftl_finish_replay()
+{
+   STATUS   ret = STATUS_SUCCESS;
+
+   if (DATA_IsReplaying() == TRUE)
+   {
+      ret = DATA_ReplayPages(MAX_UINT32);
+   }
+
+   return ret;
+}
+
+
+static
+BOOL ftl_get_pattern(void* buffer, UINT8* pattern)
+{
+   UINT8*   bytes = (UINT8*)buffer;
+
+   *pattern = bytes[0];
+
+   /* every byte is the same as the next one. memcmp in the library takes
+    * any alignment, and is faster than a byte loop.
+    */
+   return (memcmp(bytes, bytes+1, MPP_SIZE-1) == 0);
+}
+
+
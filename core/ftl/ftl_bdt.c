@@ -37,14 +37,60 @@
 #include "ftl_inc.h"
 
 
+/* the BDT entries of a changed block, logged in a delta page */
+typedef struct {
+   LOG_BLOCK         block;
+   DIRTY_PAGE_COUNT  dirty_count;
+   UINT8             generation;
+   UINT32            valid_map[VALID_MAP_WORDS];
+} BDT_DELTA;
+
+#define BDT_DELTA_COUNT    (MPP_SIZE/sizeof(BDT_DELTA))
+
+/* spare of the delta page: the base commit page and the count of entries,
+ * the base of a snapshot is erased (INVALID_PAGE).
+ */
+#define BDT_SPARE_BASE     (0)
+#define BDT_SPARE_COUNT    (1)
+
 static LOG_BLOCK  bdt_current_block;
 static PAGE_OFF   bdt_current_page;
 
-#define BDT_PAGE_COUNT     ((CFG_LOG_BLOCK_COUNT+MPP_SIZE-1)/MPP_SIZE)
+/* a whole page is written from the deltas */
+static BDT_DELTA  bdt_delta[(MPP_SIZE+sizeof(BDT_DELTA)-1)/sizeof(BDT_DELTA)];
+static PAGE_OFF   bdt_delta_pages[PAGE_PER_PHY_BLOCK];
+
+static
+UINT32 bdt_pack_delta();
+
+static
+void bdt_apply_delta(UINT32 count);
+
+static
+STATUS bdt_read_snapshot(PAGE_OFF page);
 
-DIRTY_PAGE_COUNT block_dirty_table[BDT_PAGE_COUNT*MPP_SIZE];
+static
+STATUS bdt_write_snapshot();
 
-#define BDT_PAGE_ADDR(i)   (&(block_dirty_table[(i)*MPP_SIZE]))
+#define BDT_PAGE_COUNT     ((CFG_LOG_BLOCK_COUNT*sizeof(DIRTY_PAGE_COUNT)+\
+                             MPP_SIZE-1)/MPP_SIZE)
+/* the valid page bitmap is saved in the pages following BDT */
+#define BVT_PAGE_COUNT     ((CFG_LOG_BLOCK_COUNT*VALID_MAP_WORDS*sizeof(UINT32)+\
+                             MPP_SIZE-1)/MPP_SIZE)
+/* and the generation of blocks, in the pages following the bitmap */
+#define BGT_PAGE_COUNT     ((CFG_LOG_BLOCK_COUNT+MPP_SIZE-1)/MPP_SIZE)
+#define BDT_COMMIT_PAGES   (BDT_PAGE_COUNT+BVT_PAGE_COUNT+BGT_PAGE_COUNT)
+
+DIRTY_PAGE_COUNT block_dirty_table[BDT_PAGE_COUNT*MPP_SIZE/
+                                   sizeof(DIRTY_PAGE_COUNT)];
+UINT32           block_valid_table[BVT_PAGE_COUNT*MPP_SIZE/sizeof(UINT32)];
+UINT8            block_generation_table[BGT_PAGE_COUNT*MPP_SIZE];
+UINT32           block_changed_table[(CFG_LOG_BLOCK_COUNT+31)/32];
+
+#define BDT_PAGE_ADDR(i)   (&(block_dirty_table[(i)*MPP_SIZE/\
+                                                sizeof(DIRTY_PAGE_COUNT)]))
+#define BVT_PAGE_ADDR(i)   (&(block_valid_table[(i)*MPP_SIZE/sizeof(UINT32)]))
+#define BGT_PAGE_ADDR(i)   (&(block_generation_table[(i)*MPP_SIZE]))
 
 
 STATUS BDT_Format()
@@ -67,62 +113,230 @@ STATUS BDT_Format()
 
 STATUS BDT_Init()
 {
-   UINT32      i;
-   STATUS      ret = STATUS_SUCCESS;
+   UINT32      delta_count = 0;
+   PAGE_OFF    commit_page;
+   PAGE_OFF    page;
+   SPARE       spare;
+   STATUS      ret;
 
    bdt_current_block = PM_NODE_BLOCK(root_table.bdt_current_journal);
-   bdt_current_page = PM_NODE_PAGE(root_table.bdt_current_journal);
+   commit_page = PM_NODE_PAGE(root_table.bdt_current_journal);
+   page = commit_page;
 
-   /* read out the valid page of table */
-   for (i=0; i<BDT_PAGE_COUNT; i++)
+   /* follow the deltas back to the snapshot they are based on */
+   ret = UBI_Read(bdt_current_block, page, NULL, spare);
+   while (ret == STATUS_SUCCESS && spare[BDT_SPARE_BASE] != INVALID_PAGE)
    {
-      ret = UBI_Read(bdt_current_block,
-                     bdt_current_page+i,
-                     BDT_PAGE_ADDR(i),
-                     NULL);
-      ASSERT(ret == STATUS_SUCCESS);
+      ASSERT(spare[BDT_SPARE_BASE] < page);
+
+      bdt_delta_pages[delta_count] = page;
+      delta_count ++;
+
+      page = spare[BDT_SPARE_BASE];
+      ret = UBI_Read(bdt_current_block, page, NULL, spare);
    }
 
-   /* scan the first erased page in the block */
-   for (i = bdt_current_page+BDT_PAGE_COUNT;
-        i < PAGE_PER_PHY_BLOCK;
-        i += BDT_PAGE_COUNT)
+   if (ret == STATUS_SUCCESS)
    {
-      ret = UBI_Read(bdt_current_block, i, NULL, NULL);
-      if (ret != STATUS_SUCCESS)
+      ret = bdt_read_snapshot(page);
+   }
+
+   /* apply the deltas, from the oldest one */
+   while (ret == STATUS_SUCCESS && delta_count > 0)
+   {
+      delta_count --;
+
+      ret = UBI_Read(bdt_current_block,
+                     bdt_delta_pages[delta_count],
+                     bdt_delta,
+                     spare);
+      if (ret == STATUS_SUCCESS)
       {
-         /* this page is not programmed */
-         bdt_current_page = i;
-         ret = STATUS_SUCCESS;
-         break;
+         bdt_apply_delta(spare[BDT_SPARE_COUNT]);
       }
    }
 
-   if (i == PAGE_PER_PHY_BLOCK)
+   ASSERT(ret == STATUS_SUCCESS);
+
+   if (ret == STATUS_SUCCESS)
    {
-      ASSERT(ret == STATUS_SUCCESS);
+      memset(block_changed_table, 0, sizeof(block_changed_table));
+
+      /* find the first erased page after the commit, or the block is full.
+       * deltas not committed in ROOT are skipped.
+       */
+      bdt_current_page = UBI_FindErasedPage(bdt_current_block,
+                                            commit_page+1,
+                                            1);
+   }
+
+   return ret;
+}
+
 
-      /* current block is full */
-      bdt_current_page = PAGE_PER_PHY_BLOCK;
+STATUS BDT_Commit()
+{
+   UINT32      delta_count;
+   PAGE_OFF    commit_page = bdt_current_page;
+   SPARE       spare;
+   STATUS      ret;
+
+   delta_count = bdt_pack_delta();
+
+   if (bdt_current_page > 0 &&
+       bdt_current_page < PAGE_PER_PHY_BLOCK &&
+       delta_count <= BDT_DELTA_COUNT)
+   {
+      /* the last commit is in the current block, log the changes on it */
+      ASSERT(PM_NODE_BLOCK(root_table.bdt_current_journal) == bdt_current_block);
+
+      spare[BDT_SPARE_BASE] = PM_NODE_PAGE(root_table.bdt_current_journal);
+      spare[BDT_SPARE_COUNT] = delta_count;
+      spare[2] = INVALID_INDEX;
+
+      ret = UBI_Write(bdt_current_block,
+                      bdt_current_page,
+                      bdt_delta,
+                      spare,
+                      FALSE);
+      if (ret == STATUS_SUCCESS)
+      {
+         bdt_current_page ++;
+      }
+   }
+   else
+   {
+      ret = bdt_write_snapshot();
+      if (ret == STATUS_SUCCESS)
+      {
+         commit_page = bdt_current_page - BDT_COMMIT_PAGES;
+      }
    }
 
    if (ret == STATUS_SUCCESS)
    {
-      /* skip one page for possible PLR issue */
-      (void)BDT_Commit();
+      PM_NODE_SET_BLOCKPAGE(root_table.bdt_current_journal,
+                            bdt_current_block, commit_page);
+      memset(block_changed_table, 0, sizeof(block_changed_table));
    }
 
    return ret;
 }
 
 
-STATUS BDT_Commit()
+static
+UINT32 bdt_pack_delta()
+{
+   UINT32      count = 0;
+   UINT32      word;
+   UINT32      bit;
+   LOG_BLOCK   block;
+
+   for (word=0; word<sizeof(block_changed_table)/sizeof(UINT32); word++)
+   {
+      if (block_changed_table[word] != 0)
+      {
+         for (bit=0; bit<32; bit++)
+         {
+            if ((block_changed_table[word] & (((UINT32)1)<<bit)) != 0)
+            {
+               if (count < BDT_DELTA_COUNT)
+               {
+                  block = word*32+bit;
+
+                  bdt_delta[count].block = block;
+                  bdt_delta[count].dirty_count = block_dirty_table[block];
+                  bdt_delta[count].generation = block_generation_table[block];
+                  memcpy(bdt_delta[count].valid_map,
+                         VALID_MAP(block),
+                         VALID_MAP_WORDS*sizeof(UINT32));
+               }
+
+               /* count all changed blocks, to know whether they fit */
+               count ++;
+            }
+         }
+      }
+   }
+
+   return count;
+}
+
+
+static
+void bdt_apply_delta(UINT32 count)
+{
+   UINT32      i;
+   LOG_BLOCK   block;
+
+   ASSERT(count <= BDT_DELTA_COUNT);
+
+   for (i=0; i<count; i++)
+   {
+      block = bdt_delta[i].block;
+      ASSERT(block < CFG_LOG_BLOCK_COUNT);
+
+      block_dirty_table[block] = bdt_delta[i].dirty_count;
+      block_generation_table[block] = bdt_delta[i].generation;
+      memcpy(VALID_MAP(block),
+             bdt_delta[i].valid_map,
+             VALID_MAP_WORDS*sizeof(UINT32));
+   }
+}
+
+
+static
+STATUS bdt_read_snapshot(PAGE_OFF page)
+{
+   UINT32      i;
+   STATUS      ret = STATUS_SUCCESS;
+
+   /* read out the valid page of table */
+   for (i=0; i<BDT_PAGE_COUNT; i++)
+   {
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = UBI_Read(bdt_current_block,
+                        page+i,
+                        BDT_PAGE_ADDR(i),
+                        NULL);
+      }
+   }
+
+   for (i=0; i<BVT_PAGE_COUNT; i++)
+   {
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = UBI_Read(bdt_current_block,
+                        page+BDT_PAGE_COUNT+i,
+                        BVT_PAGE_ADDR(i),
+                        NULL);
+      }
+   }
+
+   for (i=0; i<BGT_PAGE_COUNT; i++)
+   {
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = UBI_Read(bdt_current_block,
+                        page+BDT_PAGE_COUNT+BVT_PAGE_COUNT+i,
+                        BGT_PAGE_ADDR(i),
+                        NULL);
+      }
+   }
+
+   return ret;
+}
+
+
+static
+STATUS bdt_write_snapshot()
 {
    STATUS      ret = STATUS_SUCCESS;
    LOG_BLOCK   next_block = INVALID_BLOCK;
    UINT32      i;
 
-   if (bdt_current_page == PAGE_PER_PHY_BLOCK)
+   if (bdt_current_page+BDT_COMMIT_PAGES > PAGE_PER_PHY_BLOCK)
    {
       /* write data in another block */
       next_block = bdt_current_block ^ 1;
@@ -136,7 +350,7 @@ STATUS BDT_Commit()
       }
    }
 
-   /* write BDT in ram to UBI */
+   /* write BDT in ram to UBI, the spare is left erased */
    for (i=0; i<BDT_PAGE_COUNT; i++)
    {
       if (ret == STATUS_SUCCESS)
@@ -149,11 +363,33 @@ STATUS BDT_Commit()
       }
    }
 
+   for (i=0; i<BVT_PAGE_COUNT; i++)
+   {
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = UBI_Write(bdt_current_block,
+                         bdt_current_page+BDT_PAGE_COUNT+i,
+                         BVT_PAGE_ADDR(i),
+                         NULL,
+                         FALSE);
+      }
+   }
+
+   for (i=0; i<BGT_PAGE_COUNT; i++)
+   {
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = UBI_Write(bdt_current_block,
+                         bdt_current_page+BDT_PAGE_COUNT+BVT_PAGE_COUNT+i,
+                         BGT_PAGE_ADDR(i),
+                         NULL,
+                         FALSE);
+      }
+   }
+
    if (ret == STATUS_SUCCESS)
    {
-      PM_NODE_SET_BLOCKPAGE(root_table.bdt_current_journal,
-                            bdt_current_block, bdt_current_page);
-      bdt_current_page += BDT_PAGE_COUNT;
+      bdt_current_page += BDT_COMMIT_PAGES;
    }
 
    return ret;
@@ -31,6 +31,7 @@
 
 #include <core\inc\cmn.h>
 #include <core\inc\buf.h>
+#include <core\inc\ftl.h>
 #include <core\inc\ubi.h>
 
 #include <sys\sys.h>
@@ -38,582 +39,2343 @@
 #include "ftl_inc.h"
 
 
-/* journal edition for orderly replay */
-static UINT32     edition_in_hot_journal = 0;
-static UINT32     edition_in_cold_journal = 0;
+/* data journals: the journal of each stream, the reclaim journal of each
+ * generation, and the record journal.
+ */
+#define DATA_RECLAIM_JOURNAL(g)     (DATA_STREAM_COUNT+(g))
+#define DATA_RECORD_JOURNAL         (DATA_STREAM_COUNT+RECLAIM_GENERATION_COUNT)
+#define DATA_JOURNAL_COUNT          (DATA_RECORD_JOURNAL+1)
+#define DATA_IS_RECLAIM_JOURNAL(t)  ((t) >= DATA_STREAM_COUNT &&          \
+                                     (t) < DATA_RECORD_JOURNAL)
+
+/* the generation of data in a journal: 0 for data from host, and the
+ * reclaim journal g keeps the data survived g+1 reclaims or more.
+ */
+#define DATA_GENERATION(t)                                     \
+            (DATA_IS_RECLAIM_JOURNAL(t) ? (t)-DATA_STREAM_COUNT+1 : 0)
+/* the generation of reclaim journal to copy the valid pages of a block */
+#define DATA_RECLAIM_TARGET(blk)                               \
+            MIN(block_generation_table[blk], RECLAIM_GENERATION_COUNT-1)
+
+/* data blocks have no summary page. The spare of a data page keeps the
+ * logical address, the edition, and the link: the last page of a journal
+ * block links to the next journal block, so replay can follow the journal
+ * without a commit. The link of other pages is INVALID_BLOCK.
+ */
+#define DATA_LINK_PAGE        (PAGE_PER_PHY_BLOCK-1)
+
+/* the meta data of a failed page, its data is in the next page */
+#define JOURNAL_BAD_PAGE      (MAX_UINT32-2)
+
+/* a failed page is repaired with the next page, so only the meta data of
+ * the last two pages in a journal block is kept.
+ */
+#define META_PAGE_COUNT       (2)
+#define META_SLOT(page)       ((page)%META_PAGE_COUNT)
+
+/* the tag of pages in an atomic write, except the last page, set in the
+ * logical address in spare. Replay maps them only with the last page, which
+ * is the commit mark of the atomic write.
+ */
+#define DATA_ATOMIC_PAGE      (0x80000000)
+#define DATA_PAGE_ADDR(a)     ((a)&(~DATA_ATOMIC_PAGE))
+
+/* the tag of shared pages copied in reclaim, set with the share entry in
+ * spare instead of the logical address. Replay moves the entry.
+ */
+#define DATA_SHARED_PAGE      (0x40000000)
+#define DATA_IS_SHARED(a)     (((a)&DATA_SHARED_PAGE) != 0)
+#define DATA_SHARE(a)         ((a)&(~DATA_SHARED_PAGE))
+
+/* a record maps a logical page without a data page, to the byte of a
+ * pattern page, or to the page of another logical page with the same data.
+ * Records are kept in ram, and programmed in one page of the record journal
+ * before the next data page, so replay maps them in order with data pages.
+ * A commit keeps them in PMT, and drops them.
+ */
+#define DATA_RECORD_COUNT     (MPP_SIZE/sizeof(DATA_RECORD))
+#define RECORD_PATTERN        (0x80000000)
+#define RECORD_IS_PATTERN(s)  (((s)&RECORD_PATTERN) != 0)
+#define RECORD_BYTE(s)        ((s)&0xff)
+
+/* the tag of record pages, set with the count of records in spare instead
+ * of the logical address.
+ */
+#define DATA_RECORD_PAGE      (DATA_ATOMIC_PAGE|DATA_SHARED_PAGE)
+#define DATA_IS_RECORD(a)     (((a)&DATA_RECORD_PAGE) == DATA_RECORD_PAGE)
+#define DATA_RECORDS(a)       ((a)&(~DATA_RECORD_PAGE))
+
+/* commit after erasing some blocks, to keep the replay short */
+#define RECLAIM_COMMIT_BLOCKS (JOURNAL_BLOCK_COUNT)
+
+/* free journal blocks kept only for reclaim journals */
+#define FREE_JOURNAL_RESERVE  (1)
+
+/* blocks replayed from the last commit: the journal blocks in the commit,
+ * and the blocks linked after it.
+ */
+#define REPLAY_CHAIN_COUNT    (DATA_JOURNAL_COUNT*JOURNAL_BLOCK_COUNT+    \
+                               FREE_JOURNAL_COUNT+RECLAIM_COMMIT_BLOCKS)
+
+/* pages read ahead in each journal block in replay: the next page to
+ * replay, and the page after it, where the data of a failed page is.
+ */
+#define REPLAY_READ_AHEAD     (2)
+#define REPLAY_MAX_READS      (DATA_JOURNAL_COUNT*JOURNAL_BLOCK_COUNT*    \
+                               REPLAY_READ_AHEAD)
+
+
+typedef enum {
+   RECLAIM_SELECT,
+   RECLAIM_COPY,
+   RECLAIM_ERASE,
+   RECLAIM_COMMIT,
+} RECLAIM_STATE;
+
+typedef struct {
+   LOG_BLOCK   block;
+   PAGE_OFF    page;
+   LOG_BLOCK   root_block;
+   PAGE_OFF    root_page;
+   SPARE       spare;
+   BOOL        programmed;
+   BOOL        linked;
+   PAGE_OFF    bad_page;   /* the failed page skipped by peek */
+   SPARE       ahead[REPLAY_READ_AHEAD];  /* spares of pages read ahead */
+   PAGE_OFF    ahead_page;                /* the first page read ahead */
+   PAGE_OFF    ahead_count;
+} REPLAY_CURSOR;
+
+typedef struct {
+   PGADDR      addr;
+   PGADDR      src_addr;   /* the page to share, or RECORD_PATTERN|byte */
+} DATA_RECORD;
+
+
+/* journal edition for orderly replay, shared by all data journals */
+static UINT32        data_edition = 0;
+
+/* meta data of the last pages written since init, to repair failed pages */
+static SPARE         meta_data[DATA_JOURNAL_COUNT]
+                              [JOURNAL_BLOCK_COUNT]
+                              [META_PAGE_COUNT];
+
+/* reclaim context, kept between reclaim steps. One victim at most in each
+ * die, their pages are copied in turn to keep all dice busy.
+ */
+static RECLAIM_STATE reclaim_state = RECLAIM_SELECT;
+static LOG_BLOCK     reclaim_victims[TOTAL_DIE_COUNT];
+static PAGE_OFF      reclaim_pages[TOTAL_DIE_COUNT];
+static SPARE         reclaim_spares[TOTAL_DIE_COUNT][PAGE_PER_PHY_BLOCK];
+static BOOL          reclaim_spares_read[TOTAL_DIE_COUNT];
+static UINT32        reclaim_victim_count = 0;
+static UINT32        reclaim_die = 0;
+static UINT32        reclaim_valid_pages = 0;
+static UINT32        reclaim_erased_blocks = 0;
+static BOOL          trimmed_since_commit = FALSE;
+
+/* the blocks replay reads after power loss, reclaim commits before erasing
+ * one of them. Too many links since the commit count as all blocks.
+ */
+static LOG_BLOCK     replay_chain[REPLAY_CHAIN_COUNT];
+static UINT32        replay_chain_count = 0;
+static BOOL          replay_chain_full = FALSE;
+
+/* blocks with a failed page in each die, to be relocated by reclaim */
+static LOG_BLOCK     marginal_blocks[TOTAL_DIE_COUNT];
+
+/* cursors used in replay, which is done in slices after init */
+static REPLAY_CURSOR replay_cursors[DATA_JOURNAL_COUNT][JOURNAL_BLOCK_COUNT];
+static BOOL          replay_running = FALSE;
+
+/* spare reads of all cursors, issued together to overlap dice */
+static LOG_BLOCK     replay_blocks[REPLAY_MAX_READS];
+static PAGE_OFF      replay_pages[REPLAY_MAX_READS];
+static SPARE*        replay_spares[REPLAY_MAX_READS];
+
+/* pages of an atomic write not mapped yet, in writing or in replay */
+static PGADDR        atomic_addrs[FTL_ATOMIC_MAX_PAGES];
+static LOG_BLOCK     atomic_blocks[FTL_ATOMIC_MAX_PAGES];
+static PAGE_OFF      atomic_pages[FTL_ATOMIC_MAX_PAGES];
+static UINT32        atomic_count = 0;
+
+/* records not programmed yet, or the record page read in replay */
+#if defined(__ICCARM__)
+#pragma data_alignment=DMA_BURST_BYTES
+#endif
+static DATA_RECORD   data_records[DATA_RECORD_COUNT];
+static UINT32        data_record_count = 0;
+
+
+static
+JOURNAL_ADDR* data_journal(UINT32 journal_type);
+
+static
+BOOL data_is_journal_block(LOG_BLOCK block);
+
+static
+UINT32 data_free_journal_count();
+
+static
+UINT32 data_find_journal(UINT32 journal_type);
+
+static
+UINT32 data_link_journal(UINT32 journal_type, UINT32 index, SPARE spare);
+
+static
+void data_switch_journal(UINT32 journal_type, UINT32 index, UINT32 slot);
+
+static
+STATUS data_write_page(PGADDR      spare_addr,
+                       void*       buffer,
+                       UINT32      stream,
+                       LOG_BLOCK*  block,
+                       PAGE_OFF*   page);
+
+static
+STATUS data_write_journal(PGADDR       addr,
+                          void*        buffer,
+                          UINT32       stream,
+                          LOG_BLOCK*   block,
+                          PAGE_OFF*    page);
+
+static
+STATUS data_log_record(PGADDR addr, PGADDR src_addr);
+
+static
+void data_discard_atomic();
+
+static
+STATUS data_repair_page(LOG_BLOCK block, PAGE_OFF page);
+
+static
+void data_reset_chain();
+
+static
+void data_link_chain(LOG_BLOCK block);
+
+static
+BOOL data_is_chain_block(LOG_BLOCK block);
+
+static
+void data_reclaim_reset();
+
+static
+STATUS data_reclaim_select(UINT32* cost);
+
+static
+STATUS data_reclaim_read_spares(UINT32 die);
+
+static
+STATUS data_reclaim_copy(UINT32* cost);
+
+static
+STATUS data_reclaim_erase(UINT32* cost, BOOL* idle);
+
+static
+STATUS data_replay_read(REPLAY_CURSOR* cursor, PAGE_OFF page, SPARE spare);
+
+static
+STATUS data_replay_read_ahead(REPLAY_CURSOR* cursor, PAGE_OFF page);
+
+static
+STATUS data_replay_peek(REPLAY_CURSOR* cursor);
+
+static
+STATUS data_replay_page(UINT32 journal_type, UINT32 index, BOOL replay);
 
-/* meta data */
-static SPARE      hot_meta_data[JOURNAL_BLOCK_COUNT][PAGE_PER_PHY_BLOCK];
-static SPARE      cold_meta_data[JOURNAL_BLOCK_COUNT][PAGE_PER_PHY_BLOCK];
+static
+STATUS data_replay_records(REPLAY_CURSOR* cursor);
 
-/* buffer used in reclaim */
-static SPARE      pages_buffer[MPP_SIZE/sizeof(SPARE)];
-static UINT8      data_buffer[MPP_SIZE];
-static LOG_BLOCK  dirty_blocks[JOURNAL_BLOCK_COUNT];
+static
+STATUS data_replay_map(PGADDR spare_addr, LOG_BLOCK block, PAGE_OFF page);
+
+static
+STATUS data_search(PGADDR spare_addr, LOG_BLOCK* block, PAGE_OFF* page);
+
+static
+STATUS data_map(PGADDR spare_addr, LOG_BLOCK block, PAGE_OFF page);
 
 
 STATUS DATA_Format()
 {
-   UINT32      i;
-   LOG_BLOCK   block = DATA_START_BLOCK;
-   STATUS      ret = STATUS_SUCCESS;
+   UINT32         i;
+   UINT32         j;
+   JOURNAL_ADDR*  journal;
+   LOG_BLOCK      block = DATA_START_BLOCK;
+   STATUS         ret = STATUS_SUCCESS;
 
-   /* init the bdt to all dirty */
-   for (i=0; i<CFG_LOG_BLOCK_COUNT; i++)
-   {
-      block_dirty_table[i] = MAX_DIRTY_PAGES;
-   }
+   replay_running = FALSE;
 
-   /* init the journal blocks in root table */
-   for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+   /* init the bdt to all dirty, and no valid page */
+   for (i=0; i<CFG_LOG_BLOCK_COUNT; i++)
    {
-      if (ret == STATUS_SUCCESS)
+      if (i < DATA_START_BLOCK)
       {
-         ret = UBI_Erase(block, block);
+         block_dirty_table[i] = MAX_DIRTY_PAGES;
       }
-
-      if (ret == STATUS_SUCCESS)
+      else
       {
-         PM_NODE_SET_BLOCKPAGE(root_table.hot_journal[i], block, 0);
-         block_dirty_table[block] = 0;
-         block ++;
+         block_dirty_table[i] = DATA_MAX_DIRTY_PAGES;
       }
+
+      block_generation_table[i] = 0;
+      BLOCK_CLEAR_VALID(i);
    }
 
-   for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+   /* init the journal blocks in root table, one block per die */
+   for (i=0; i<DATA_JOURNAL_COUNT; i++)
    {
-      if (ret == STATUS_SUCCESS)
-      {
-         ret = UBI_Erase(block, block);
-      }
+      journal = data_journal(i);
 
-      if (ret == STATUS_SUCCESS)
+      for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
       {
-         PM_NODE_SET_BLOCKPAGE(root_table.cold_journal[i], block, 0);
-         block_dirty_table[block] = 0;
-         block ++;
+         if (ret == STATUS_SUCCESS)
+         {
+            ret = UBI_Erase(block, j);
+         }
+
+         if (ret == STATUS_SUCCESS)
+         {
+            PM_NODE_SET_BLOCKPAGE(journal[j], block, 0);
+            block_dirty_table[block] = 0;
+            block_generation_table[block] = DATA_GENERATION(i);
+            block ++;
+         }
       }
    }
 
-   for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+   /* free journal blocks are erased in reclaim */
+   for (i=0; i<FREE_JOURNAL_COUNT; i++)
    {
-      if (ret == STATUS_SUCCESS)
-      {
-         ret = UBI_Erase(block, block);
-      }
-
-      if (ret == STATUS_SUCCESS)
-      {
-         PM_NODE_SET_BLOCKPAGE(root_table.reclaim_journal[i], block, 0);
-         block_dirty_table[block] = 0;
-         block ++;
-      }
+      root_table.free_journal[i] = INVALID_BLOCK;
    }
 
-   return STATUS_SUCCESS;
+   data_edition = 0;
+   root_table.data_edition = data_edition;
+
+   data_reclaim_reset();
+   data_reset_chain();
+   reclaim_erased_blocks = 0;
+   trimmed_since_commit = FALSE;
+   data_record_count = 0;
+
+   return ret;
 }
 
 
-STATUS DATA_Write(PGADDR addr, void* buffer, BOOL is_hot)
+STATUS DATA_Write(PGADDR addr, void* buffer, UINT32 stream)
 {
-   UINT32         i;
-   UINT32*        edition;
-   PHY_BLOCK      block;
+   LOG_BLOCK      block;
    PAGE_OFF       page;
-   JOURNAL_ADDR*  data_journal;
-   SPARE*         meta_data;
-   STATUS         ret = STATUS_SUCCESS;
+   STATUS         ret;
 
    /* TODO: optimize this critical path */
-   /* TODO: Bad Page Marker, skip the bad PAGE instead of bad BLOCK. */
-
-   if (is_hot == TRUE)
-   {
-      data_journal = root_table.hot_journal;
-      meta_data = &(hot_meta_data[0][0]);
-      edition = &edition_in_hot_journal;
-   }
-   else
-   {
-      data_journal = root_table.cold_journal;
-      meta_data = &(cold_meta_data[0][0]);
-      edition = &edition_in_cold_journal;
-   }
 
-   /* find an idle non-full block */
-   do
-   {
-      for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
-      {
-         if (PM_NODE_PAGE(data_journal[i]) < PAGE_PER_PHY_BLOCK-1)
-         {
-            ret = UBI_ReadStatus(PM_NODE_BLOCK(data_journal[i]));
-            if (ret == STATUS_SUCCESS)
-            {
-               /* success means idle */
-               data_journal = &data_journal[i];
-               meta_data = meta_data+i*PAGE_PER_PHY_BLOCK;
-               break;
-            }
-         }
-      }
-   } while (ret==STATUS_DIE_BUSY);
+   ASSERT(stream < DATA_STREAM_COUNT);
 
-   ASSERT(ret==STATUS_SUCCESS);
-   if (buffer != NULL)
+   /* load the PMT page before writing: loading may cause a commit, which
+    * should not happen between writing the page and updating the journal.
+    */
+   ret = PMT_Search(addr, &block, &page);
+   if (ret == STATUS_SUCCESS && buffer != NULL)
    {
-      block = PM_NODE_BLOCK(*data_journal);
-      page = PM_NODE_PAGE(*data_journal);
-
-      /* prepare spare data, and set in meta table */
-      meta_data[page][0] = addr;
-      meta_data[page][1] = (*edition);
-      (*edition) = (*edition)+1;
-
-      /* write the page to journal block */
-      ret = UBI_Write(block, page, buffer, meta_data[page], TRUE);
+      ret = data_write_journal(addr, buffer, stream, &block, &page);
       if (ret == STATUS_SUCCESS)
       {
          /* update PMT */
          ret = PMT_Update(addr, block, page);
       }
-
-      if (ret == STATUS_SUCCESS)
-      {
-         /* update journal */
-         PM_NODE_SET_BLOCKPAGE(*data_journal, block, page+1);
-      }
-
-      if (PM_NODE_PAGE(*data_journal) == PAGE_PER_PHY_BLOCK-1)
-      {
-         /* write meta data to last page */
-         ret = UBI_Write(block, PAGE_PER_PHY_BLOCK-1, meta_data, NULL, FALSE);
-      }
    }
-   else
+   else if (ret == STATUS_SUCCESS)
    {
       /* no buffer, so no need to write data. Just treat it as page trim. */
       /* update PMT */
       ret = PMT_Update(addr, INVALID_BLOCK, INVALID_PAGE);
+      if (ret == STATUS_SUCCESS)
+      {
+         /* trim is not logged in journals, commit before erasing blocks */
+         trimmed_since_commit = TRUE;
+      }
    }
 
    return ret;
 }
 
 
-STATUS DATA_Commit()
+STATUS DATA_WritePattern(PGADDR addr, UINT8 pattern)
 {
-   STATUS ret;
+   STATUS         ret;
 
-   ret = HDI_Commit();
+   /* map the pattern before logging it: loading the PMT page may cause a
+    * commit, which drops the records logged before.
+    */
+   ret = PMT_Update(addr, PATTERN_BLOCK, pattern);
    if (ret == STATUS_SUCCESS)
    {
-      ret = PMT_Commit();
+      /* no data page is written, replay maps it with the record */
+      ret = data_log_record(addr, RECORD_PATTERN|pattern);
    }
 
-   if (ret == STATUS_SUCCESS)
+   return ret;
+}
+
+
+STATUS DATA_WriteDuplicate(PGADDR src_addr, PGADDR dst_addr)
+{
+   STATUS         ret = STATUS_SUCCESS;
+
+   /* the trimmed pages are not replayed, so replay may add other share
+    * entries than here, and reclaim copies a shared page with its entry.
+    * Commit before sharing after a trim.
+    */
+   if (trimmed_since_commit == TRUE)
    {
-      ret = BDT_Commit();
+      ret = DATA_Commit();
    }
 
+   /* share before logging it, as the pattern in DATA_WritePattern */
    if (ret == STATUS_SUCCESS)
    {
-      ret = ROOT_Commit();
+      ret = PMT_Share(src_addr, dst_addr);
    }
 
    if (ret == STATUS_SUCCESS)
    {
-      edition_in_hot_journal = 0;
-      edition_in_cold_journal = 0;
+      /* no data page is written, replay shares it with the record */
+      ret = data_log_record(dst_addr, src_addr);
    }
 
    return ret;
 }
 
 
-BOOL DATA_IsFull(BOOL hot_journal)
+STATUS DATA_WriteAtomic(PGADDR   addr,
+                        UINT32   page_count,
+                        void*    buffers[],
+                        UINT32   stream)
 {
-   UINT32   i;
-   BOOL     ret = TRUE;
+   UINT32         i;
+   PGADDR         spare_addr;
+   STATUS         ret;
 
-   for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+   ASSERT(page_count > 0 && page_count <= FTL_ATOMIC_MAX_PAGES);
+
+   do
    {
-      if (hot_journal == TRUE)
+      /* program the records logged before, it may commit */
+      ret = DATA_WriteRecords();
+
+      /* load the PMT pages before writing: no commit can happen until all
+       * the pages are written and mapped.
+       */
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = PMT_Reserve(addr, page_count);
+      }
+
+      if (ret == STATUS_SUCCESS && DATA_IsFull(stream, page_count) == TRUE)
       {
-         if (PM_NODE_PAGE(root_table.hot_journal[i]) < PAGE_PER_PHY_BLOCK-1)
+         ret = STATUS_JOURNAL_FULL;
+      }
+
+      atomic_count = 0;
+      while (ret == STATUS_SUCCESS && atomic_count < page_count)
+      {
+         spare_addr = addr+atomic_count;
+         if (atomic_count < page_count-1)
          {
-            ret = FALSE;
-            break;
+            spare_addr |= DATA_ATOMIC_PAGE;
+         }
+
+         ret = data_write_page(spare_addr,
+                               buffers[atomic_count],
+                               stream,
+                               &(atomic_blocks[atomic_count]),
+                               &(atomic_pages[atomic_count]));
+         if (ret == STATUS_SUCCESS)
+         {
+            atomic_count ++;
          }
       }
-      else
+
+      if (ret == STATUS_BADPAGE)
       {
-         if (PM_NODE_PAGE(root_table.cold_journal[i]) < PAGE_PER_PHY_BLOCK-1)
+         /* the repair needs a commit, so discard the written pages, and
+          * write all again after the commit.
+          */
+         data_discard_atomic();
+
+         ret = DATA_Commit();
+         if (ret == STATUS_SUCCESS)
          {
-            ret = FALSE;
-            break;
+            ret = STATUS_BADPAGE;
          }
       }
+   } while (ret == STATUS_BADPAGE);
+
+   if (ret == STATUS_SUCCESS)
+   {
+      /* all pages are written, map them */
+      for (i=0; i<page_count && ret == STATUS_SUCCESS; i++)
+      {
+         ret = PMT_Update(addr+i, atomic_blocks[i], atomic_pages[i]);
+      }
+
+      atomic_count = 0;
+   }
+   else
+   {
+      data_discard_atomic();
    }
 
    return ret;
 }
 
 
-STATUS DATA_Reclaim(BOOL is_hot)
+STATUS DATA_WriteRecords()
 {
-   UINT32         i, j;
-   UINT32*        edition;
-   UINT32         total_valid_page = 0;
-   PAGE_OFF       next_dirty_count = 0;
-   PAGE_OFF       target_dirty_count = MAX_DIRTY_PAGES;
-   UINT32         found_block = 0;
-   JOURNAL_ADDR*  journal;
-   JOURNAL_ADDR*  exclude_journal;
-   SPARE*         meta_data;
-   UINT32         total_reclaimed_page = 0;
-   LOG_BLOCK      reclaim_block;
-   LOG_BLOCK      dirty_block;
-   PAGE_OFF       reclaim_page = 0;
+   UINT32         i = JOURNAL_BLOCK_COUNT;
+   UINT32         slot;
+   JOURNAL_ADDR*  journal = data_journal(DATA_RECORD_JOURNAL);
+   SPARE*         meta;
+   LOG_BLOCK      block;
    PAGE_OFF       page;
-   SPARE*         meta_data_buffer;
-   LOG_BLOCK      true_block = INVALID_BLOCK;
-   PAGE_OFF       true_page = INVALID_PAGE;
-   SPARE          spare;
    STATUS         ret = STATUS_SUCCESS;
 
-   if (is_hot == TRUE)
+   if (data_record_count > 0)
    {
-      journal = root_table.hot_journal;
-      exclude_journal = root_table.cold_journal;
-      meta_data = &(hot_meta_data[0][0]);
-      edition = &edition_in_hot_journal;
-   }
-   else
-   {
-      journal = root_table.cold_journal;
-      exclude_journal = root_table.hot_journal;
-      meta_data = &(cold_meta_data[0][0]);
-      edition = &edition_in_cold_journal;
-   }
-
-   /* data reclaim process:
-    * - flush and release all write buffer
-    * - find the dirtiest blocks.
-    * - copy valid pages in dirty blocks to reclaim blocks,
-    * - update PMT and reclaim journal (keep integrity for PLR)
-    * - erase dirtiest blocks, assign to new low EC blocks in same die
-    * - update journals: reclaim ==> journal, dirty ==> reclaim
-    */
-
-   /* flush and release all write buffer */
-   if (ret == STATUS_SUCCESS)
-   {
-      ret = UBI_Flush();
+      i = data_find_journal(DATA_RECORD_JOURNAL);
    }
 
-   /* find the dirtiest blocks */
-   if (ret == STATUS_SUCCESS)
+   if (i < JOURNAL_BLOCK_COUNT)
    {
-      while (found_block != JOURNAL_BLOCK_COUNT)
-      {
-         for (i=DATA_START_BLOCK; i<=DATA_LAST_BLOCK; i++)
-         {
-            /* exclude journal blocks */
-            for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
-            {
-               if (i == PM_NODE_BLOCK(exclude_journal[j]))
-               {
-                  /* skip the journal block */
-                  break;
-               }
-            }
-
-            if (j < JOURNAL_BLOCK_COUNT)
-            {
-               continue;
-            }
-
-            if (block_dirty_table[i] == target_dirty_count)
-            {
-               dirty_blocks[found_block] = i;
-               total_valid_page += (MAX_DIRTY_PAGES-block_dirty_table[i]);
-               found_block ++;
-            }
-            else
-            {
-               /* set the next target dirty count */
-               if (block_dirty_table[i] < target_dirty_count &&
-                   block_dirty_table[i] > next_dirty_count)
-               {
-                  next_dirty_count = block_dirty_table[i];
-               }
-            }
-
-            if (found_block == JOURNAL_BLOCK_COUNT)
-            {
-               break;
-            }
-         }
+      block = PM_NODE_BLOCK(journal[i]);
+      page = PM_NODE_PAGE(journal[i]);
+      meta = meta_data[DATA_RECORD_JOURNAL][i];
 
-         /* find more dirty blocks */
-         target_dirty_count = next_dirty_count;
-         next_dirty_count = 0;
-      }
-   }
+      /* the page takes one edition, with the count of records in spare */
+      meta[META_SLOT(page)][0] = DATA_RECORD_PAGE|data_record_count;
+      meta[META_SLOT(page)][1] = data_edition;
+      slot = data_link_journal(DATA_RECORD_JOURNAL, i, meta[META_SLOT(page)]);
 
-   if (ret == STATUS_SUCCESS)
-   {
-      if (total_valid_page != 0)
+      /* not async, the records are logged again after it */
+      ret = UBI_Write(block, page, data_records, meta[META_SLOT(page)], FALSE);
+      if (ret == STATUS_SUCCESS)
       {
-         for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
-         {
-            /* copy valid pages in dirty blocks to reclaim blocks */
-            /* keep integrity before PMT_Update() */
-            reclaim_block = PM_NODE_BLOCK(root_table.reclaim_journal[j]);
-            reclaim_page = 0;
-            dirty_block = dirty_blocks[j];
-            meta_data_buffer = meta_data + j*PAGE_PER_PHY_BLOCK;
-
-            ret = UBI_Read(dirty_block, PAGE_PER_PHY_BLOCK-1, pages_buffer, NULL);
-            if (ret == STATUS_SUCCESS)
-            {
-               for (page=0; page<PAGE_PER_PHY_BLOCK-1; page++)
-               {
-                  if (ret == STATUS_SUCCESS)
-                  {
-                     ret = PMT_Search(pages_buffer[page][0],
-                                      &true_block,
-                                      &true_page);
-                  }
-
-                  if (ret == STATUS_SUCCESS)
-                  {
-                     if (true_block == dirty_block && true_page == page)
-                     {
-                        /* this page is valid */
-                        /* copy valid page to reclaim block */
-                        ret = UBI_Read(dirty_block, page, data_buffer, spare);
-                        if (ret == STATUS_SUCCESS)
-                        {
-                           /* logical page address is not changed */
-                           spare[1] = total_reclaimed_page;
-
-                           ret = UBI_Write(reclaim_block,
-                                           reclaim_page,
-                                           data_buffer,
-                                           spare,
-                                           FALSE);
-                        }
-
-                        if (ret == STATUS_SUCCESS)
-                        {
-                           /* update pmt */
-                           ret = PMT_Update(pages_buffer[page][0],
-                                            reclaim_block,
-                                            reclaim_page);
-
-                           /* check logical page address */
-                           ASSERT(spare[0] == pages_buffer[page][0]);
-                           /* check edition number */
-                           ASSERT(spare[1] == total_reclaimed_page);
-
-                           /* update meta data */
-                           meta_data_buffer[reclaim_page][0] = spare[0];
-                           meta_data_buffer[reclaim_page][1] = spare[1];
-                        }
-
-                        if (ret == STATUS_SUCCESS)
-                        {
-                           reclaim_page ++;
-                           total_reclaimed_page ++;
-
-                           /* update journals */
-                           PM_NODE_SET_BLOCKPAGE(root_table.reclaim_journal[j],
-                                                 reclaim_block, reclaim_page);
-                        }
-                     }
-                  }
-               }
-            }
-         }
+         data_edition ++;
+         data_switch_journal(DATA_RECORD_JOURNAL, i, slot);
+         data_record_count = 0;
 
-         ASSERT(total_valid_page == total_reclaimed_page);
-
-         /* copied all valid page in all dirty blocks.
-          * Erase dirtiest blocks, assign to new low EC blocks in different
-          * dice, and update journals: reclaim ==> journal, dirty ==> reclaim
+         /* PMT keeps the records, the page is dirty at once, and only
+          * read in replay.
           */
-         for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
-         {
-            if (ret == STATUS_SUCCESS)
-            {
-               ret = UBI_Erase(dirty_blocks[j], j);
-            }
-
-            if (ret == STATUS_SUCCESS)
-            {
-               journal[j] = root_table.reclaim_journal[j];
-               PM_NODE_SET_BLOCKPAGE(root_table.reclaim_journal[j],
-                                     dirty_blocks[j], 0);
-
-               /* update blocks: origin journal - not changed
-                *                origin dirty   - clear all dirty
-                *                origin reclaim - not changed, and shoudl be 0
-                */
-               block_dirty_table[dirty_blocks[j]] = 0;
-               block_dirty_table[PM_NODE_BLOCK(journal[j])] = 0;
-            }
-         }
-      }
-      else
-      {
-         /* erase dirty blocks, update journals, and no need to copy pages */
-         for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
-         {
-            if (ret == STATUS_SUCCESS)
-            {
-               ret = UBI_Erase(dirty_blocks[j], j);
-            }
-
-            if (ret == STATUS_SUCCESS)
-            {
-               /* dirty ==> journal, reclaim unchanged */
-               PM_NODE_SET_BLOCKPAGE(journal[j], dirty_blocks[j], 0);
-
-               /* BDT: clear dirty (now journal) */
-               block_dirty_table[dirty_blocks[j]] = 0;
-            }
-         }
+         block_dirty_table[block] ++;
+         BLOCK_SET_CHANGED(block);
+         ASSERT(block_dirty_table[block] <= DATA_MAX_DIRTY_PAGES);
       }
    }
+   else if (data_record_count > 0)
+   {
+      /* no room in the record journal, keep the records in PMT */
+      ret = STATUS_JOURNAL_FULL;
+   }
 
-   if (ret == STATUS_SUCCESS)
+   if (ret == STATUS_JOURNAL_FULL || ret == STATUS_BADPAGE)
    {
-      (*edition) = total_valid_page;
+      /* or an earlier page failed in the block, repair it in a commit */
+      ret = DATA_Commit();
    }
 
    return ret;
 }
 
 
-STATUS DATA_Replay(JOURNAL_ADDR* journals)
+STATUS DATA_Commit()
 {
-   UINT32      journal_edition = 0;
-   UINT32      j_index = 0;
-   SPARE*      meta_data;
    LOG_BLOCK   block;
    PAGE_OFF    page;
-   SPARE       spare;
-   UINT32      page_edition;
-   PGADDR      logical_page_address;
-   SPARE*      meta_data_buffer;
-   STATUS      ret = STATUS_SUCCESS;
+   STATUS      ret;
 
-   if (journals == root_table.hot_journal)
+   /* the pages in PMT should be programmed before committing it */
+   ret = UBI_Flush();
+
+   /* repair the journals with failed pages, found when flushing */
+   while (ret == STATUS_SUCCESS &&
+          UBI_GetBadPage(&block, &page) == STATUS_SUCCESS)
    {
-      meta_data = &(hot_meta_data[0][0]);
+      ret = data_repair_page(block, page);
    }
-   else
+
+   if (ret == STATUS_SUCCESS)
    {
-      meta_data = &(cold_meta_data[0][0]);
+      ret = HDI_Commit(FALSE);
    }
 
-   while (journal_edition != MAX_UINT32)
+   if (ret == STATUS_SUCCESS)
    {
-      for (j_index=0; j_index<JOURNAL_BLOCK_COUNT; j_index++)
-      {
-         block = PM_NODE_BLOCK(journals[j_index]);
-         page = PM_NODE_PAGE(journals[j_index]);
-
-         if (ret == STATUS_SUCCESS)
-         {
-            ret = UBI_Read(block, page, NULL, spare);
-         }
+      ret = PMT_Commit();
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = SHARE_Commit(FALSE);
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = BDT_Commit();
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      /* replay starts from the edition of the next page */
+      root_table.data_edition = data_edition;
+      ret = ROOT_Commit();
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      data_reset_chain();
+      reclaim_erased_blocks = 0;
+      trimmed_since_commit = FALSE;
+
+      /* the records are kept in PMT */
+      data_record_count = 0;
+   }
+
+   return ret;
+}
+
+
+STATUS DATA_Copy(PGADDR src_addr, PGADDR dst_addr)
+{
+   STATUS   ret;
+
+   ret = PMT_Share(src_addr, dst_addr);
+   if (ret == STATUS_SUCCESS)
+   {
+      /* the old page of the destination is released as in trim, and the
+       * copy is not logged in journals, commit before erasing blocks.
+       */
+      trimmed_since_commit = TRUE;
+   }
+
+   return ret;
+}
+
+
+BOOL DATA_IsFull(UINT32 stream, UINT32 page_count)
+{
+   UINT32         i;
+   UINT32         free_count = data_free_journal_count();
+   JOURNAL_ADDR*  journal = data_journal(stream);
+   UINT32         room = 0;
+
+   for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+   {
+      if (PM_NODE_PAGE(journal[i]) < DATA_LINK_PAGE)
+      {
+         room += DATA_LINK_PAGE-PM_NODE_PAGE(journal[i]);
+      }
+   }
+
+   if (free_count > FREE_JOURNAL_RESERVE)
+   {
+      /* free blocks can be switched in, by the last page of a block */
+      room += (free_count-FREE_JOURNAL_RESERVE)*PAGE_PER_PHY_BLOCK;
+   }
+
+   return (room < page_count);
+}
+
+
+BOOL DATA_IsBusy(UINT32 stream)
+{
+   UINT32         i;
+   JOURNAL_ADDR*  journal = data_journal(stream);
+   BOOL           ret = TRUE;
+
+   for (i=0; i<MIN(WRITE_STRIPE_BLOCKS, JOURNAL_BLOCK_COUNT); i++)
+   {
+      if (PM_NODE_PAGE(journal[i]) < PAGE_PER_PHY_BLOCK-1 &&
+          UBI_GetReadyTime(PM_NODE_BLOCK(journal[i])) == 0)
+      {
+         ret = FALSE;
+         break;
+      }
+   }
+
+   return ret;
+}
+
+
+STATUS DATA_Reclaim(UINT32 budget)
+{
+   UINT32   cost;
+   BOOL     idle = FALSE;
+   STATUS   ret = STATUS_SUCCESS;
+
+   /* data reclaim process, in small steps:
+    * - select the dirtiest block in each die.
+    * - copy one valid page to reclaim journals, and update PMT. The
+    *   valid pages are found in the valid page bitmap, and the copies
+    *   are replayed in edition order with other journals. Copies of
+    *   victims in different dice are interleaved.
+    * - erase the victims as free journal blocks, after all copies are
+    *   programmed.
+    * - commit after some blocks erased.
+    */
+   while (ret == STATUS_SUCCESS && budget > 0 && idle == FALSE)
+   {
+      cost = 0;
+
+      switch (reclaim_state)
+      {
+         case RECLAIM_SELECT:
+            if (data_free_journal_count() < FREE_JOURNAL_COUNT)
+            {
+               ret = data_reclaim_select(&cost);
+            }
+            else
+            {
+               /* all free journal blocks are ready */
+               idle = TRUE;
+            }
+            break;
+
+         case RECLAIM_COPY:
+            ret = data_reclaim_copy(&cost);
+            break;
+
+         case RECLAIM_ERASE:
+            ret = data_reclaim_erase(&cost, &idle);
+            break;
+
+         case RECLAIM_COMMIT:
+            ret = DATA_Commit();
+            if (ret == STATUS_SUCCESS)
+            {
+               cost = RECLAIM_COMMIT_COST;
+               reclaim_state = RECLAIM_SELECT;
+            }
+            break;
+
+         default:
+            ASSERT(FALSE);
+            break;
+      }
+
+      budget -= MIN(budget, cost);
+   }
+
+   return ret;
+}
+
+
+UINT32 DATA_ReclaimBudget()
+{
+   UINT32   free_count = data_free_journal_count();
+   UINT32   victims = MAX(reclaim_victim_count, 1);
+   UINT32   valid_pages;
+   UINT32   gained_pages;
+   UINT32   budget = 0;
+
+   if (free_count < FREE_JOURNAL_COUNT)
+   {
+      /* the work to free the victims, shared by the pages they gain */
+      valid_pages = MIN(reclaim_valid_pages, victims*DATA_MAX_DIRTY_PAGES-1);
+      gained_pages = victims*DATA_MAX_DIRTY_PAGES - valid_pages;
+      budget = (valid_pages*RECLAIM_COPY_COST +
+                victims*RECLAIM_ERASE_COST +
+                victims*RECLAIM_COMMIT_COST/RECLAIM_COMMIT_BLOCKS +
+                gained_pages - 1) / gained_pages;
+
+      if (free_count <= FREE_JOURNAL_COUNT/2)
+      {
+         /* free blocks are running out, catch up */
+         budget *= 2;
+      }
+   }
+
+   return budget;
+}
+
+
+STATUS DATA_Replay()
+{
+   UINT32         i;
+   UINT32         j;
+   JOURNAL_ADDR*  journal;
+   REPLAY_CURSOR* cursor;
+   STATUS         ret = STATUS_SUCCESS;
+
+   /* reclaim restarts from selecting the dirtiest blocks */
+   data_reclaim_reset();
+   reclaim_erased_blocks = 0;
+   trimmed_since_commit = FALSE;
+
+   data_edition = root_table.data_edition;
+   atomic_count = 0;
+   data_record_count = 0;
+
+   /* replay from the journal blocks in the commit */
+   data_reset_chain();
+
+   /* read the first page to replay in all journals */
+   for (i=0; i<DATA_JOURNAL_COUNT; i++)
+   {
+      journal = data_journal(i);
+
+      for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
+      {
+         cursor = &(replay_cursors[i][j]);
+         cursor->block = PM_NODE_BLOCK(journal[j]);
+         cursor->page = PM_NODE_PAGE(journal[j]);
+         cursor->root_block = cursor->block;
+         cursor->root_page = cursor->page;
+         cursor->linked = FALSE;
+         cursor->bad_page = INVALID_PAGE;
+         cursor->ahead_page = 0;
+         cursor->ahead_count = 0;
+      }
+   }
+
+   /* read ahead in all journals together, the dice are read in parallel */
+   ret = data_replay_read_ahead(NULL, INVALID_PAGE);
+
+   for (i=0; i<DATA_JOURNAL_COUNT && ret == STATUS_SUCCESS; i++)
+   {
+      for (j=0; j<JOURNAL_BLOCK_COUNT && ret == STATUS_SUCCESS; j++)
+      {
+         ret = data_replay_peek(&(replay_cursors[i][j]));
+      }
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      /* pages are replayed later in slices */
+      replay_running = TRUE;
+   }
+
+   return ret;
+}
+
+
+STATUS DATA_ReplayPages(UINT32 page_count)
+{
+   UINT32         i;
+   UINT32         j;
+   REPLAY_CURSOR* cursor;
+   REPLAY_CURSOR* next_cursor;
+   UINT32         next_type = 0;
+   UINT32         next_index = 0;
+   STATUS         ret = STATUS_SUCCESS;
+
+   /* replay pages in the edition order */
+   while (ret == STATUS_SUCCESS && replay_running == TRUE && page_count > 0)
+   {
+      next_cursor = NULL;
+
+      for (i=0; i<DATA_JOURNAL_COUNT && next_cursor == NULL; i++)
+      {
+         for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
+         {
+            cursor = &(replay_cursors[i][j]);
+            if (cursor->programmed == TRUE && cursor->spare[1] == data_edition)
+            {
+               next_cursor = cursor;
+               next_type = i;
+               next_index = j;
+               break;
+            }
+         }
+      }
+
+      if (next_cursor != NULL)
+      {
+         ret = data_replay_page(next_type, next_index, TRUE);
+         page_count --;
+      }
+      else
+      {
+         /* no more edition */
+         for (i=0; i<DATA_JOURNAL_COUNT; i++)
+         {
+            for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
+            {
+               cursor = &(replay_cursors[i][j]);
+
+               /* pages after a missing edition are not replayed, and
+                * discarded. The meta table of pages before replay is not
+                * built up, it is only used for pages written after init.
+                */
+               while (ret == STATUS_SUCCESS &&
+                      (cursor->programmed == TRUE || cursor->linked == TRUE))
+               {
+                  ret = data_replay_page(i, j, FALSE);
+               }
+            }
+         }
+
+         if (ret == STATUS_SUCCESS && atomic_count > 0)
+         {
+            /* the atomic write without its last page is discarded. Commit,
+             * so it is not replayed with the next atomic write.
+             */
+            data_discard_atomic();
+
+            if (FTL_IsReadOnly() == FALSE)
+            {
+               ret = DATA_Commit();
+            }
+         }
 
          if (ret == STATUS_SUCCESS)
          {
-            /* this page was written, replay it */
-            logical_page_address = spare[0];
-            page_edition = spare[1];
-
-            if (page_edition != journal_edition)
+            replay_running = FALSE;
+         }
+      }
+   }
+
+   return ret;
+}
+
+
+BOOL DATA_IsReplaying()
+{
+   return replay_running;
+}
+
+
+static
+JOURNAL_ADDR* data_journal(UINT32 journal_type)
+{
+   JOURNAL_ADDR*  journal;
+
+   if (journal_type < DATA_STREAM_COUNT)
+   {
+      journal = root_table.stream_journal[journal_type];
+   }
+   else if (journal_type < DATA_RECORD_JOURNAL)
+   {
+      journal = root_table.reclaim_journal[journal_type-DATA_STREAM_COUNT];
+   }
+   else
+   {
+      ASSERT(journal_type == DATA_RECORD_JOURNAL);
+      journal = root_table.record_journal;
+   }
+
+   return journal;
+}
+
+
+static
+BOOL data_is_journal_block(LOG_BLOCK block)
+{
+   UINT32         i;
+   UINT32         j;
+   JOURNAL_ADDR*  journal;
+   BOOL           ret = FALSE;
+
+   for (i=0; i<DATA_JOURNAL_COUNT && ret == FALSE; i++)
+   {
+      journal = data_journal(i);
+
+      for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
+      {
+         if (PM_NODE_BLOCK(journal[j]) == block)
+         {
+            ret = TRUE;
+            break;
+         }
+      }
+   }
+
+   for (i=0; i<FREE_JOURNAL_COUNT && ret == FALSE; i++)
+   {
+      if (root_table.free_journal[i] == block)
+      {
+         ret = TRUE;
+      }
+   }
+
+   return ret;
+}
+
+
+static
+UINT32 data_free_journal_count()
+{
+   UINT32   i;
+   UINT32   count = 0;
+
+   for (i=0; i<FREE_JOURNAL_COUNT; i++)
+   {
+      if (root_table.free_journal[i] != INVALID_BLOCK)
+      {
+         count ++;
+      }
+   }
+
+   return count;
+}
+
+
+static
+UINT32 data_find_journal(UINT32 journal_type)
+{
+   UINT32         i;
+   UINT32         found = JOURNAL_BLOCK_COUNT;
+   UINT32         ready_time = 0;
+   UINT32         time;
+   JOURNAL_ADDR*  journal = data_journal(journal_type);
+
+   /* take the non-full block in the die ready first, by the die scheduler
+    * in UBI, instead of polling the status of dice. Blocks out of the
+    * stripe are used only when the stripe is full.
+    */
+   for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+   {
+      if (PM_NODE_PAGE(journal[i]) < PAGE_PER_PHY_BLOCK-1 &&
+          (i < WRITE_STRIPE_BLOCKS || found == JOURNAL_BLOCK_COUNT))
+      {
+         time = UBI_GetReadyTime(PM_NODE_BLOCK(journal[i]));
+         if (found == JOURNAL_BLOCK_COUNT || time < ready_time)
+         {
+            found = i;
+            ready_time = time;
+
+            if (ready_time == 0)
+            {
+               break;
+            }
+         }
+      }
+   }
+
+   if (found == JOURNAL_BLOCK_COUNT &&
+       data_free_journal_count() > FREE_JOURNAL_RESERVE)
+   {
+      /* all blocks are full, program the last page of the block in the
+       * die ready first, and link it to a free block.
+       */
+      for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+      {
+         time = UBI_GetReadyTime(PM_NODE_BLOCK(journal[i]));
+         if (found == JOURNAL_BLOCK_COUNT || time < ready_time)
+         {
+            found = i;
+            ready_time = time;
+         }
+      }
+   }
+
+   return found;
+}
+
+
+static
+UINT32 data_link_journal(UINT32 journal_type, UINT32 index, SPARE spare)
+{
+   UINT32         i;
+   UINT32         slot = FREE_JOURNAL_COUNT;
+   UINT32         reserved = FREE_JOURNAL_RESERVE;
+   JOURNAL_ADDR*  journal = data_journal(journal_type);
+
+   spare[2] = INVALID_BLOCK;
+
+   if (PM_NODE_PAGE(journal[index]) == DATA_LINK_PAGE)
+   {
+      if (DATA_IS_RECLAIM_JOURNAL(journal_type))
+      {
+         /* reclaim can use the reserved free blocks */
+         reserved = 0;
+      }
+
+      ASSERT(data_free_journal_count() > reserved);
+
+      /* take the free block in the same die first */
+      if (root_table.free_journal[index%FREE_JOURNAL_COUNT] != INVALID_BLOCK)
+      {
+         slot = index%FREE_JOURNAL_COUNT;
+      }
+      else
+      {
+         for (i=0; i<FREE_JOURNAL_COUNT; i++)
+         {
+            if (root_table.free_journal[i] != INVALID_BLOCK)
+            {
+               slot = i;
+               break;
+            }
+         }
+      }
+
+      /* the last page links to the next block */
+      spare[2] = root_table.free_journal[slot];
+   }
+
+   return slot;
+}
+
+
+static
+void data_switch_journal(UINT32 journal_type, UINT32 index, UINT32 slot)
+{
+   JOURNAL_ADDR*  journal = data_journal(journal_type);
+   LOG_BLOCK      block = PM_NODE_BLOCK(journal[index]);
+   PAGE_OFF       page = PM_NODE_PAGE(journal[index]);
+   LOG_BLOCK      next_block;
+
+   if (slot < FREE_JOURNAL_COUNT)
+   {
+      /* the last page is programmed, switch to the linked block */
+      ASSERT(page == DATA_LINK_PAGE);
+
+      next_block = root_table.free_journal[slot];
+      root_table.free_journal[slot] = INVALID_BLOCK;
+      PM_NODE_SET_BLOCKPAGE(journal[index], next_block, 0);
+      block_generation_table[next_block] = DATA_GENERATION(journal_type);
+      BLOCK_SET_CHANGED(next_block);
+      ASSERT(block_dirty_table[next_block] == 0);
+
+      data_link_chain(next_block);
+   }
+   else
+   {
+      ASSERT(page < DATA_LINK_PAGE);
+      PM_NODE_SET_BLOCKPAGE(journal[index], block, page+1);
+   }
+}
+
+
+static
+STATUS data_write_page(PGADDR      spare_addr,
+                       void*       buffer,
+                       UINT32      stream,
+                       LOG_BLOCK*  block,
+                       PAGE_OFF*   page)
+{
+   UINT32         i = JOURNAL_BLOCK_COUNT;
+   UINT32         slot;
+   JOURNAL_ADDR*  journal = data_journal(stream);
+   SPARE*         meta;
+   STATUS         ret;
+
+   ASSERT(stream < DATA_STREAM_COUNT);
+
+   /* the records logged before the page are programmed first */
+   ret = DATA_WriteRecords();
+
+   /* find an idle non-full block */
+   if (ret == STATUS_SUCCESS)
+   {
+      i = data_find_journal(stream);
+   }
+
+   if (ret == STATUS_SUCCESS && i < JOURNAL_BLOCK_COUNT)
+   {
+      *block = PM_NODE_BLOCK(journal[i]);
+      *page = PM_NODE_PAGE(journal[i]);
+      meta = meta_data[stream][i];
+
+      /* prepare spare data, and set in meta table */
+      meta[META_SLOT(*page)][0] = spare_addr;
+      meta[META_SLOT(*page)][1] = data_edition;
+      slot = data_link_journal(stream, i, meta[META_SLOT(*page)]);
+
+      /* write the page to journal block */
+      ret = UBI_Write(*block, *page, buffer, meta[META_SLOT(*page)], TRUE);
+      if (ret == STATUS_SUCCESS)
+      {
+         data_edition ++;
+
+         /* update journal */
+         data_switch_journal(stream, i, slot);
+      }
+   }
+   else if (ret == STATUS_SUCCESS)
+   {
+      ret = STATUS_JOURNAL_FULL;
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_write_journal(PGADDR       addr,
+                          void*        buffer,
+                          UINT32       stream,
+                          LOG_BLOCK*   block,
+                          PAGE_OFF*    page)
+{
+   STATUS         ret;
+
+   do
+   {
+      ret = data_write_page(addr, buffer, stream, block, page);
+      if (ret == STATUS_BADPAGE)
+      {
+         /* an earlier page failed in the block, and took this page.
+          * Repair the journal in a commit, and write again.
+          */
+         ret = DATA_Commit();
+         if (ret == STATUS_SUCCESS)
+         {
+            ret = STATUS_BADPAGE;
+         }
+      }
+   } while (ret == STATUS_BADPAGE);
+
+   return ret;
+}
+
+
+static
+STATUS data_log_record(PGADDR addr, PGADDR src_addr)
+{
+   STATUS   ret = STATUS_SUCCESS;
+
+   if (data_record_count == DATA_RECORD_COUNT)
+   {
+      /* the page of records is full */
+      ret = DATA_WriteRecords();
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      data_records[data_record_count].addr = addr;
+      data_records[data_record_count].src_addr = src_addr;
+      data_record_count ++;
+   }
+
+   return ret;
+}
+
+
+static
+void data_discard_atomic()
+{
+   UINT32   i;
+
+   /* the pages of an unfinished atomic write are never mapped */
+   for (i=0; i<atomic_count; i++)
+   {
+      block_dirty_table[atomic_blocks[i]] ++;
+      BLOCK_SET_CHANGED(atomic_blocks[i]);
+      ASSERT(block_dirty_table[atomic_blocks[i]] <= DATA_MAX_DIRTY_PAGES);
+   }
+
+   atomic_count = 0;
+}
+
+
+static
+STATUS data_repair_page(LOG_BLOCK block, PAGE_OFF page)
+{
+   UINT32         i;
+   UINT32         j;
+   UINT32         index = JOURNAL_BLOCK_COUNT;
+   JOURNAL_ADDR*  journal = NULL;
+   SPARE*         meta = NULL;
+   LOG_BLOCK      true_block = INVALID_BLOCK;
+   PAGE_OFF       true_page = INVALID_PAGE;
+   STATUS         ret;
+
+   /* find the journal of the block */
+   for (i=0; i<DATA_JOURNAL_COUNT && meta == NULL; i++)
+   {
+      for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
+      {
+         if (PM_NODE_BLOCK(data_journal(i)[j]) == block)
+         {
+            journal = data_journal(i);
+            meta = meta_data[i][j];
+            index = j;
+            break;
+         }
+      }
+   }
+
+   ASSERT(meta != NULL && page+1 < DATA_LINK_PAGE);
+
+   /* the data is in the next page, and mark the failed page */
+   meta[META_SLOT(page+1)][0] = meta[META_SLOT(page)][0];
+   meta[META_SLOT(page+1)][1] = meta[META_SLOT(page)][1];
+   meta[META_SLOT(page+1)][2] = meta[META_SLOT(page)][2];
+   meta[META_SLOT(page)][0] = JOURNAL_BAD_PAGE;
+   meta[META_SLOT(page)][1] = JOURNAL_BAD_PAGE;
+
+   if (PM_NODE_PAGE(journal[index]) <= page+1)
+   {
+      PM_NODE_SET_BLOCKPAGE(journal[index], block, page+2);
+   }
+
+   /* release the PMT cache, so loading PMT does not cause a commit */
+   ret = PMT_Commit();
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = data_search(DATA_PAGE_ADDR(meta[META_SLOT(page+1)][0]),
+                        &true_block,
+                        &true_page);
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      if (true_block == block && true_page == page)
+      {
+         ret = data_map(DATA_PAGE_ADDR(meta[META_SLOT(page+1)][0]),
+                        block,
+                        page+1);
+      }
+      else
+      {
+         /* the page has been written again or trimmed */
+         block_dirty_table[block] ++;
+         BLOCK_SET_CHANGED(block);
+      }
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      /* relocate the block in reclaim, after it is full */
+      marginal_blocks[UBI_GetDie(block)] = block;
+   }
+
+   return ret;
+}
+
+
+static
+void data_reset_chain()
+{
+   UINT32         i;
+   UINT32         j;
+   JOURNAL_ADDR*  journal;
+
+   replay_chain_count = 0;
+   replay_chain_full = FALSE;
+
+   for (i=0; i<DATA_JOURNAL_COUNT; i++)
+   {
+      journal = data_journal(i);
+
+      for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
+      {
+         data_link_chain(PM_NODE_BLOCK(journal[j]));
+      }
+   }
+}
+
+
+static
+void data_link_chain(LOG_BLOCK block)
+{
+   if (replay_chain_count < REPLAY_CHAIN_COUNT)
+   {
+      replay_chain[replay_chain_count] = block;
+      replay_chain_count ++;
+   }
+   else
+   {
+      replay_chain_full = TRUE;
+   }
+}
+
+
+static
+BOOL data_is_chain_block(LOG_BLOCK block)
+{
+   UINT32   i;
+   BOOL     ret = replay_chain_full;
+
+   for (i=0; i<replay_chain_count && ret == FALSE; i++)
+   {
+      if (replay_chain[i] == block)
+      {
+         ret = TRUE;
+      }
+   }
+
+   return ret;
+}
+
+
+static
+void data_reclaim_reset()
+{
+   UINT32   die;
+
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      reclaim_victims[die] = INVALID_BLOCK;
+      reclaim_pages[die] = 0;
+      reclaim_spares_read[die] = FALSE;
+      marginal_blocks[die] = INVALID_BLOCK;
+   }
+
+   reclaim_state = RECLAIM_SELECT;
+   reclaim_victim_count = 0;
+   reclaim_die = 0;
+   reclaim_valid_pages = 0;
+}
+
+
+static
+STATUS data_reclaim_select(UINT32* cost)
+{
+   UINT32            i;
+   UINT32            g;
+   UINT32            die;
+   UINT32            marginal_die = TOTAL_DIE_COUNT;
+   UINT32            victim_die;
+   UINT32            max_victims;
+   UINT32            reserved_blocks;
+   UINT32            blocks;
+   UINT32            room_pages[RECLAIM_GENERATION_COUNT];
+   UINT32            copy_pages[RECLAIM_GENERATION_COUNT];
+   UINT32            valid_pages;
+   UINT32            top_valid_pages = 0;
+   JOURNAL_ADDR*     journal;
+   LOG_BLOCK         block;
+   DIRTY_PAGE_COUNT  dirty[TOTAL_DIE_COUNT];
+   BOOL              selected[TOTAL_DIE_COUNT];
+   STATUS            ret = STATUS_SUCCESS;
+
+   /* find the dirtiest block in each die, excluding journal and free
+    * blocks.
+    */
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      reclaim_victims[die] = INVALID_BLOCK;
+      reclaim_pages[die] = 0;
+      reclaim_spares_read[die] = FALSE;
+      dirty[die] = 0;
+      selected[die] = FALSE;
+   }
+
+   for (block=DATA_START_BLOCK; block<=DATA_LAST_BLOCK; block++)
+   {
+      if (block_dirty_table[block] > 0 &&
+          data_is_journal_block(block) == FALSE)
+      {
+         die = UBI_GetDie(block);
+         if (block_dirty_table[block] > dirty[die])
+         {
+            reclaim_victims[die] = block;
+            dirty[die] = block_dirty_table[block];
+         }
+      }
+   }
+
+   /* relocate a block with a failed page first, as the only victim */
+   for (die=0; die<TOTAL_DIE_COUNT && marginal_die == TOTAL_DIE_COUNT; die++)
+   {
+      block = marginal_blocks[die];
+      if (block != INVALID_BLOCK && data_is_journal_block(block) == FALSE)
+      {
+         marginal_die = UBI_GetDie(block);
+         reclaim_victims[marginal_die] = block;
+         dirty[marginal_die] = block_dirty_table[block];
+      }
+   }
+
+   /* the pages can be copied for sure: the room in reclaim blocks of each
+    * generation, and the free blocks reserved for reclaim.
+    */
+   reserved_blocks = MIN(data_free_journal_count(), FREE_JOURNAL_RESERVE);
+   for (g=0; g<RECLAIM_GENERATION_COUNT; g++)
+   {
+      journal = data_journal(DATA_RECLAIM_JOURNAL(g));
+      room_pages[g] = 0;
+      copy_pages[g] = 0;
+
+      for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+      {
+         room_pages[g] += DATA_LINK_PAGE-PM_NODE_PAGE(journal[i]);
+      }
+   }
+
+   /* each victim takes a free journal slot after erased */
+   max_victims = FREE_JOURNAL_COUNT - data_free_journal_count();
+   if (marginal_die < TOTAL_DIE_COUNT)
+   {
+      max_victims = 1;
+   }
+
+   /* take the victims from the dirtiest one. The dirtiest is always taken,
+    * others only if they are about as dirty, and their pages fit in.
+    */
+   reclaim_victim_count = 0;
+   reclaim_valid_pages = 0;
+   while (reclaim_victim_count < max_victims)
+   {
+      victim_die = marginal_die;
+      for (die=0; die<TOTAL_DIE_COUNT && marginal_die == TOTAL_DIE_COUNT; die++)
+      {
+         if (selected[die] == FALSE &&
+             reclaim_victims[die] != INVALID_BLOCK &&
+             (victim_die == TOTAL_DIE_COUNT ||
+              dirty[die] > dirty[victim_die]))
+         {
+            victim_die = die;
+         }
+      }
+
+      if (victim_die == TOTAL_DIE_COUNT)
+      {
+         break;
+      }
+
+      valid_pages = DATA_MAX_DIRTY_PAGES - dirty[victim_die];
+      copy_pages[DATA_RECLAIM_TARGET(reclaim_victims[victim_die])] +=
+         valid_pages;
+
+      /* free blocks to link for the pages out of the room, each taking
+       * the last page of the block linked to it.
+       */
+      blocks = 0;
+      for (g=0; g<RECLAIM_GENERATION_COUNT; g++)
+      {
+         if (copy_pages[g] > room_pages[g])
+         {
+            blocks += (copy_pages[g]-room_pages[g]+PAGE_PER_PHY_BLOCK-1)/
+                      PAGE_PER_PHY_BLOCK;
+         }
+      }
+
+      if (reclaim_victim_count == 0)
+      {
+         /* start copying from the dirtiest one */
+         reclaim_die = victim_die;
+         top_valid_pages = valid_pages;
+      }
+      else if (valid_pages > 2*top_valid_pages || blocks > reserved_blocks)
+      {
+         break;
+      }
+
+      selected[victim_die] = TRUE;
+      reclaim_valid_pages += valid_pages;
+      reclaim_victim_count ++;
+   }
+
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      if (selected[die] == FALSE)
+      {
+         reclaim_victims[die] = INVALID_BLOCK;
+      }
+   }
+
+   if (reclaim_victim_count > 0)
+   {
+      if (reclaim_valid_pages == 0)
+      {
+         /* no valid page, erase them directly */
+         reclaim_state = RECLAIM_ERASE;
+      }
+      else
+      {
+         reclaim_state = RECLAIM_COPY;
+      }
+   }
+   else
+   {
+      ret = STATUS_RECLAIM_NONE;
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_reclaim_read_spares(UINT32 die)
+{
+   LOG_BLOCK   blocks[PAGE_PER_PHY_BLOCK];
+   PAGE_OFF    pages[PAGE_PER_PHY_BLOCK];
+   SPARE*      spares[PAGE_PER_PHY_BLOCK];
+   LOG_BLOCK   victim = reclaim_victims[die];
+   PAGE_OFF    page;
+   UINT32      count = 0;
+   STATUS      ret;
+
+   /* read the spares of all valid pages in the victim at once, instead of
+    * reading each page before copying it.
+    */
+   for (page=reclaim_pages[die]; page<PAGE_PER_PHY_BLOCK; page++)
+   {
+      if (PAGE_IS_VALID(victim, page) == TRUE)
+      {
+         blocks[count] = victim;
+         pages[count] = page;
+         spares[count] = &(reclaim_spares[die][page]);
+         count ++;
+      }
+   }
+
+   ret = UBI_ReadSpares(count, blocks, pages, spares);
+   if (ret == STATUS_SUCCESS)
+   {
+      reclaim_spares_read[die] = TRUE;
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_reclaim_copy(UINT32* cost)
+{
+   UINT32         i;
+   UINT32         index = JOURNAL_BLOCK_COUNT;
+   UINT32         die = TOTAL_DIE_COUNT;
+   UINT32         k;
+   UINT32         ready_time = 0;
+   UINT32         time;
+   UINT32         journal_type = DATA_RECLAIM_JOURNAL(0);
+   UINT32         slot = FREE_JOURNAL_COUNT;
+   JOURNAL_ADDR*  journal = NULL;
+   LOG_BLOCK      true_block = INVALID_BLOCK;
+   PAGE_OFF       true_page = INVALID_PAGE;
+   LOG_BLOCK      victim = INVALID_BLOCK;
+   PAGE_OFF       victim_page = 0;
+   LOG_BLOCK      reclaim_block;
+   PAGE_OFF       page;
+   UINT32         share;
+   SPARE          spare;
+   STATUS         ret = STATUS_SUCCESS;
+
+   /* take the victim in the die ready first, and others in turn, so the
+    * copy is programmed in one die while copying the next page in another
+    * die.
+    */
+   for (k=0; k<TOTAL_DIE_COUNT; k++)
+   {
+      i = (reclaim_die+k) % TOTAL_DIE_COUNT;
+      if (reclaim_victims[i] != INVALID_BLOCK &&
+          reclaim_pages[i] < PAGE_PER_PHY_BLOCK)
+      {
+         time = UBI_GetReadyTime(reclaim_victims[i]);
+         if (die == TOTAL_DIE_COUNT || time < ready_time)
+         {
+            die = i;
+            ready_time = time;
+         }
+      }
+   }
+
+   if (die < TOTAL_DIE_COUNT)
+   {
+      victim = reclaim_victims[die];
+      victim_page = reclaim_pages[die];
+      reclaim_die = die + 1;
+
+      /* survivors go to the journal of the next generation */
+      journal_type = DATA_RECLAIM_JOURNAL(DATA_RECLAIM_TARGET(victim));
+      journal = data_journal(journal_type);
+
+      if (reclaim_spares_read[die] == FALSE)
+      {
+         ret = data_reclaim_read_spares(die);
+      }
+
+      /* skip the invalid pages in the bitmap, without touching PMT */
+      while (victim_page < PAGE_PER_PHY_BLOCK &&
+             PAGE_IS_VALID(victim, victim_page) == FALSE)
+      {
+         victim_page ++;
+      }
+   }
+
+   if (ret == STATUS_SUCCESS && die < TOTAL_DIE_COUNT &&
+       victim_page == PAGE_PER_PHY_BLOCK)
+   {
+      /* copied all valid pages of the victim */
+      ASSERT(block_dirty_table[victim] == DATA_MAX_DIRTY_PAGES);
+      reclaim_pages[die] = victim_page;
+   }
+   else if (ret == STATUS_SUCCESS && die < TOTAL_DIE_COUNT)
+   {
+      /* data is copied back in nand, the spare is read with others */
+      memcpy(spare, reclaim_spares[die][victim_page], sizeof(SPARE));
+      if (spare[1] == MAX_UINT32)
+      {
+         /* the spare failed in the batch, read again for the status */
+         ret = UBI_Read(victim, victim_page, NULL, spare);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         /* a valid page of an atomic write is mapped, copy it untagged */
+         spare[0] = DATA_PAGE_ADDR(spare[0]);
+
+         /* a shared page is copied with its share entry, instead of the
+          * logical address written with it. If only one logical page maps
+          * to it, the page is not shared any more.
+          */
+         share = SHARE_Find(victim, victim_page);
+         if (share != INVALID_SHARE)
+         {
+            /* the entry may be added by a record logged before, which is
+             * to be replayed before the copy.
+             */
+            ret = DATA_WriteRecords();
+         }
+
+         if (ret == STATUS_SUCCESS && share != INVALID_SHARE)
+         {
+            ret = PMT_Unshare(share, &(spare[0]));
+            if (ret == STATUS_SUCCESS && spare[0] == INVALID_INDEX)
+            {
+               spare[0] = share | DATA_SHARED_PAGE;
+            }
+         }
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         /* load the PMT page before copying: loading may cause a commit,
+          * which should not happen between writing the copy and updating
+          * the journal.
+          */
+         ret = data_search(spare[0], &true_block, &true_page);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ASSERT(true_block == victim && true_page == victim_page);
+
+         /* copy the page to the reclaim block in the same die, so it is
+          * copied back in nand. Otherwise, copy to the fullest reclaim
+          * block, so only one reclaim block is switched at a time.
+          */
+         for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+         {
+            if (PM_NODE_PAGE(journal[i]) < PAGE_PER_PHY_BLOCK-1 &&
+                UBI_GetDie(PM_NODE_BLOCK(journal[i])) ==
+                UBI_GetDie(victim))
+            {
+               index = i;
+               break;
+            }
+         }
+
+         if (index == JOURNAL_BLOCK_COUNT)
+         {
+            for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+            {
+               if (PM_NODE_PAGE(journal[i]) < PAGE_PER_PHY_BLOCK-1 &&
+                   (index == JOURNAL_BLOCK_COUNT ||
+                    PM_NODE_PAGE(journal[i]) > PM_NODE_PAGE(journal[index])))
+               {
+                  index = i;
+               }
+            }
+         }
+
+         if (index == JOURNAL_BLOCK_COUNT)
+         {
+            /* all reclaim blocks are full, program the last page of the
+             * block in the same die, and link it to a free block.
+             */
+            if (data_free_journal_count() > 0)
+            {
+               for (i=0; i<JOURNAL_BLOCK_COUNT; i++)
+               {
+                  if (index == JOURNAL_BLOCK_COUNT ||
+                      UBI_GetDie(PM_NODE_BLOCK(journal[i])) ==
+                      UBI_GetDie(victim))
+                  {
+                     index = i;
+                  }
+               }
+            }
+            else
+            {
+               ret = STATUS_JOURNAL_FULL;
+            }
+         }
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         reclaim_block = PM_NODE_BLOCK(journal[index]);
+         page = PM_NODE_PAGE(journal[index]);
+
+         /* logical page address is not changed */
+         spare[1] = data_edition;
+         slot = data_link_journal(journal_type, index, spare);
+
+         ret = UBI_Copy(victim,
+                        victim_page,
+                        reclaim_block,
+                        page,
+                        spare,
+                        TRUE);
+         if (ret == STATUS_BADPAGE)
+         {
+            /* an earlier page failed in the reclaim block, repair the
+             * journal in a commit, and copy again in the next step.
+             */
+            ret = DATA_Commit();
+            if (ret == STATUS_SUCCESS)
             {
-               /* replay pages in the edition order */
-               continue;
+               *cost = RECLAIM_COMMIT_COST;
+               ret = STATUS_BADPAGE;
             }
-
-            /* update PMT */
-            ret = PMT_Update(logical_page_address, block, page);
          }
+      }
 
-         if (ret == STATUS_SUCCESS)
-         {
-            /* update journal */
-            PM_NODE_SET_BLOCKPAGE(journals[j_index], block, page+1);
+      if (ret == STATUS_SUCCESS)
+      {
+         data_edition ++;
 
-            /* find next edition of journal */
-            journal_edition ++;
-            break;
+         /* update pmt */
+         ret = data_map(spare[0], reclaim_block, page);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         /* update meta data and journal */
+         meta_data[journal_type][index][META_SLOT(page)][0] = spare[0];
+         meta_data[journal_type][index][META_SLOT(page)][1] = spare[1];
+         meta_data[journal_type][index][META_SLOT(page)][2] = spare[2];
+         data_switch_journal(journal_type, index, slot);
+
+         *cost = RECLAIM_COPY_COST;
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         reclaim_pages[die] = victim_page + 1;
+      }
+      else if (ret == STATUS_BADPAGE)
+      {
+         ret = STATUS_SUCCESS;
+      }
+   }
+   else if (die == TOTAL_DIE_COUNT)
+   {
+      /* copied all victims */
+      reclaim_state = RECLAIM_ERASE;
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_reclaim_erase(UINT32* cost, BOOL* idle)
+{
+   UINT32   i;
+   UINT32   die;
+   UINT32   slot;
+   UINT32   slots[TOTAL_DIE_COUNT];
+   BOOL     taken[FREE_JOURNAL_COUNT];
+   BOOL     chained = FALSE;
+   UINT32   die_mask = 0;
+   UINT32   free_slots = 0;
+   STATUS   ret = STATUS_SUCCESS;
+
+   for (slot=0; slot<FREE_JOURNAL_COUNT; slot++)
+   {
+      taken[slot] = (root_table.free_journal[slot] != INVALID_BLOCK);
+      if (taken[slot] == FALSE)
+      {
+         free_slots ++;
+      }
+   }
+
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      if (reclaim_victims[die] != INVALID_BLOCK &&
+          data_is_chain_block(reclaim_victims[die]) == TRUE)
+      {
+         chained = TRUE;
+      }
+   }
+
+   if (free_slots < reclaim_victim_count)
+   {
+      /* erase later, when free blocks are used */
+      *idle = TRUE;
+   }
+   else if (trimmed_since_commit == TRUE || chained == TRUE)
+   {
+      /* the trimmed pages may be in the blocks to erase, and they are not
+       * replayed after PL, so commit before erasing. So does a victim
+       * replayed from the last commit, which is all dirty before the next
+       * commit, e.g. a block of record pages.
+       */
+      ret = DATA_Commit();
+      if (ret == STATUS_SUCCESS)
+      {
+         *cost = RECLAIM_COMMIT_COST;
+      }
+   }
+   else
+   {
+      /* choose the slot of each victim, in the same die if possible */
+      for (die=0; die<TOTAL_DIE_COUNT; die++)
+      {
+         slots[die] = FREE_JOURNAL_COUNT;
+
+         if (reclaim_victims[die] != INVALID_BLOCK &&
+             taken[die%FREE_JOURNAL_COUNT] == FALSE)
+         {
+            slots[die] = die%FREE_JOURNAL_COUNT;
+            taken[slots[die]] = TRUE;
          }
-         else
+      }
+
+      for (die=0; die<TOTAL_DIE_COUNT; die++)
+      {
+         if (reclaim_victims[die] != INVALID_BLOCK)
          {
-            /* restore the edition */
-            if (journals == root_table.hot_journal)
+            for (slot=0;
+                 slot<FREE_JOURNAL_COUNT && slots[die] == FREE_JOURNAL_COUNT;
+                 slot++)
             {
-               edition_in_hot_journal = journal_edition;
+               if (taken[slot] == FALSE)
+               {
+                  slots[die] = slot;
+                  taken[slot] = TRUE;
+               }
             }
-            else
+
+            ASSERT(slots[die] < FREE_JOURNAL_COUNT);
+            die_mask |= 1<<(slots[die]%TOTAL_DIE_COUNT);
+         }
+      }
+
+      /* flush all dice, the copies should be programmed before erasing.
+       * Then erase the free blocks of all dice at once.
+       */
+      ret = UBI_EraseAhead(die_mask);
+
+      for (die=0; die<TOTAL_DIE_COUNT && ret == STATUS_SUCCESS; die++)
+      {
+         if (reclaim_victims[die] != INVALID_BLOCK)
+         {
+            ret = UBI_Erase(reclaim_victims[die], slots[die]);
+            if (ret == STATUS_SUCCESS)
             {
-               edition_in_cold_journal = journal_edition;
+               for (i=0; i<TOTAL_DIE_COUNT; i++)
+               {
+                  if (marginal_blocks[i] == reclaim_victims[die])
+                  {
+                     /* relocated */
+                     marginal_blocks[i] = INVALID_BLOCK;
+                  }
+               }
+
+               root_table.free_journal[slots[die]] = reclaim_victims[die];
+               block_dirty_table[reclaim_victims[die]] = 0;
+               BLOCK_CLEAR_VALID(reclaim_victims[die]);
+               reclaim_victims[die] = INVALID_BLOCK;
+               reclaim_victim_count --;
+               reclaim_erased_blocks ++;
+
+               *cost += RECLAIM_ERASE_COST;
             }
+         }
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ASSERT(reclaim_victim_count == 0);
+         reclaim_valid_pages = 0;
 
-            /* empty page in this journal block */
-            journal_edition = MAX_UINT32;
-            ret = STATUS_SUCCESS;
-            continue;
+         if (reclaim_erased_blocks >= RECLAIM_COMMIT_BLOCKS)
+         {
+            reclaim_state = RECLAIM_COMMIT;
+         }
+         else
+         {
+            reclaim_state = RECLAIM_SELECT;
          }
       }
    }
 
-   /* build up the meta table */
-   for (j_index=0; j_index<JOURNAL_BLOCK_COUNT; j_index++)
+   return ret;
+}
+
+
+static
+STATUS data_replay_read(REPLAY_CURSOR* cursor, PAGE_OFF page, SPARE spare)
+{
+   STATUS   ret = STATUS_SUCCESS;
+
+   if (page < cursor->ahead_page ||
+       page >= cursor->ahead_page+cursor->ahead_count)
+   {
+      ret = data_replay_read_ahead(cursor, page);
+   }
+
+   if (ret == STATUS_SUCCESS)
    {
-      block = PM_NODE_BLOCK(journals[j_index]);
+      ASSERT(page >= cursor->ahead_page &&
+             page < cursor->ahead_page+cursor->ahead_count);
 
-      /* point to the right meta data address */
-      meta_data_buffer= meta_data + j_index*PAGE_PER_PHY_BLOCK;
+      memcpy(spare, cursor->ahead[page-cursor->ahead_page], sizeof(SPARE));
 
-      for (page=0; page<PAGE_PER_PHY_BLOCK; page++)
+      /* the edition of a programmed page is never all 0xff */
+      if (spare[1] == MAX_UINT32)
       {
-         if (ret == STATUS_SUCCESS)
+         ret = STATUS_FAILURE;
+      }
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_replay_read_ahead(REPLAY_CURSOR* cursor, PAGE_OFF page)
+{
+   UINT32         i;
+   UINT32         j;
+   UINT32         count = 0;
+   REPLAY_CURSOR* ahead_cursor;
+   PAGE_OFF       next_page;
+   PAGE_OFF       ahead_page;
+
+   /* read ahead the missed page of the cursor (or the next page of all
+    * cursors if NULL), and all other cursors to be replayed which have
+    * consumed their pages read ahead.
+    */
+   for (i=0; i<DATA_JOURNAL_COUNT; i++)
+   {
+      for (j=0; j<JOURNAL_BLOCK_COUNT; j++)
+      {
+         ahead_cursor = &(replay_cursors[i][j]);
+         next_page = PAGE_PER_PHY_BLOCK;
+
+         if (cursor == NULL)
+         {
+            next_page = ahead_cursor->page;
+         }
+         else if (ahead_cursor == cursor)
+         {
+            next_page = page;
+         }
+         else if (ahead_cursor->programmed == TRUE)
          {
-            ret = UBI_Read(block, page, NULL, spare);
+            next_page = ahead_cursor->page+1;
          }
 
+         if (next_page < PAGE_PER_PHY_BLOCK &&
+             (next_page < ahead_cursor->ahead_page ||
+              next_page >= ahead_cursor->ahead_page+
+                           ahead_cursor->ahead_count))
+         {
+            ahead_cursor->ahead_page = next_page;
+            ahead_cursor->ahead_count = 0;
+
+            for (ahead_page = next_page;
+                 ahead_page < PAGE_PER_PHY_BLOCK &&
+                 ahead_page < next_page+REPLAY_READ_AHEAD;
+                 ahead_page ++)
+            {
+               ASSERT(count < REPLAY_MAX_READS);
+               replay_blocks[count] = ahead_cursor->block;
+               replay_pages[count] = ahead_page;
+               replay_spares[count] =
+                  &(ahead_cursor->ahead[ahead_cursor->ahead_count]);
+               ahead_cursor->ahead_count ++;
+               count ++;
+            }
+         }
+      }
+   }
+
+   return UBI_ReadSpares(count, replay_blocks, replay_pages, replay_spares);
+}
+
+
+static
+STATUS data_replay_peek(REPLAY_CURSOR* cursor)
+{
+   STATUS   ret;
+
+   cursor->programmed = FALSE;
+
+   if (cursor->page < PAGE_PER_PHY_BLOCK)
+   {
+      ret = data_replay_read(cursor, cursor->page, cursor->spare);
+      if (ret != STATUS_SUCCESS && cursor->page+1 < DATA_LINK_PAGE)
+      {
+         /* a failed page is followed by its data in the next page */
+         ret = data_replay_read(cursor, cursor->page+1, cursor->spare);
          if (ret == STATUS_SUCCESS)
          {
-            meta_data_buffer[page][0] = spare[0];
-            meta_data_buffer[page][1] = spare[1];
+            cursor->bad_page = cursor->page;
+            cursor->page ++;
          }
-         else if (page == PAGE_PER_PHY_BLOCK-1)
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         cursor->programmed = TRUE;
+      }
+   }
+
+   /* read fail means an empty page */
+   return STATUS_SUCCESS;
+}
+
+
+static
+STATUS data_replay_page(UINT32 journal_type, UINT32 index, BOOL replay)
+{
+   UINT32         i;
+   REPLAY_CURSOR* cursor = &(replay_cursors[journal_type][index]);
+   JOURNAL_ADDR*  journal = data_journal(journal_type);
+   SPARE*         meta = meta_data[journal_type][index];
+   STATUS         ret = STATUS_SUCCESS;
+
+   if (cursor->linked == TRUE)
+   {
+      /* enter the linked block. Pages copied out of it when it was
+       * reclaimed, have been replayed before its first page.
+       */
+      for (i=0; i<FREE_JOURNAL_COUNT; i++)
+      {
+         if (root_table.free_journal[i] == cursor->block)
+         {
+            root_table.free_journal[i] = INVALID_BLOCK;
+         }
+      }
+
+      block_dirty_table[cursor->block] = 0;
+      block_generation_table[cursor->block] = DATA_GENERATION(journal_type);
+      BLOCK_CLEAR_VALID(cursor->block);
+      cursor->linked = FALSE;
+
+      data_link_chain(cursor->block);
+   }
+
+   if (cursor->bad_page != INVALID_PAGE)
+   {
+      /* the failed page skipped by peek */
+      meta[META_SLOT(cursor->bad_page)][0] = JOURNAL_BAD_PAGE;
+      meta[META_SLOT(cursor->bad_page)][1] = JOURNAL_BAD_PAGE;
+      block_dirty_table[cursor->block] ++;
+      BLOCK_SET_CHANGED(cursor->block);
+      cursor->bad_page = INVALID_PAGE;
+   }
+
+   if (cursor->programmed == TRUE)
+   {
+      if (replay == TRUE)
+      {
+         /* update PMT */
+         if (DATA_IS_RECORD(cursor->spare[0]) == TRUE)
          {
-            /* write meta data to last page */
-            ret = UBI_Write(block,
-                            PAGE_PER_PHY_BLOCK-1,
-                            meta_data_buffer,
-                            NULL,
-                            FALSE);
+            ret = data_replay_records(cursor);
          }
          else
          {
-            ret = STATUS_SUCCESS;
-            break;
+            ret = data_replay_map(cursor->spare[0],
+                                  cursor->block,
+                                  cursor->page);
+         }
+
+         if (ret == STATUS_SUCCESS)
+         {
+            data_edition ++;
+         }
+      }
+
+      if (ret == STATUS_SUCCESS &&
+          (replay == FALSE || DATA_IS_RECORD(cursor->spare[0]) == TRUE))
+      {
+         /* discard the page, and a record page is dirty once replayed */
+         block_dirty_table[cursor->block] ++;
+         BLOCK_SET_CHANGED(cursor->block);
+         ASSERT(block_dirty_table[cursor->block] <= DATA_MAX_DIRTY_PAGES);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         meta[META_SLOT(cursor->page)][0] = cursor->spare[0];
+         meta[META_SLOT(cursor->page)][1] = cursor->spare[1];
+         meta[META_SLOT(cursor->page)][2] = cursor->spare[2];
+         cursor->page ++;
+
+         if (cursor->page == PAGE_PER_PHY_BLOCK)
+         {
+            /* full block, follow the link in the last page */
+            ASSERT(cursor->spare[2] != INVALID_BLOCK);
+            cursor->block = cursor->spare[2];
+            cursor->page = 0;
+            cursor->linked = TRUE;
+            cursor->ahead_count = 0;
          }
       }
    }
 
+   if (ret == STATUS_SUCCESS)
+   {
+      /* update journal */
+      PM_NODE_SET_BLOCKPAGE(journal[index], cursor->block, cursor->page);
+
+      ret = data_replay_peek(cursor);
+   }
+
+   if (ret == STATUS_SUCCESS && replay == TRUE &&
+       cursor->programmed == TRUE && cursor->page > 0 &&
+       cursor->spare[0] == meta[META_SLOT(cursor->page-1)][0] &&
+       cursor->spare[1] == meta[META_SLOT(cursor->page-1)][1])
+   {
+      /* the replayed page failed but was readable, and its data was
+       * programmed again in this page.
+       */
+      if ((cursor->spare[0]&DATA_ATOMIC_PAGE) != 0)
+      {
+         /* the failed page of an atomic write is not mapped yet */
+         ASSERT(atomic_count > 0 &&
+                atomic_pages[atomic_count-1] == cursor->page-1);
+         atomic_pages[atomic_count-1] = cursor->page;
+         block_dirty_table[cursor->block] ++;
+         BLOCK_SET_CHANGED(cursor->block);
+      }
+      else
+      {
+         ret = data_map(cursor->spare[0], cursor->block, cursor->page);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         meta[META_SLOT(cursor->page-1)][0] = JOURNAL_BAD_PAGE;
+         meta[META_SLOT(cursor->page-1)][1] = JOURNAL_BAD_PAGE;
+         meta[META_SLOT(cursor->page)][0] = cursor->spare[0];
+         meta[META_SLOT(cursor->page)][1] = cursor->spare[1];
+         meta[META_SLOT(cursor->page)][2] = cursor->spare[2];
+         cursor->page ++;
+
+         PM_NODE_SET_BLOCKPAGE(journal[index], cursor->block, cursor->page);
+
+         ret = data_replay_peek(cursor);
+      }
+   }
+
    return ret;
 }
 
 
+static
+STATUS data_replay_records(REPLAY_CURSOR* cursor)
+{
+   UINT32   i;
+   UINT32   count = DATA_RECORDS(cursor->spare[0]);
+   STATUS   ret;
+
+   ASSERT(count <= DATA_RECORD_COUNT);
+
+   /* map the logical pages of all records in the page */
+   ret = UBI_Read(cursor->block, cursor->page, data_records, NULL);
+   for (i=0; i<count && ret == STATUS_SUCCESS; i++)
+   {
+      if (RECORD_IS_PATTERN(data_records[i].src_addr) == TRUE)
+      {
+         ret = PMT_Update(data_records[i].addr,
+                          PATTERN_BLOCK,
+                          RECORD_BYTE(data_records[i].src_addr));
+      }
+      else
+      {
+         /* the share entries are added in the same order as before PL */
+         ret = PMT_Share(data_records[i].src_addr, data_records[i].addr);
+         ASSERT(ret != STATUS_SHARE_FULL);
+      }
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_replay_map(PGADDR spare_addr, LOG_BLOCK block, PAGE_OFF page)
+{
+   UINT32   i;
+   STATUS   ret = STATUS_SUCCESS;
+
+   if ((spare_addr&DATA_ATOMIC_PAGE) != 0)
+   {
+      if (atomic_count == 0)
+      {
+         /* load the PMT pages at the first page, so no commit happens
+          * until the last page maps all: the next replay would skip the
+          * pages before the commit.
+          */
+         ret = PMT_Reserve(DATA_PAGE_ADDR(spare_addr), FTL_ATOMIC_MAX_PAGES);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         /* map the page of an atomic write with its last page */
+         ASSERT(atomic_count < FTL_ATOMIC_MAX_PAGES);
+         atomic_addrs[atomic_count] = DATA_PAGE_ADDR(spare_addr);
+         atomic_blocks[atomic_count] = block;
+         atomic_pages[atomic_count] = page;
+         atomic_count ++;
+      }
+   }
+   else
+   {
+      for (i=0; i<atomic_count && ret == STATUS_SUCCESS; i++)
+      {
+         ret = PMT_Update(atomic_addrs[i], atomic_blocks[i], atomic_pages[i]);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         atomic_count = 0;
+         ret = data_map(spare_addr, block, page);
+      }
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_search(PGADDR spare_addr, LOG_BLOCK* block, PAGE_OFF* page)
+{
+   STATUS   ret = STATUS_SUCCESS;
+
+   if (DATA_IS_SHARED(spare_addr) == TRUE)
+   {
+      SHARE_Search(DATA_SHARE(spare_addr), block, page);
+   }
+   else
+   {
+      ret = PMT_Search(spare_addr, block, page);
+   }
+
+   return ret;
+}
+
+
+static
+STATUS data_map(PGADDR spare_addr, LOG_BLOCK block, PAGE_OFF page)
+{
+   STATUS   ret = STATUS_SUCCESS;
+
+   if (DATA_IS_SHARED(spare_addr) == TRUE)
+   {
+      /* the logical pages of a shared page follow its entry */
+      SHARE_Update(DATA_SHARE(spare_addr), block, page);
+   }
+   else
+   {
+      ret = PMT_Update(spare_addr, block, page);
+   }
+
+   return ret;
+}
@@ -0,0 +1,134 @@
+/*********************************************************
+ * Module name: ftl_dedup.c
+ *
+ * Copyright 2010, 2011. All Rights Reserved, Crane Chu.
+ *
+ * This file is part of OpenNFM.
+ *
+ * OpenNFM is free software: you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public 
+ * License as published by the Free Software Foundation, 
+ * either version 3 of the License, or (at your option) any 
+ * later version.
+ * 
+ * OpenNFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied 
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+ * PURPOSE. See the GNU General Public License for more 
+ * details.
+ *
+ * You should have received a copy of the GNU General Public 
+ * License along with OpenNFM. If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * First written on 2010-01-01 by cranechu@gmail.com
+ *
+ * Module Description:
+ *    Inline dedup of data pages. The hashes of written
+ *    pages are indexed in ram with their logical pages.
+ *    A page with the same hash is compared with the data
+ *    in NAND, and shared with the indexed logical page.
+ *    Only a record of the share is logged for replay.
+ *
+ *********************************************************/
+
+
+#include <core\inc\cmn.h>
+#include <core\inc\ubi.h>
+
+#include <sys\sys.h>
+
+#include "ftl_inc.h"
+
+
+/* the index is direct mapped by the hash, a new page replaces the older one
+ * of the same slot. An entry is stale after its logical page is rewritten,
+ * but the data is compared before sharing, so it is only a miss.
+ */
+typedef struct {
+   UINT32   hash;
+   PGADDR   addr;
+} DEDUP_ENTRY;
+
+
+static DEDUP_ENTRY   dedup_index[DEDUP_INDEX_COUNT];
+
+/* read the indexed page to verify the data */
+#if defined(__ICCARM__)
+#pragma data_alignment=DMA_BURST_BYTES
+#endif
+static UINT8         dedup_buffer[MPP_SIZE];
+
+
+void DEDUP_Init()
+{
+   UINT32   i;
+
+   for (i=0; i<DEDUP_INDEX_COUNT; i++)
+   {
+      dedup_index[i].addr = INVALID_INDEX;
+   }
+}
+
+
+UINT32 DEDUP_Hash(void* buffer)
+{
+   UINT8*   bytes = (UINT8*)buffer;
+   UINT32   word;
+   UINT32   hash = DEDUP_HASH_BASIS;
+   UINT32   i;
+
+   /* FNV-1a in words. The buffer may be unaligned, the small memcpy is
+    * a word load where the target allows it.
+    */
+   for (i=0; i<MPP_SIZE/sizeof(UINT32); i++)
+   {
+      memcpy(&word, &bytes[i*sizeof(UINT32)], sizeof(UINT32));
+      hash = (hash^word)*DEDUP_HASH_PRIME;
+   }
+
+   return hash;
+}
+
+
+STATUS DEDUP_Search(PGADDR addr, void* buffer, UINT32 hash, PGADDR* dup_addr)
+{
+   DEDUP_ENTRY*   entry = &(dedup_index[hash%DEDUP_INDEX_COUNT]);
+   LOG_BLOCK      block = INVALID_BLOCK;
+   PAGE_OFF       page = INVALID_PAGE;
+   STATUS         ret = STATUS_SUCCESS;
+
+   *dup_addr = INVALID_INDEX;
+
+   /* the page itself is written as usual */
+   if (entry->addr != INVALID_INDEX && entry->addr != addr &&
+       entry->hash == hash)
+   {
+      ret = PMT_Search(entry->addr, &block, &page);
+   }
+
+   if (ret == STATUS_SUCCESS && block != INVALID_BLOCK &&
+       block != PATTERN_BLOCK)
+   {
+      /* verify the data of the same hash */
+      ret = UBI_Read(block, page, dedup_buffer, NULL);
+      if (ret == STATUS_SUCCESS &&
+          memcmp(dedup_buffer, buffer, MPP_SIZE) == 0)
+      {
+         *dup_addr = entry->addr;
+      }
+   }
+
+   return ret;
+}
+
+
+void DEDUP_Add(PGADDR addr, UINT32 hash)
+{
+   DEDUP_ENTRY*   entry = &(dedup_index[hash%DEDUP_INDEX_COUNT]);
+
+   entry->hash = hash;
+   entry->addr = addr;
+}
+
+
@@ -37,27 +37,58 @@
 #include "ftl_inc.h"
 
 
-static UINT8      hdi_hash_table[MPP_SIZE];
+/* a byte per slot, in words to be cold down a word at a time */
+static UINT32     hdi_hash_table[MPP_SIZE/sizeof(UINT32)];
 static PAGE_OFF   hdi_current_page;
 static LOG_BLOCK  hdi_current_block;
 
+static const UINT32 hdi_hash_multipliers[] =
+{
+   0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f
+};
+
+/* commits skipped and pages written since the table was last written */
+static UINT32     hdi_skipped_commits;
+static UINT32     hdi_changed_pages;
+
+/* the word to cold down next, and the accesses not paid in cold down */
+static UINT32     hdi_colddown_word;
+static UINT32     hdi_colddown_credit;
 
-/* TODO: choose other hash functions and parameters to optimize HDI */
-#define HDI_FUNCTION(a, i)          (((a)>>((i)*3))&(MPP_SIZE-1))
+
+/* multiply-shift hashes: the slot is the high bits of the address
+ * multiplied by an odd constant, so each hash mixes all address bits,
+ * and neighbouring addresses don't share slots in all hashes.
+ */
+#define HDI_FUNCTION(a, i)                                     \
+            (((UINT32)(a)*hdi_hash_multipliers[i])>>(32-MPP_SIZE_SHIFT))
 #define HDI_FUNC_COUNT              (4)
 #define HDI_HOT_DATA_THERSHOLD      (0x60)
+/* threshold of each temperature, halved for each cooler one */
+#define HDI_TEMPERATURE_THERSHOLD(t)                           \
+            (HDI_HOT_DATA_THERSHOLD>>(DATA_STREAM_COUNT-1-(t)))
 #define HDI_COLDDOWN_DELAY          (0x1000)
 
+#define HDI_SLOT(i)                 (((UINT8*)hdi_hash_table)[i])
+#define HDI_WORD_COUNT              (MPP_SIZE/sizeof(UINT32))
+/* halve the 4 slots in a word */
+#define HDI_HALVE_WORD(w)           (((w)>>1)&0x7f7f7f7f)
+
+/* HDI is advisory, a stale table after power loss only misplaces some
+ * pages in streams. It is written in every HDI_COMMIT_INTERVAL commits, or
+ * after HDI_COMMIT_CHANGES pages are written to change the table.
+ */
+#define HDI_COMMIT_INTERVAL         (16)
+#define HDI_COMMIT_CHANGES          (MPP_SIZE/HDI_FUNC_COUNT)
+
 
 STATUS HDI_Format()
 {
-   UINT32   i;
    STATUS   ret;
 
-   for (i=0; i<MPP_SIZE; i++)
-   {
-      hdi_hash_table[i] = 0;
-   }
+   memset(hdi_hash_table, 0, sizeof(hdi_hash_table));
+   hdi_colddown_word = 0;
+   hdi_colddown_credit = 0;
 
    hdi_current_block = HDI_BLOCK0;
    hdi_current_page = 0;
@@ -66,7 +97,7 @@ STATUS HDI_Format()
    if (ret == STATUS_SUCCESS)
    {
       /* write to UBI */
-      ret = HDI_Commit();
+      ret = HDI_Commit(TRUE);
    }
 
    return ret;
@@ -75,7 +106,6 @@ STATUS HDI_Format()
 
 STATUS HDI_Init()
 {
-   UINT32      i;
    STATUS      ret = STATUS_SUCCESS;
 
    hdi_current_block = PM_NODE_BLOCK(root_table.hdi_current_journal);
@@ -85,109 +115,125 @@ STATUS HDI_Init()
    ret = UBI_Read(hdi_current_block, hdi_current_page, hdi_hash_table, NULL);
    ASSERT(ret == STATUS_SUCCESS);
 
-   /* scan for the first erased page */
-   for (i=hdi_current_page+1; i<PAGE_PER_PHY_BLOCK; i++)
-   {
-      ret = UBI_Read(hdi_current_block, i, NULL, NULL);
-      if (ret != STATUS_SUCCESS)
-      {
-         /* this page is not programmed */
-         hdi_current_page = i;
-         ret = STATUS_SUCCESS;
-         break;
-      }
-   }
-
-   if (i == PAGE_PER_PHY_BLOCK)
-   {
-      ASSERT(ret == STATUS_SUCCESS);
+   /* find the first erased page, or the block is full */
+   hdi_current_page = UBI_FindErasedPage(hdi_current_block,
+                                         hdi_current_page+1,
+                                         1);
 
-      /* current block is full */
-      hdi_current_page = PAGE_PER_PHY_BLOCK;
-   }
-
-   if (ret == STATUS_SUCCESS)
-   {
-      /* skip one page for possible PLR issue */
-      (void)BDT_Commit();
-   }
+   hdi_skipped_commits = 0;
+   hdi_changed_pages = 0;
 
    return ret;
 }
 
 
-BOOL HDI_IsHotPage(PGADDR addr)
+UINT32 HDI_GetTemperature(PGADDR addr)
 {
-   static UINT32  count = 0;
    UINT32         i;
    UINT8*         hot_value;
-   BOOL           ret = TRUE;
+   UINT8          min_value = MAX_UINT8;
+   UINT32         ret;
+
+   hdi_changed_pages ++;
 
    /* increase all hash slots when writing the page */
    for (i=0; i<HDI_FUNC_COUNT; i++)
    {
-      hot_value = &hdi_hash_table[HDI_FUNCTION(addr, i)];
+      hot_value = &HDI_SLOT(HDI_FUNCTION(addr, i));
 
       if (*hot_value != MAX_UINT8)
       {
          (*hot_value) ++;
       }
 
-      if (*hot_value < HDI_HOT_DATA_THERSHOLD)
+      /* the least slot is the closest to the count of the page */
+      if (*hot_value < min_value)
       {
-         ret = FALSE;
+         min_value = *hot_value;
       }
    }
 
-   /* cold down the hash table after every XXX times of access */
-   if (count++ == HDI_COLDDOWN_DELAY)
+   /* grade the count with the thresholds */
+   for (ret=DATA_STREAM_COUNT-1; ret>0; ret--)
    {
-      for (i=0; i<MPP_SIZE; i++)
+      if (min_value >= HDI_TEMPERATURE_THERSHOLD(ret))
       {
-         hdi_hash_table[i] >>= 1;
+         break;
       }
+   }
+
+   /* cold down a few words in each access, instead of the whole table
+    * at once. Each access earns HDI_WORD_COUNT credits, and a word is
+    * halved for HDI_COLDDOWN_DELAY credits, so the whole table is still
+    * halved in every HDI_COLDDOWN_DELAY accesses, without a long loop.
+    */
+   hdi_colddown_credit += HDI_WORD_COUNT;
+   while (hdi_colddown_credit >= HDI_COLDDOWN_DELAY)
+   {
+      hdi_colddown_credit -= HDI_COLDDOWN_DELAY;
+
+      hdi_hash_table[hdi_colddown_word] =
+         HDI_HALVE_WORD(hdi_hash_table[hdi_colddown_word]);
+
+      if (++hdi_colddown_word == HDI_WORD_COUNT)
+      {
+         hdi_colddown_word = 0;
 
-      count = 0;
+         /* all slots are changed */
+         hdi_changed_pages = HDI_COMMIT_CHANGES;
+      }
    }
 
    return ret;
 }
 
 
-STATUS HDI_Commit()
+STATUS HDI_Commit(BOOL force)
 {
    STATUS      ret = STATUS_SUCCESS;
    LOG_BLOCK   next_block = INVALID_BLOCK;
 
-   if (hdi_current_page == PAGE_PER_PHY_BLOCK)
+   if (force == FALSE &&
+       hdi_skipped_commits+1 < HDI_COMMIT_INTERVAL &&
+       hdi_changed_pages < HDI_COMMIT_CHANGES)
+   {
+      /* keep the committed table, it is stale but still a fair hint */
+      hdi_skipped_commits ++;
+   }
+   else
    {
-      /* write data in another block */
-      next_block = hdi_current_block ^ 1;
+      if (hdi_current_page == PAGE_PER_PHY_BLOCK)
+      {
+         /* write data in another block */
+         next_block = hdi_current_block ^ 1;
+
+         /* erase the block before write hdi */
+         ret = UBI_Erase(next_block, next_block);
+         if (ret == STATUS_SUCCESS)
+         {
+            hdi_current_page = 0;
+            hdi_current_block = next_block;
+         }
+      }
 
-      /* erase the block before write bdt */
-      ret = UBI_Erase(next_block, next_block);
+      /* write HDI in ram to UBI */
       if (ret == STATUS_SUCCESS)
       {
-         hdi_current_page = 0;
-         hdi_current_block = next_block;
+         ret = UBI_Write(hdi_current_block,
+                         hdi_current_page,
+                         hdi_hash_table,
+                         NULL,
+                         FALSE);
       }
-   }
-
-   /* write BDT in ram to UBI */
-   if (ret == STATUS_SUCCESS)
-   {
-      ret = UBI_Write(hdi_current_block,
-                      hdi_current_page,
-                      hdi_hash_table,
-                      NULL,
-                      FALSE);
-   }
 
-   if (ret == STATUS_SUCCESS)
-   {
-      PM_NODE_SET_BLOCKPAGE(root_table.hdi_current_journal,
-                            hdi_current_block, hdi_current_page);
-      hdi_current_page ++;
+      if (ret == STATUS_SUCCESS)
+      {
+         PM_NODE_SET_BLOCKPAGE(root_table.hdi_current_journal,
+                               hdi_current_block, hdi_current_page);
+         hdi_current_page ++;
+         hdi_skipped_commits = 0;
+         hdi_changed_pages = 0;
+      }
    }
 
    return ret;
@@ -50,15 +50,41 @@ typedef UINT32                PM_NODE_ADDR;
                      ((p) = ((((blk)<<PAGE_PER_BLOCK_SHIFT)+(page))<<2) + 1)
 #define INVALID_PM_NODE       ((PM_NODE_ADDR)(-1))
 
+/* a PMT entry of a shared page points to its share entry, with bit 1 set.
+ * The bit is not used by other PMT entries, which are always in NAND.
+ */
+#define PM_NODE_IS_SHARED(p)  ((p) != INVALID_PM_NODE && ((p)&0x3) == 0x3)
+#define PM_NODE_SHARE(p)      ((p)>>2)
+#define PM_NODE_SET_SHARE(p, share)  ((p) = ((share)<<2) + 3)
+
+/* a PMT entry of a page filled with one byte keeps the byte, with bit 1 set
+ * and bit 0 cleared. No data page is written for it.
+ */
+#define PM_NODE_IS_PATTERN(p) (((p)&0x3) == 0x2)
+#define PM_NODE_PATTERN(p)    ((p)>>2)
+#define PM_NODE_SET_PATTERN(p, pattern)  ((p) = ((pattern)<<2) + 2)
+
+/* the block of pattern pages in PMT search and update, the page offset is
+ * the byte of the pattern.
+ */
+#define PATTERN_BLOCK         ((LOG_BLOCK)(-2))
+
+#if (CFG_LOG_BLOCK_COUNT_SHIFT+PAGE_PER_BLOCK_SHIFT > 30)
+#error "block and page can not be packed in a PM node!"
+#endif
 
-#if (PAGE_PER_BLOCK_SHIFT <= 8)
+
+/* the dirty count of data blocks can be PAGE_PER_PHY_BLOCK */
+#if (PAGE_PER_PHY_BLOCK < 0x100)
 typedef UINT8        DIRTY_PAGE_COUNT;
 #else
-#error "large block is not supported!"
+typedef UINT16       DIRTY_PAGE_COUNT;
 #endif
 
 
 #define JOURNAL_BLOCK_COUNT         (TOTAL_DIE_COUNT)
+/* erased blocks ready to be the next data journal blocks, one per die */
+#define FREE_JOURNAL_COUNT          (JOURNAL_BLOCK_COUNT)
 #define PM_PER_NODE                 (MPP_SIZE/sizeof(PM_NODE_ADDR))
 
 #define CLUSTER_INDEX(pa)           ((pa)/PM_PER_NODE)
@@ -74,33 +100,105 @@ typedef UINT8        DIRTY_PAGE_COUNT;
 #define HDI_BLOCK0         (4)
 #define HDI_BLOCK1         (5)
 
-#define PMT_START_BLOCK    (6)
+#define PMT_DIR_BLOCK0     (6)
+#define PMT_DIR_BLOCK1     (7)
+
+#define SHARE_BLOCK0       (8)
+#define SHARE_BLOCK1       (9)
+
+#define PMT_START_BLOCK    (10)
 /* TODO: shrink PMT size, by removing PMT of continous pages */
 #define PMT_BLOCK_COUNT    (((CFG_LOG_BLOCK_COUNT+PM_PER_NODE-1)/PM_PER_NODE) * 5)
 
+/* the most clusters of PMT, and the directory pages pointing to them */
+#define PMT_CLUSTER_COUNT  ((CFG_LOG_BLOCK_COUNT*PAGE_PER_PHY_BLOCK+      \
+                             PM_PER_NODE-1)/PM_PER_NODE)
+#define PMT_DIR_PAGE_COUNT ((PMT_CLUSTER_COUNT+PM_PER_NODE-1)/PM_PER_NODE)
+
 #define DATA_START_BLOCK   (PMT_START_BLOCK+PMT_BLOCK_COUNT)
 #define DATA_LAST_BLOCK    (UBI_Capacity-1)
 
 #define MAX_DIRTY_PAGES    (PAGE_PER_PHY_BLOCK-1)
-#define MAX_PM_CLUSTERS    (MPP_SIZE/sizeof(UINT32)-(JOURNAL_BLOCK_COUNT*3+6))
+
+/* data blocks have no summary page */
+#define DATA_MAX_DIRTY_PAGES  (PAGE_PER_PHY_BLOCK)
+
+/* valid page bitmap of blocks, a bit per page */
+#define VALID_MAP_WORDS             ((PAGE_PER_PHY_BLOCK+31)/32)
+#define VALID_MAP(blk)              (&(block_valid_table[(blk)*VALID_MAP_WORDS]))
+#define VALID_MAP_BIT(page)         (((UINT32)1)<<((page)%32))
+#define PAGE_IS_VALID(blk, page)                               \
+            ((VALID_MAP(blk)[(page)/32] & VALID_MAP_BIT(page)) != 0)
+#define PAGE_SET_VALID(blk, page)                              \
+            (BLOCK_SET_CHANGED(blk),                           \
+             VALID_MAP(blk)[(page)/32] |= VALID_MAP_BIT(page))
+#define PAGE_CLEAR_VALID(blk, page)                            \
+            (BLOCK_SET_CHANGED(blk),                           \
+             VALID_MAP(blk)[(page)/32] &= ~VALID_MAP_BIT(page))
+#define BLOCK_CLEAR_VALID(blk)                                 \
+            (BLOCK_SET_CHANGED(blk),                           \
+             memset(VALID_MAP(blk), 0, VALID_MAP_WORDS*sizeof(UINT32)))
+
+/* blocks whose BDT entries changed since the last BDT commit, they are
+ * logged in the next BDT delta. Set it after changing the dirty count
+ * or generation of a block.
+ */
+#define BLOCK_SET_CHANGED(blk)                                 \
+            (block_changed_table[(blk)/32] |= ((UINT32)1)<<((blk)%32))
+
+#define MAX_PMT_DIR_PAGES  (MPP_SIZE/sizeof(UINT32)-                     \
+                            (JOURNAL_BLOCK_COUNT*(DATA_STREAM_COUNT+    \
+                                                  RECLAIM_GENERATION_COUNT)+\
+                             JOURNAL_BLOCK_COUNT+FREE_JOURNAL_COUNT+9))
+
+/* the entries of shared pages, in a page */
+#define SHARE_ENTRY_COUNT  (MPP_SIZE/(sizeof(PM_NODE_ADDR)+sizeof(UINT32)+ \
+                                      2*sizeof(PGADDR)))
+#define INVALID_SHARE      (MAX_UINT32)
+
+/* FNV-1a of page data in dedup */
+#define DEDUP_HASH_BASIS   (2166136261u)
+#define DEDUP_HASH_PRIME   (16777619u)
+
+/* incremental reclaim: the cost of each reclaim step in tokens */
+#define RECLAIM_COPY_COST     (1)
+#define RECLAIM_ERASE_COST    (4)
+#define RECLAIM_COMMIT_COST   (8)
+/* tokens of a background reclaim slice */
+#define RECLAIM_BG_TOKENS     (PAGE_PER_PHY_BLOCK)
+/* pages of a background replay slice after init */
+#define REPLAY_BG_PAGES       (PAGE_PER_PHY_BLOCK)
+/* the most PMT pages replayed in init to update the directory */
+#define PMT_DIR_REPLAY_PAGES  (64)
 
 
 typedef PM_NODE_ADDR       JOURNAL_ADDR;
 typedef PM_NODE_ADDR       PM_NODE[PM_PER_NODE];
 
 typedef struct {
-   /* DATA journal */
-   JOURNAL_ADDR   hot_journal[JOURNAL_BLOCK_COUNT];
-   JOURNAL_ADDR   cold_journal[JOURNAL_BLOCK_COUNT];
-   JOURNAL_ADDR   reclaim_journal[JOURNAL_BLOCK_COUNT];
+   /* DATA journal, streams from the coldest to the hottest */
+   JOURNAL_ADDR   stream_journal[DATA_STREAM_COUNT][JOURNAL_BLOCK_COUNT];
+   JOURNAL_ADDR   reclaim_journal[RECLAIM_GENERATION_COUNT]
+                                 [JOURNAL_BLOCK_COUNT];
+   /* records of pages mapped without data, e.g. pattern pages */
+   JOURNAL_ADDR   record_journal[JOURNAL_BLOCK_COUNT];
+   LOG_BLOCK      free_journal[FREE_JOURNAL_COUNT];
+
+   /* the edition of the next page in data journals */
+   UINT32         data_edition;
 
    /* PMT journal */
    JOURNAL_ADDR   pmt_current_block;
    JOURNAL_ADDR   pmt_reclaim_block;
+   /* the PMT journal when the directory was committed */
+   JOURNAL_ADDR   pmt_directory_journal;
 
    /* HDI journal */
    JOURNAL_ADDR   hdi_current_journal;
 
+   /* share table journal */
+   JOURNAL_ADDR   share_current_journal;
+
    /* BDT journal */
    JOURNAL_ADDR   bdt_current_journal;
 
@@ -110,13 +208,16 @@ typedef struct {
    /* root edition */
    UINT32         root_edition;
 
-   /* PMT nodes: hold all the remaining space in a page */
-   PM_NODE_ADDR   page_mapping_nodes[MAX_PM_CLUSTERS];
+   /* PMT directory pages: hold all the remaining space in a page */
+   PM_NODE_ADDR   pmt_directory_pages[MAX_PMT_DIR_PAGES];
 } ROOT;
 
 
 extern ROOT                root_table;
 extern DIRTY_PAGE_COUNT    block_dirty_table[];
+extern UINT32              block_valid_table[];
+extern UINT8               block_generation_table[];
+extern UINT32              block_changed_table[];
 
 
 /*********************************************************
@@ -142,7 +243,8 @@ STATUS BDT_Format();
  * Funcion Name: BDT_Init
  *
  * Description:
- *    Read the BDT from BDT blocks.
+ *    Read the BDT, valid page bitmap and generation of
+ *    blocks from BDT blocks.
  *
  * Return Value:
  *    STATUS      F/S
@@ -151,7 +253,8 @@ STATUS BDT_Format();
  *    N/A
  *
  * NOTES:
- *    N/A
+ *    Load the last snapshot, and apply the deltas logged
+ *    after it up to the committed one.
  *
  *********************************************************/
 STATUS BDT_Init();
@@ -161,7 +264,8 @@ STATUS BDT_Init();
  * Funcion Name: BDT_Commit
  *
  * Description:
- *    Update BDT to the blocks.
+ *    Update BDT, valid page bitmap and generation of
+ *    blocks to the blocks.
  *
  * Return Value:
  *    STATUS      F/S
@@ -170,7 +274,9 @@ STATUS BDT_Init();
  *    N/A
  *
  * NOTES:
- *    N/A
+ *    Only the entries of changed blocks are logged in a
+ *    delta page, a full snapshot is written when the
+ *    changes don't fit in a page or the block rolls over.
  *
  *********************************************************/
 STATUS BDT_Commit();
@@ -207,13 +313,113 @@ STATUS DATA_Format();
  * Parameter List:
  *    addr     IN    logical page address to write
  *    buffer   IN    the data to write
- *    is_hot   IN    hot data flag
+ *    stream   IN    the data stream to write in
  *
  * NOTES:
  *    N/A
  *
  *********************************************************/
-STATUS DATA_Write(PGADDR addr, void* buffer, BOOL is_hot);
+STATUS DATA_Write(PGADDR addr, void* buffer, UINT32 stream);
+
+
+/*********************************************************
+ * Funcion Name: DATA_WritePattern
+ *
+ * Description:
+ *    Write a page filled with one byte, by mapping it to
+ *    the byte in PMT.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    addr     IN    logical page address to write
+ *    pattern  IN    the byte filled in the page
+ *
+ * NOTES:
+ *    No data page is written. The mapping is logged as a
+ *    record, and many records are programmed in a page
+ *    of the record journal before the next data page.
+ *
+ *********************************************************/
+STATUS DATA_WritePattern(PGADDR addr, UINT8 pattern);
+
+
+/*********************************************************
+ * Funcion Name: DATA_WriteDuplicate
+ *
+ * Description:
+ *    Write a page with the same data as another logical
+ *    page, by sharing the data page of it in PMT.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    src_addr IN    the logical page with the same data
+ *    dst_addr IN    logical page address to write
+ *
+ * NOTES:
+ *    No data page is written. The share is logged as a
+ *    record as in DATA_WritePattern, and replay shares
+ *    the pages again in order. STATUS_SHARE_FULL means
+ *    nothing is mapped, and the data is to be written
+ *    with DATA_Write.
+ *
+ *********************************************************/
+STATUS DATA_WriteDuplicate(PGADDR src_addr, PGADDR dst_addr);
+
+
+/*********************************************************
+ * Funcion Name: DATA_WriteAtomic
+ *
+ * Description:
+ *    Write continuous pages to journals, all of them are
+ *    mapped after power loss, or none of them.
+ *
+ * Return Value:
+ *    STATUS      F/S, STATUS_JOURNAL_FULL if the journal has
+ *                no room for all the pages.
+ *
+ * Parameter List:
+ *    addr        IN    the logical address of the first page
+ *    page_count  IN    count of pages, FTL_ATOMIC_MAX_PAGES
+ *                      at most
+ *    buffers     IN    the data of each page
+ *    stream      IN    the data stream to write in
+ *
+ * NOTES:
+ *    The pages except the last one are tagged in spare,
+ *    replay maps them only with the last page.
+ *
+ *********************************************************/
+STATUS DATA_WriteAtomic(PGADDR   addr,
+                        UINT32   page_count,
+                        void*    buffers[],
+                        UINT32   stream);
+
+
+/*********************************************************
+ * Funcion Name: DATA_WriteRecords
+ *
+ * Description:
+ *    Program the records logged in ram to a page of the
+ *    record journal.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    N/A
+ *
+ * NOTES:
+ *    Called before writing data pages and in idle time.
+ *    Records not programmed are lost in power loss, and
+ *    so are the writes after them. Without room in the
+ *    record journal, the records are kept in a commit.
+ *
+ *********************************************************/
+STATUS DATA_WriteRecords();
 
 
 /*********************************************************
@@ -235,62 +441,178 @@ STATUS DATA_Write(PGADDR addr, void* buffer, BOOL is_hot);
 STATUS DATA_Commit();
 
 
+/*********************************************************
+ * Funcion Name: DATA_Copy
+ *
+ * Description:
+ *    Map a logical page to the data page of another one,
+ *    without copying the data.
+ *
+ * Return Value:
+ *    STATUS      F/S, STATUS_SHARE_FULL if no share entry
+ *                is free for the page.
+ *
+ * Parameter List:
+ *    src_addr    IN    the logical page to copy from
+ *    dst_addr    IN    the logical page to copy to
+ *
+ * NOTES:
+ *    The copy is not logged in journals, it is kept after
+ *    power loss only after a commit.
+ *
+ *********************************************************/
+STATUS DATA_Copy(PGADDR src_addr, PGADDR dst_addr);
+
+
 /*********************************************************
  * Funcion Name: DATA_IsFull
  *
  * Description:
- *    Check if any data journal is full.
+ *    Check if the data journal of a stream has no room for
+ *    some pages, in its blocks and the free blocks can be
+ *    switched in.
  *
  * Return Value:
  *    BOOL        true if full
  *
  * Parameter List:
- *    N/A
+ *    stream      IN    the data stream
+ *    page_count  IN    count of pages to write
  *
  * NOTES:
- *    N/A
+ *    Reclaim must be done before writing a full journal.
  *
  *********************************************************/
-BOOL DATA_IsFull();
+BOOL DATA_IsFull(UINT32 stream, UINT32 page_count);
+
+
+/*********************************************************
+ * Funcion Name: DATA_IsBusy
+ *
+ * Description:
+ *    Check if the dice of all non-full journal blocks of
+ *    a data stream are busy.
+ *
+ * Return Value:
+ *    BOOL        true if busy
+ *
+ * Parameter List:
+ *    stream   IN    the data stream
+ *
+ * NOTES:
+ *    Estimated by the die scheduler in UBI.
+ *
+ *********************************************************/
+BOOL DATA_IsBusy(UINT32 stream);
 
 
 /*********************************************************
  * Funcion Name: DATA_Reclaim
  *
  * Description:
- *    Choose dirtiest data blocks, and copy valid data to 
- *    reclaim blocks. 
+ *    Run reclaim steps within a budget of tokens: choose the
+ *    dirtiest block, copy its valid pages to the reclaim
+ *    journal of the next generation, erase it as a free
+ *    journal block, and commit.
  *
  * Return Value:
- *    STATUS      F/S
+ *    STATUS      F/S, STATUS_RECLAIM_NONE if no dirty block
+ *                can be reclaimed.
+ *
+ * Parameter List:
+ *    budget   IN    tokens to spend, see RECLAIM_XXX_COST
+ *
+ * NOTES:
+ *    The reclaim context is kept between calls, so a block
+ *    is reclaimed by several calls with small budgets. It
+ *    stops early when all free journal blocks are ready.
+ *
+ *********************************************************/
+STATUS DATA_Reclaim(UINT32 budget);
+
+
+/*********************************************************
+ * Funcion Name: DATA_ReclaimBudget
+ *
+ * Description:
+ *    Get the reclaim tokens a page write should pay.
+ *
+ * Return Value:
+ *    UINT32      the tokens, 0 if all free journal blocks
+ *                are ready.
  *
  * Parameter List:
  *    N/A
  *
  * NOTES:
+ *    The budget is the reclaim work to free one block,
+ *    shared by the pages gained from it, and doubled when
+ *    free blocks are running out.
+ *
+ *********************************************************/
+UINT32 DATA_ReclaimBudget();
+
+
+/*********************************************************
+ * Funcion Name: DATA_Replay
+ *
+ * Description:
+ *    Start to replay data in journal blocks to recover
+ *    context.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
  *    N/A
  *
+ * NOTES:
+ *    Only the first page of all journals is read, pages
+ *    are replayed by DATA_ReplayPages().
+ *
  *********************************************************/
-STATUS DATA_Reclaim();
+STATUS DATA_Replay();
 
 
 /*********************************************************
- * Funcion Name: BDT_Commit
+ * Funcion Name: DATA_ReplayPages
  *
  * Description:
- *    Replay data in journal blocks to recover context.
+ *    Replay a slice of pages in journal blocks.
  *
  * Return Value:
  *    STATUS      F/S
  *
  * Parameter List:
- *    journals    IN    the journal to replay
+ *    page_count  IN    the max count of pages to replay
  *
  * NOTES:
+ *    Pages in stream and reclaim journals are replayed
+ *    in the order of edition, following the link in the
+ *    spare of the last page of full journal blocks. The
+ *    replay is done when no page is left to replay.
+ *
+ *********************************************************/
+STATUS DATA_ReplayPages(UINT32 page_count);
+
+
+/*********************************************************
+ * Funcion Name: DATA_IsReplaying
+ *
+ * Description:
+ *    Check if some pages are not replayed after init.
+ *
+ * Return Value:
+ *    BOOL        TRUE if replay is not done
+ *
+ * Parameter List:
  *    N/A
  *
+ * NOTES:
+ *    PMT and BDT are stale until the replay is done.
+ *
  *********************************************************/
-STATUS DATA_Replay(JOURNAL_ADDR* journals);
+BOOL DATA_IsReplaying();
 
 
 /*********************************************************
@@ -332,22 +654,23 @@ STATUS HDI_Init();
 
 
 /*********************************************************
- * Funcion Name: HDI_IsHotPage
+ * Funcion Name: HDI_GetTemperature
  *
  * Description:
- *    Check if the data to read is hot or cold.
+ *    Count the write of a page, and grade how hot it is.
  *
  * Return Value:
- *    STATUS      F/S
+ *    UINT32      the temperature, from 0 (coldest) to
+ *                DATA_STREAM_COUNT-1 (hottest)
  *
  * Parameter List:
  *    addr     IN    the logical address of the page to write
  *
  * NOTES:
- *    N/A
+ *    The temperature is used as the data stream.
  *
  *********************************************************/
-BOOL HDI_IsHotPage(PGADDR addr);
+UINT32 HDI_GetTemperature(PGADDR addr);
 
 
 /*********************************************************
@@ -360,13 +683,326 @@ BOOL HDI_IsHotPage(PGADDR addr);
  *    STATUS      F/S
  *
  * Parameter List:
+ *    force       IN       write the table even if it
+ *                         changed little
+ *
+ * NOTES:
+ *    Without force, the table is written only every
+ *    HDI_COMMIT_INTERVAL commits or after enough page
+ *    writes; the previous table stays committed.
+ *
+ *********************************************************/
+STATUS HDI_Commit(BOOL force);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Format
+ *
+ * Description:
+ *    Format the share table blocks.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
  *    N/A
  *
  * NOTES:
  *    N/A
  *
  *********************************************************/
-STATUS HDI_Commit();
+STATUS SHARE_Format();
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Init
+ *
+ * Description:
+ *    Read the share table from the blocks.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    N/A
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+STATUS SHARE_Init();
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Commit
+ *
+ * Description:
+ *    Update the share table to the blocks.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    force       IN       write the table even if it is
+ *                         not changed
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+STATUS SHARE_Commit(BOOL force);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Add
+ *
+ * Description:
+ *    Take a free share entry for a data page, with one
+ *    logical page mapping to it.
+ *
+ * Return Value:
+ *    UINT32      the share entry, INVALID_SHARE if all
+ *                entries are taken
+ *
+ * Parameter List:
+ *    block       IN    the block of the data page
+ *    page        IN    the page offset in the block
+ *    addr        IN    the logical page mapping to it
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+UINT32 SHARE_Add(LOG_BLOCK block, PAGE_OFF page, PGADDR addr);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_AddRef
+ *
+ * Description:
+ *    Count another logical page mapping to a shared page.
+ *
+ * Return Value:
+ *    N/A
+ *
+ * Parameter List:
+ *    share       IN    the share entry
+ *    addr        IN    the logical page mapping to it
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+void SHARE_AddRef(UINT32 share, PGADDR addr);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Release
+ *
+ * Description:
+ *    Uncount a logical page mapping to a shared page, the
+ *    page is dirty when no logical page maps to it.
+ *
+ * Return Value:
+ *    N/A
+ *
+ * Parameter List:
+ *    share       IN    the share entry
+ *
+ * NOTES:
+ *    The entry is free after the last release.
+ *
+ *********************************************************/
+void SHARE_Release(UINT32 share);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Update
+ *
+ * Description:
+ *    Move a shared page, the old page is dirty.
+ *
+ * Return Value:
+ *    N/A
+ *
+ * Parameter List:
+ *    share       IN    the share entry
+ *    block       IN    new logical block address
+ *    page        IN    new page offset in the block
+ *
+ * NOTES:
+ *    The logical pages mapping to the entry follow it.
+ *
+ *********************************************************/
+void SHARE_Update(UINT32 share, LOG_BLOCK block, PAGE_OFF page);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Search
+ *
+ * Description:
+ *    Find the location of a shared page.
+ *
+ * Return Value:
+ *    N/A
+ *
+ * Parameter List:
+ *    share       IN    the share entry
+ *    block       OUT   logical block address
+ *    page        OUT   page offset in the block
+ *
+ * NOTES:
+ *    INVALID_BLOCK/INVALID_PAGE if the entry is free.
+ *
+ *********************************************************/
+void SHARE_Search(UINT32 share, LOG_BLOCK* block, PAGE_OFF* page);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Find
+ *
+ * Description:
+ *    Find the share entry of a data page.
+ *
+ * Return Value:
+ *    UINT32      the share entry, INVALID_SHARE if the
+ *                page is not shared
+ *
+ * Parameter List:
+ *    block       IN    logical block address
+ *    page        IN    page offset in the block
+ *
+ * NOTES:
+ *    The table is searched only when some pages are
+ *    shared.
+ *
+ *********************************************************/
+UINT32 SHARE_Find(LOG_BLOCK block, PAGE_OFF page);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_GetAddress
+ *
+ * Description:
+ *    Get the count of logical pages mapping to a shared
+ *    page, and the first and the last one of them.
+ *
+ * Return Value:
+ *    UINT32      count of logical pages
+ *
+ * Parameter List:
+ *    share       IN    the share entry
+ *    first_addr  OUT   the logical page of the entry added
+ *    last_addr   OUT   the logical page mapped the last
+ *
+ * NOTES:
+ *    The addresses may be written or trimmed since then.
+ *
+ *********************************************************/
+UINT32 SHARE_GetAddress(UINT32 share, PGADDR* first_addr, PGADDR* last_addr);
+
+
+/*********************************************************
+ * Funcion Name: SHARE_Remove
+ *
+ * Description:
+ *    Free the entry of a shared page, when its last
+ *    logical page maps to the page directly.
+ *
+ * Return Value:
+ *    N/A
+ *
+ * Parameter List:
+ *    share       IN    the share entry
+ *
+ * NOTES:
+ *    The page is still valid.
+ *
+ *********************************************************/
+void SHARE_Remove(UINT32 share);
+
+
+/*********************************************************
+ * Funcion Name: DEDUP_Init
+ *
+ * Description:
+ *    Clear the dedup index.
+ *
+ * Return Value:
+ *    N/A
+ *
+ * Parameter List:
+ *    N/A
+ *
+ * NOTES:
+ *    The index is only in ram, and filled again by the
+ *    following writes.
+ *
+ *********************************************************/
+void DEDUP_Init();
+
+
+/*********************************************************
+ * Funcion Name: DEDUP_Hash
+ *
+ * Description:
+ *    Hash the data of a page.
+ *
+ * Return Value:
+ *    UINT32      the hash
+ *
+ * Parameter List:
+ *    buffer      IN    the data of a page
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+UINT32 DEDUP_Hash(void* buffer);
+
+
+/*********************************************************
+ * Funcion Name: DEDUP_Search
+ *
+ * Description:
+ *    Find an indexed page with the same data as a page to
+ *    write.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    addr        IN    logical page address to write
+ *    buffer      IN    the data to write
+ *    hash        IN    the hash of the data
+ *    dup_addr    OUT   the logical page with the same data,
+ *                      or INVALID_INDEX
+ *
+ * NOTES:
+ *    The data is verified in NAND when the hash matches.
+ *
+ *********************************************************/
+STATUS DEDUP_Search(PGADDR addr, void* buffer, UINT32 hash, PGADDR* dup_addr);
+
+
+/*********************************************************
+ * Funcion Name: DEDUP_Add
+ *
+ * Description:
+ *    Index a page written in journals.
+ *
+ * Return Value:
+ *    N/A
+ *
+ * Parameter List:
+ *    addr        IN    logical page address written
+ *    hash        IN    the hash of the data
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+void DEDUP_Add(PGADDR addr, UINT32 hash);
 
 
 /*********************************************************
@@ -422,12 +1058,82 @@ STATUS PMT_Init();
  *    page           IN    new page offset in the block
  *
  * NOTES:
- *    N/A
+ *    A page of pattern is updated with PATTERN_BLOCK,
+ *    and the byte as the page offset.
  *
  *********************************************************/
 STATUS PMT_Update(PGADDR page_addr, LOG_BLOCK block, PAGE_OFF page);
 
 
+/*********************************************************
+ * Funcion Name: PMT_Reserve
+ *
+ * Description:
+ *    Load the PMT pages of continuous logical pages in
+ *    cache, so they are updated without a commit.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    page_addr      IN    the first logical page address
+ *    page_count     IN    count of pages
+ *
+ * NOTES:
+ *    Commit first if the free cache slots are not enough.
+ *    The pages should be in PMT_CACHE_COUNT clusters.
+ *
+ *********************************************************/
+STATUS PMT_Reserve(PGADDR page_addr, UINT32 page_count);
+
+
+/*********************************************************
+ * Funcion Name: PMT_Share
+ *
+ * Description:
+ *    Map a logical page to the data page of another one,
+ *    both map to the share entry of the data page.
+ *
+ * Return Value:
+ *    STATUS      F/S, STATUS_SHARE_FULL if no share entry
+ *                is free for the page.
+ *
+ * Parameter List:
+ *    src_addr       IN    the logical page to copy from
+ *    dst_addr       IN    the logical page to copy to
+ *
+ * NOTES:
+ *    The destination is trimmed if the source is not
+ *    mapped.
+ *
+ *********************************************************/
+STATUS PMT_Share(PGADDR src_addr, PGADDR dst_addr);
+
+
+/*********************************************************
+ * Funcion Name: PMT_Unshare
+ *
+ * Description:
+ *    Map the only logical page of a shared page to the
+ *    page directly, and free the share entry.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    share          IN    the share entry
+ *    page_addr      OUT   the logical page, INVALID_INDEX
+ *                         if the page is still shared
+ *
+ * NOTES:
+ *    Only the first and the last logical pages of the
+ *    entry are checked, the page is kept shared if the
+ *    only one is another.
+ *
+ *********************************************************/
+STATUS PMT_Unshare(UINT32 share, PGADDR* page_addr);
+
+
 /*********************************************************
  * Funcion Name: PMT_Search
  *
@@ -443,12 +1149,40 @@ STATUS PMT_Update(PGADDR page_addr, LOG_BLOCK block, PAGE_OFF page);
  *    page           OUT   valid page offset in the block
  *
  * NOTES:
- *    N/A
+ *    A page of pattern is found in PATTERN_BLOCK, with
+ *    the byte as the page offset.
  *
  *********************************************************/
 STATUS PMT_Search(PGADDR logcial_addr, LOG_BLOCK* block, PAGE_OFF* page);
 
 
+/*********************************************************
+ * Funcion Name: PMT_SearchBuffer
+ *
+ * Description:
+ *    Find the location of the logical page, without
+ *    loading the PMT page in cache.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    page_addr      IN    the logical page address
+ *    block          OUT   valid logical block address
+ *    page           OUT   valid page offset in the block
+ *    buffer         IN    a page buffer to read the PMT page
+ *
+ * NOTES:
+ *    Used in read-only mode, when no cache can be released
+ *    without a commit.
+ *
+ *********************************************************/
+STATUS PMT_SearchBuffer(PGADDR      page_addr,
+                        LOG_BLOCK*  block,
+                        PAGE_OFF*   page,
+                        void*       buffer);
+
+
 /*********************************************************
  * Funcion Name: PMT_Load
  *
@@ -483,12 +1217,37 @@ STATUS PMT_Load(LOG_BLOCK block, PAGE_OFF page, PMT_CLUSTER cluster);
  *    N/A
  *
  * NOTES:
- *    N/A
+ *    The directory pages pointing to the written PMT
+ *    pages are also committed.
  *
  *********************************************************/
 STATUS PMT_Commit();
 
 
+/*********************************************************
+ * Funcion Name: PMT_CommitDirectory
+ *
+ * Description:
+ *    Write the changed PMT directory pages to the
+ *    directory blocks, and point ROOT to them.
+ *
+ * Return Value:
+ *    STATUS      F/S
+ *
+ * Parameter List:
+ *    force       IN       write all directory pages
+ *
+ * NOTES:
+ *    Without force, the directory is written only after
+ *    a PMT block is reclaimed or PMT_DIR_REPLAY_PAGES
+ *    PMT pages are written, the later PMT pages are
+ *    replayed in init. The whole directory is written in
+ *    the other block when the current block is full.
+ *
+ *********************************************************/
+STATUS PMT_CommitDirectory(BOOL force);
+
+
 /*********************************************************
  * Funcion Name: ROOT_Format
  *
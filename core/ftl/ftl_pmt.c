@@ -24,10 +24,13 @@
  * First written on 2010-01-01 by cranechu@gmail.com
  *
  * Module Description:
- *    Page Mapping Table. It contains 2 layers of table. 
- *    The first layer is ROOT, and points to every second
- *       layer of PMT (aka. CLUSTER)
- *    The second layer is PMT pages, and holding logical 
+ *    Page Mapping Table. It contains 3 layers of table. 
+ *    The first layer is ROOT, and points to the directory
+ *       pages of PMT.
+ *    The second layer is the directory, and points to every
+ *       PMT page (aka. CLUSTER). It is all cached in RAM,
+ *       and only the changed pages are written in commit.
+ *    The third layer is PMT pages, and holding logical 
  *       page mapping info, pointing to UBI block/page.
  *
  *********************************************************/
@@ -47,6 +50,13 @@
 #define PMT_RECLAIM_BLOCK  (PM_NODE_BLOCK(root_table.pmt_reclaim_block))
 #define PMT_RECLAIM_PAGE   (PM_NODE_PAGE(root_table.pmt_reclaim_block))
 
+/* the PM node of a cluster in the directory */
+#define PMT_DIR_PAGE(cluster)       ((cluster)/PM_PER_NODE)
+#define PMT_CLUSTER_NODE(cluster)   (pmt_directory[PMT_DIR_PAGE(cluster)] \
+                                                  [(cluster)%PM_PER_NODE])
+#define PMT_CLUSTER_SET_CHANGED(cluster)                       \
+            (pmt_directory_changed[PMT_DIR_PAGE(cluster)] = TRUE)
+
 
 #if defined(__ICCARM__)
 /* must be aligned to 4bytes, because the lowest 2 bits is reserved */
@@ -56,17 +66,43 @@ static PM_NODE          pm_node_caches[PMT_CACHE_COUNT];
 
 static PM_NODE_ADDR     pm_cache_origin_location[PMT_CACHE_COUNT];
 static PMT_CLUSTER      pm_cache_cluster[PMT_CACHE_COUNT];
-/* meta data in last page */
-static PMT_CLUSTER      meta_data[PAGE_PER_PHY_BLOCK];
+/* meta data in last page, the cluster of each page in the block */
+#if (PAGE_PER_PHY_BLOCK > MPP_SIZE/4)
+#error "the meta data page can not hold the clusters of a block!"
+#endif
+static PMT_CLUSTER      meta_data[MPP_SIZE/sizeof(PMT_CLUSTER)];
 
 /* buffer used in reclaim */
 static PMT_CLUSTER      clusters[MPP_SIZE/sizeof(PMT_CLUSTER)];
-static UINT8            pm_node_buffer[MPP_SIZE];
+
+/* directory of PMT, and the pages changed since the last commit */
+static PM_NODE          pmt_directory[PMT_DIR_PAGE_COUNT];
+static BOOL             pmt_directory_changed[PMT_DIR_PAGE_COUNT];
+static UINT32           pmt_directory_page_count;
+
+/* directory journal */
+static LOG_BLOCK        pmt_directory_block;
+static PAGE_OFF         pmt_directory_page;
+
+/* a PMT block is reclaimed since the directory commit */
+static BOOL             pmt_block_reclaimed;
 
 
 static
 STATUS pmt_reclaim_blocks();
 
+static
+void pmt_clear_cache();
+
+static
+STATUS pmt_load_cluster(PMT_CLUSTER cluster);
+
+static
+void pmt_release(PM_NODE_ADDR pm_node);
+
+static
+void pmt_resolve(PM_NODE_ADDR pm_node, LOG_BLOCK* block, PAGE_OFF* page);
+
 
 STATUS PMT_Format()
 {
@@ -80,8 +116,15 @@ STATUS PMT_Format()
    UINT32         pmt_cluster_count = ((FTL_Capacity()+PM_PER_NODE-1) / 
                                        PM_PER_NODE);
 
-   /* root table has enough space to hold 1st level of pmt */
-   ASSERT(pmt_cluster_count < MAX_PM_CLUSTERS);
+   pmt_directory_page_count = ((pmt_cluster_count+PM_PER_NODE-1) /
+                               PM_PER_NODE);
+
+   /* the directory is in RAM, root table has enough space to point to
+    * its pages, and they can be written in a block.
+    */
+   ASSERT(pmt_cluster_count <= PMT_CLUSTER_COUNT);
+   ASSERT(pmt_directory_page_count <= MAX_PMT_DIR_PAGES);
+   ASSERT(pmt_directory_page_count <= PAGE_PER_PHY_BLOCK);
 
    for (i=0; i<pmt_cluster_count; i++)
    {
@@ -102,8 +145,7 @@ STATUS PMT_Format()
       {
          meta_data[pmt_page] = i;
 
-         PM_NODE_SET_BLOCKPAGE(root_table.page_mapping_nodes[i],
-                               pmt_block, pmt_page);
+         PM_NODE_SET_BLOCKPAGE(PMT_CLUSTER_NODE(i), pmt_block, pmt_page);
 
          /* last page is reserved for meta data */
          if (pmt_page < PAGE_PER_PHY_BLOCK-1)
@@ -137,6 +179,20 @@ STATUS PMT_Format()
       block_dirty_table[pmt_block+1] = 0;
    }
 
+   if (ret == STATUS_SUCCESS)
+   {
+      /* write the whole directory */
+      pmt_directory_block = PMT_DIR_BLOCK0;
+      pmt_directory_page = 0;
+
+      ret = UBI_Erase(pmt_directory_block, pmt_directory_block);
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = PMT_CommitDirectory(TRUE);
+   }
+
    return ret;
 }
 
@@ -144,17 +200,70 @@ STATUS PMT_Format()
 STATUS PMT_Init()
 {
    UINT32   i;
+   PAGE_OFF last_page = 0;
+   PAGE_OFF page;
+   SPARE    spare;
    STATUS   ret = STATUS_SUCCESS;
 
-   /* init cache */
-   for (i=0; i<PMT_CACHE_COUNT; i++)
+   pmt_directory_page_count = ((FTL_Capacity()+PM_PER_NODE-1)/PM_PER_NODE +
+                               PM_PER_NODE-1) / PM_PER_NODE;
+
+   /* all directory pages are in the same block */
+   pmt_directory_block = PM_NODE_BLOCK(root_table.pmt_directory_pages[0]);
+
+   /* read out the directory */
+   for (i=0; i<pmt_directory_page_count && ret==STATUS_SUCCESS; i++)
    {
-      memset(pm_node_caches[i], 0, MPP_SIZE);
-      pm_cache_origin_location[i] = INVALID_PM_NODE;
-      pm_cache_cluster[i] = INVALID_CLUSTER;
+      ASSERT(PM_NODE_BLOCK(root_table.pmt_directory_pages[i]) ==
+             pmt_directory_block);
+
+      ret = UBI_Read(pmt_directory_block,
+                     PM_NODE_PAGE(root_table.pmt_directory_pages[i]),
+                     pmt_directory[i],
+                     NULL);
+      if (ret == STATUS_SUCCESS)
+      {
+         pmt_directory_changed[i] = FALSE;
+         if (PM_NODE_PAGE(root_table.pmt_directory_pages[i]) > last_page)
+         {
+            last_page = PM_NODE_PAGE(root_table.pmt_directory_pages[i]);
+         }
+      }
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      /* find the first erased page, or the block is full */
+      pmt_directory_page = UBI_FindErasedPage(pmt_directory_block,
+                                              last_page+1,
+                                              1);
+      pmt_block_reclaimed = FALSE;
+
+      /* PLR: the PMT is only validated after writing ROOT. */
+      pmt_clear_cache();
    }
 
-   /* PLR: the PMT is only validated after writing ROOT. do some test. */
+   if (ret == STATUS_SUCCESS)
+   {
+      /* replay the PMT pages written after the directory commit, the
+       * cluster of each page is in its spare.
+       */
+      ASSERT(PM_NODE_BLOCK(root_table.pmt_directory_journal) ==
+             PMT_CURRENT_BLOCK);
+
+      for (page=PM_NODE_PAGE(root_table.pmt_directory_journal);
+           page<PMT_CURRENT_PAGE && ret==STATUS_SUCCESS;
+           page++)
+      {
+         ret = UBI_Read(PMT_CURRENT_BLOCK, page, NULL, spare);
+         if (ret == STATUS_SUCCESS)
+         {
+            PM_NODE_SET_BLOCKPAGE(PMT_CLUSTER_NODE(spare[0]),
+                                  PMT_CURRENT_BLOCK, page);
+            PMT_CLUSTER_SET_CHANGED(spare[0]);
+         }
+      }
+   }
 
    return ret;
 }
@@ -164,36 +273,28 @@ STATUS PMT_Update(PGADDR page_addr, LOG_BLOCK block, PAGE_OFF page)
 {
    PMT_CLUSTER    cluster = CLUSTER_INDEX(page_addr);
    PM_NODE_ADDR*  cluster_addr;
-   LOG_BLOCK      edit_block;
-   STATUS         ret = STATUS_SUCCESS;
-
-   if (PM_NODE_IS_CACHED(root_table.page_mapping_nodes[cluster]) == FALSE)
-   {
-      /* load page in cache before updating bdt/hdi/root,
-       * because it may cause a commit.
-       */
-      ret = PMT_Load(PM_NODE_BLOCK(root_table.page_mapping_nodes[cluster]),
-                     PM_NODE_PAGE(root_table.page_mapping_nodes[cluster]),
-                     cluster);
-   }
+   STATUS         ret;
 
+   /* load page in cache before updating bdt/hdi/root,
+    * because it may cause a commit.
+    */
+   ret = pmt_load_cluster(cluster);
    if (ret == STATUS_SUCCESS)
    {
-      cluster_addr = PM_NODE_ADDRESS(root_table.page_mapping_nodes[cluster]);
-      if (cluster_addr[PAGE_IN_CLUSTER(page_addr)] != INVALID_PM_NODE)
-      {
-         /* update BDT: increase dirty page count of the edited block */
-         edit_block = PM_NODE_BLOCK(cluster_addr[PAGE_IN_CLUSTER(page_addr)]);
-         block_dirty_table[edit_block] ++;
-         ASSERT(block_dirty_table[edit_block] <= MAX_DIRTY_PAGES);
-      }
+      cluster_addr = PM_NODE_ADDRESS(PMT_CLUSTER_NODE(cluster));
+      pmt_release(cluster_addr[PAGE_IN_CLUSTER(page_addr)]);
 
       /* update PMT */
-      if (block != INVALID_BLOCK)
+      if (block == PATTERN_BLOCK)
+      {
+         PM_NODE_SET_PATTERN(cluster_addr[PAGE_IN_CLUSTER(page_addr)], page);
+      }
+      else if (block != INVALID_BLOCK)
       {
          ASSERT(page != INVALID_PAGE);
          PM_NODE_SET_BLOCKPAGE(cluster_addr[PAGE_IN_CLUSTER(page_addr)],
                                block, page);
+         PAGE_SET_VALID(block, page);
       }
       else
       {
@@ -205,7 +306,171 @@ STATUS PMT_Update(PGADDR page_addr, LOG_BLOCK block, PAGE_OFF page)
       }
 
       /* set dirty bit */
-      PM_NODE_SET_DIRTY(root_table.page_mapping_nodes[cluster]);
+      PM_NODE_SET_DIRTY(PMT_CLUSTER_NODE(cluster));
+   }
+
+   return ret;
+}
+
+
+STATUS PMT_Reserve(PGADDR page_addr, UINT32 page_count)
+{
+   PMT_CLUSTER    first = CLUSTER_INDEX(page_addr);
+   PMT_CLUSTER    last;
+   PMT_CLUSTER    cluster;
+   UINT32         i;
+   UINT32         free_count = 0;
+   UINT32         load_count = 0;
+   STATUS         ret = STATUS_SUCCESS;
+
+   /* clusters out of the capacity are not formatted */
+   last = CLUSTER_INDEX(MIN(page_addr+page_count, FTL_Capacity())-1);
+   ASSERT(last-first < PMT_CACHE_COUNT);
+
+   for (i=0; i<PMT_CACHE_COUNT; i++)
+   {
+      if (pm_cache_origin_location[i] == INVALID_PM_NODE)
+      {
+         free_count ++;
+      }
+   }
+
+   for (cluster=first; cluster<=last; cluster++)
+   {
+      if (PM_NODE_IS_CACHED(PMT_CLUSTER_NODE(cluster)) == FALSE)
+      {
+         load_count ++;
+      }
+   }
+
+   if (load_count > free_count && FTL_IsReadOnly() == FALSE)
+   {
+      /* commit once here, instead of between the loads */
+      ret = DATA_Commit();
+   }
+
+   for (cluster=first; cluster<=last && ret == STATUS_SUCCESS; cluster++)
+   {
+      if (PM_NODE_IS_CACHED(PMT_CLUSTER_NODE(cluster)) == FALSE)
+      {
+         ret = PMT_Load(PM_NODE_BLOCK(PMT_CLUSTER_NODE(cluster)),
+                        PM_NODE_PAGE(PMT_CLUSTER_NODE(cluster)),
+                        cluster);
+      }
+   }
+
+   return ret;
+}
+
+
+STATUS PMT_Share(PGADDR src_addr, PGADDR dst_addr)
+{
+   PMT_CLUSTER    src_cluster = CLUSTER_INDEX(src_addr);
+   PMT_CLUSTER    dst_cluster = CLUSTER_INDEX(dst_addr);
+   PM_NODE_ADDR*  src_node;
+   PM_NODE_ADDR*  dst_node;
+   UINT32         share;
+   STATUS         ret;
+
+   /* load both PMT pages, the commit in loading the source may release
+    * the destination, then it is loaded again without a commit.
+    */
+   ret = pmt_load_cluster(dst_cluster);
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = pmt_load_cluster(src_cluster);
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = pmt_load_cluster(dst_cluster);
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      src_node = &(PM_NODE_ADDRESS(PMT_CLUSTER_NODE(src_cluster))
+                                  [PAGE_IN_CLUSTER(src_addr)]);
+      dst_node = &(PM_NODE_ADDRESS(PMT_CLUSTER_NODE(dst_cluster))
+                                  [PAGE_IN_CLUSTER(dst_addr)]);
+
+      if (*src_node == INVALID_PM_NODE)
+      {
+         /* nothing to share, trim the destination */
+         ret = PMT_Update(dst_addr, INVALID_BLOCK, INVALID_PAGE);
+      }
+      else if (PM_NODE_IS_SHARED(*src_node) == FALSE &&
+               PM_NODE_IS_PATTERN(*src_node) == FALSE)
+      {
+         /* map the source to a new share entry of its page */
+         share = SHARE_Add(PM_NODE_BLOCK(*src_node),
+                           PM_NODE_PAGE(*src_node),
+                           src_addr);
+         if (share != INVALID_SHARE)
+         {
+            PM_NODE_SET_SHARE(*src_node, share);
+            PM_NODE_SET_DIRTY(PMT_CLUSTER_NODE(src_cluster));
+         }
+         else
+         {
+            ret = STATUS_SHARE_FULL;
+         }
+      }
+   }
+
+   if (ret == STATUS_SUCCESS && *src_node != INVALID_PM_NODE &&
+       *dst_node != *src_node)
+   {
+      /* a pattern is copied in the PMT entry */
+      if (PM_NODE_IS_SHARED(*src_node) == TRUE)
+      {
+         SHARE_AddRef(PM_NODE_SHARE(*src_node), dst_addr);
+      }
+
+      pmt_release(*dst_node);
+
+      *dst_node = *src_node;
+      PM_NODE_SET_DIRTY(PMT_CLUSTER_NODE(dst_cluster));
+   }
+
+   return ret;
+}
+
+
+STATUS PMT_Unshare(UINT32 share, PGADDR* page_addr)
+{
+   PGADDR         addrs[2];
+   PM_NODE_ADDR*  pm_node;
+   LOG_BLOCK      block;
+   PAGE_OFF       page;
+   UINT32         i;
+   STATUS         ret = STATUS_SUCCESS;
+
+   *page_addr = INVALID_INDEX;
+
+   if (SHARE_GetAddress(share, &addrs[0], &addrs[1]) == 1)
+   {
+      for (i=0; i<2 && *page_addr == INVALID_INDEX && ret == STATUS_SUCCESS;
+           i++)
+      {
+         ret = pmt_load_cluster(CLUSTER_INDEX(addrs[i]));
+         if (ret == STATUS_SUCCESS)
+         {
+            pm_node = &(PM_NODE_ADDRESS(PMT_CLUSTER_NODE(
+                                          CLUSTER_INDEX(addrs[i])))
+                                       [PAGE_IN_CLUSTER(addrs[i])]);
+            if (PM_NODE_IS_SHARED(*pm_node) == TRUE &&
+                PM_NODE_SHARE(*pm_node) == share)
+            {
+               /* the only logical page of the entry */
+               SHARE_Search(share, &block, &page);
+               PM_NODE_SET_BLOCKPAGE(*pm_node, block, page);
+               PM_NODE_SET_DIRTY(PMT_CLUSTER_NODE(CLUSTER_INDEX(addrs[i])));
+               SHARE_Remove(share);
+
+               *page_addr = addrs[i];
+            }
+         }
+      }
    }
 
    return ret;
@@ -219,31 +484,51 @@ STATUS PMT_Search(PGADDR page_addr, LOG_BLOCK* block, PAGE_OFF* page)
    PM_NODE_ADDR   pm_node;
    STATUS         ret = STATUS_SUCCESS;
 
-   if (PM_NODE_IS_CACHED(root_table.page_mapping_nodes[cluster]) == FALSE)
+   if (PM_NODE_IS_CACHED(PMT_CLUSTER_NODE(cluster)) == FALSE)
    {
       /* load page in cache */
-      ret = PMT_Load(PM_NODE_BLOCK(root_table.page_mapping_nodes[cluster]),
-                     PM_NODE_PAGE(root_table.page_mapping_nodes[cluster]),
+      ret = PMT_Load(PM_NODE_BLOCK(PMT_CLUSTER_NODE(cluster)),
+                     PM_NODE_PAGE(PMT_CLUSTER_NODE(cluster)),
                      cluster);
    }
 
    if (ret == STATUS_SUCCESS)
    {
-      ASSERT(root_table.page_mapping_nodes[cluster] != INVALID_PM_NODE);
-      cluster_addr = PM_NODE_ADDRESS(root_table.page_mapping_nodes[cluster]);
+      ASSERT(PMT_CLUSTER_NODE(cluster) != INVALID_PM_NODE);
+      cluster_addr = PM_NODE_ADDRESS(PMT_CLUSTER_NODE(cluster));
       ASSERT(cluster_addr != 0);
       pm_node = cluster_addr[PAGE_IN_CLUSTER(page_addr)];
-      if (pm_node != INVALID_PM_NODE)
-      {
-         *block = PM_NODE_BLOCK(pm_node);
-         *page = PM_NODE_PAGE(pm_node);
-      }
-      else
+      pmt_resolve(pm_node, block, page);
+   }
+
+   return ret;
+}
+
+
+STATUS PMT_SearchBuffer(PGADDR      page_addr,
+                        LOG_BLOCK*  block,
+                        PAGE_OFF*   page,
+                        void*       buffer)
+{
+   PM_NODE_ADDR   pm_node = PMT_CLUSTER_NODE(CLUSTER_INDEX(page_addr));
+   STATUS         ret = STATUS_SUCCESS;
+
+   if (PM_NODE_IS_CACHED(pm_node) == FALSE)
+   {
+      ret = UBI_Read(PM_NODE_BLOCK(pm_node),
+                     PM_NODE_PAGE(pm_node),
+                     buffer,
+                     NULL);
+      if (ret == STATUS_SUCCESS)
       {
-         *block = INVALID_BLOCK;
-         *page = INVALID_PAGE;
+         pm_node = ((PM_NODE_ADDR*)buffer)[PAGE_IN_CLUSTER(page_addr)];
+         pmt_resolve(pm_node, block, page);
       }
    }
+   else
+   {
+      ret = PMT_Search(page_addr, block, page);
+   }
 
    return ret;
 }
@@ -264,7 +549,26 @@ STATUS PMT_Load(LOG_BLOCK block, PAGE_OFF page, PMT_CLUSTER cluster)
       }
    }
 
-   if (i == PMT_CACHE_COUNT)
+   if (i == PMT_CACHE_COUNT && FTL_IsReadOnly() == TRUE)
+   {
+      /* no commit in read-only mode, release a clean cache */
+      for (i=0; i<PMT_CACHE_COUNT; i++)
+      {
+         if (PM_NODE_IS_DIRTY(
+               PMT_CLUSTER_NODE(pm_cache_cluster[i])) == FALSE)
+         {
+            PMT_CLUSTER_NODE(pm_cache_cluster[i]) =
+                                                pm_cache_origin_location[i];
+            break;
+         }
+      }
+
+      if (i == PMT_CACHE_COUNT)
+      {
+         ret = STATUS_FAILURE;
+      }
+   }
+   else if (i == PMT_CACHE_COUNT)
    {
       i = 0;
 
@@ -273,8 +577,8 @@ STATUS PMT_Load(LOG_BLOCK block, PAGE_OFF page, PMT_CLUSTER cluster)
       if (ret == STATUS_SUCCESS)
       {
          /* use updated PMT block and page */
-         block = PM_NODE_BLOCK(root_table.page_mapping_nodes[cluster]);
-         page = PM_NODE_PAGE(root_table.page_mapping_nodes[cluster]);
+         block = PM_NODE_BLOCK(PMT_CLUSTER_NODE(cluster));
+         page = PM_NODE_PAGE(PMT_CLUSTER_NODE(cluster));
       }
    }
 
@@ -291,7 +595,7 @@ STATUS PMT_Load(LOG_BLOCK block, PAGE_OFF page, PMT_CLUSTER cluster)
       PM_NODE_SET_BLOCKPAGE(pm_cache_origin_location[i], block, page);
 
       /* update the cache address in memory to PMT table */
-      root_table.page_mapping_nodes[cluster] = (UINT32)(cache_addr);
+      PMT_CLUSTER_NODE(cluster) = (UINT32)(cache_addr);
       
       /* the page mapping should be clean in ram */
       ASSERT((((UINT32)(cache_addr))&0x3) == 0);
@@ -318,12 +622,12 @@ STATUS PMT_Commit()
          continue;
       }
 
-      pm_node = root_table.page_mapping_nodes[pm_cache_cluster[i]];
+      pm_node = PMT_CLUSTER_NODE(pm_cache_cluster[i]);
       ASSERT(PM_NODE_IS_CACHED(pm_node) == TRUE);
       if (PM_NODE_IS_DIRTY(pm_node) == FALSE)
       {
          /* update pmt in root table */
-         root_table.page_mapping_nodes[pm_cache_cluster[i]] =
+         PMT_CLUSTER_NODE(pm_cache_cluster[i]) =
                                                 pm_cache_origin_location[i];
          continue;
       }
@@ -354,8 +658,9 @@ STATUS PMT_Commit()
             LOG_BLOCK      old_pm_block;
 
             /* update pmt in root table */
-            PM_NODE_SET_BLOCKPAGE(root_table.page_mapping_nodes[pm_cluster],
+            PM_NODE_SET_BLOCKPAGE(PMT_CLUSTER_NODE(pm_cluster),
                                   PMT_CURRENT_BLOCK, PMT_CURRENT_PAGE);
+            PMT_CLUSTER_SET_CHANGED(pm_cluster);
 
             /* update pmt journal */
             PM_NODE_SET_BLOCKPAGE(root_table.pmt_current_block,
@@ -365,6 +670,7 @@ STATUS PMT_Commit()
             old_pm_block = PM_NODE_BLOCK(pm_cache_origin_location[i]);
 
             block_dirty_table[old_pm_block] ++;
+            BLOCK_SET_CHANGED(old_pm_block);
             ASSERT(block_dirty_table[old_pm_block] <= MAX_DIRTY_PAGES);
          }
       }
@@ -395,8 +701,79 @@ STATUS PMT_Commit()
 
    if (ret == STATUS_SUCCESS)
    {
-      /* init the PMT to clear all cache */
-      ret = PMT_Init();
+      /* clear all cache, and write the changed directory pages */
+      pmt_clear_cache();
+
+      ret = PMT_CommitDirectory(FALSE);
+   }
+
+   return ret;
+}
+
+
+STATUS PMT_CommitDirectory(BOOL force)
+{
+   UINT32      i;
+   UINT32      changed_pages = 0;
+   SPARE       spare;
+   STATUS      ret = STATUS_SUCCESS;
+
+   if (force == FALSE &&
+       pmt_block_reclaimed == FALSE &&
+       PMT_CURRENT_PAGE < PM_NODE_PAGE(root_table.pmt_directory_journal) +
+                          PMT_DIR_REPLAY_PAGES)
+   {
+      /* keep the committed directory, the PMT pages after the directory
+       * journal are replayed in init.
+       */
+   }
+   else
+   {
+      for (i=0; i<pmt_directory_page_count; i++)
+      {
+         if (force == TRUE || pmt_directory_changed[i] == TRUE)
+         {
+            changed_pages ++;
+         }
+      }
+
+      if (pmt_directory_page+changed_pages > PAGE_PER_PHY_BLOCK)
+      {
+         /* write the whole directory in another block */
+         pmt_directory_block ^= 1;
+         pmt_directory_page = 0;
+         force = TRUE;
+
+         ret = UBI_Erase(pmt_directory_block, pmt_directory_block);
+      }
+
+      for (i=0; i<pmt_directory_page_count && ret==STATUS_SUCCESS; i++)
+      {
+         if (force == FALSE && pmt_directory_changed[i] == FALSE)
+         {
+            continue;
+         }
+
+         spare[0] = i;
+         ret = UBI_Write(pmt_directory_block,
+                         pmt_directory_page,
+                         pmt_directory[i],
+                         spare,
+                         FALSE);
+         if (ret == STATUS_SUCCESS)
+         {
+            PM_NODE_SET_BLOCKPAGE(root_table.pmt_directory_pages[i],
+                                  pmt_directory_block, pmt_directory_page);
+            pmt_directory_changed[i] = FALSE;
+            pmt_directory_page ++;
+         }
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         root_table.pmt_directory_journal = root_table.pmt_current_block;
+         pmt_block_reclaimed = FALSE;
+      }
    }
 
    return ret;
@@ -466,7 +843,7 @@ STATUS pmt_reclaim_blocks()
             for (page=0; page<PAGE_PER_PHY_BLOCK-1; page++)
             {
                PMT_CLUSTER    cluster = clusters[page];
-               PM_NODE_ADDR   pm_node = root_table.page_mapping_nodes[cluster];
+               PM_NODE_ADDR   pm_node = PMT_CLUSTER_NODE(cluster);
                UINT32         cleared_cache_index = INVALID_INDEX;
 
                /* if cached, just need to copy clean page */
@@ -501,21 +878,19 @@ STATUS pmt_reclaim_blocks()
                    PM_NODE_PAGE(pm_node) == page)
                {
                   /* copy valid page to reclaim block */
-                  ret = UBI_Read(dirty_block, page, pm_node_buffer, NULL);
-                  if (ret == STATUS_SUCCESS)
-                  {
-                     ret = UBI_Write(reclaim_block,
-                                     reclaim_page,
-                                     pm_node_buffer,
-                                     NULL,
-                                     FALSE);
-                  }
+                  ret = UBI_Copy(dirty_block,
+                                 page,
+                                 reclaim_block,
+                                 reclaim_page,
+                                 NULL,
+                                 FALSE);
 
                   if (ret == STATUS_SUCCESS)
                   {
                      /* update mapping */
-                     PM_NODE_SET_BLOCKPAGE(root_table.page_mapping_nodes[cluster],
+                     PM_NODE_SET_BLOCKPAGE(PMT_CLUSTER_NODE(cluster),
                                            reclaim_block, reclaim_page);
+                     PMT_CLUSTER_SET_CHANGED(cluster);
                      meta_data[reclaim_page] = cluster;
                      reclaim_page ++;
 
@@ -543,10 +918,13 @@ STATUS pmt_reclaim_blocks()
                                   reclaim_block, reclaim_page);
             PM_NODE_SET_BLOCKPAGE(root_table.pmt_reclaim_block,
                                   dirty_block, 0);
+            pmt_block_reclaimed = TRUE;
 
             /* reset the BDT */
             block_dirty_table[reclaim_block] = 0;
             block_dirty_table[dirty_block] = 0;
+            BLOCK_SET_CHANGED(reclaim_block);
+            BLOCK_SET_CHANGED(dirty_block);
          }
       }
       else
@@ -560,9 +938,11 @@ STATUS pmt_reclaim_blocks()
          if (ret == STATUS_SUCCESS)
          {
             PM_NODE_SET_BLOCKPAGE(root_table.pmt_current_block, i, 0);
+            pmt_block_reclaimed = TRUE;
 
             /* reset the BDT */
             block_dirty_table[i] = 0;
+            BLOCK_SET_CHANGED(i);
          }
       }
    }
@@ -571,3 +951,85 @@ STATUS pmt_reclaim_blocks()
 }
 
 
+static
+void pmt_clear_cache()
+{
+   UINT32   i;
+
+   for (i=0; i<PMT_CACHE_COUNT; i++)
+   {
+      memset(pm_node_caches[i], 0, MPP_SIZE);
+      pm_cache_origin_location[i] = INVALID_PM_NODE;
+      pm_cache_cluster[i] = INVALID_CLUSTER;
+   }
+}
+
+
+static
+STATUS pmt_load_cluster(PMT_CLUSTER cluster)
+{
+   STATUS   ret = STATUS_SUCCESS;
+
+   if (PM_NODE_IS_CACHED(PMT_CLUSTER_NODE(cluster)) == FALSE)
+   {
+      ret = PMT_Load(PM_NODE_BLOCK(PMT_CLUSTER_NODE(cluster)),
+                     PM_NODE_PAGE(PMT_CLUSTER_NODE(cluster)),
+                     cluster);
+   }
+
+   return ret;
+}
+
+
+static
+void pmt_release(PM_NODE_ADDR pm_node)
+{
+   LOG_BLOCK      edit_block;
+   PAGE_OFF       edit_page;
+
+   if (PM_NODE_IS_SHARED(pm_node) == TRUE)
+   {
+      /* the shared page is dirty after its last logical page */
+      SHARE_Release(PM_NODE_SHARE(pm_node));
+   }
+   else if (pm_node != INVALID_PM_NODE &&
+            PM_NODE_IS_PATTERN(pm_node) == FALSE)
+   {
+      /* update BDT: increase dirty page count of the edited block,
+       * and clear the valid bit of the edited page.
+       */
+      edit_block = PM_NODE_BLOCK(pm_node);
+      edit_page = PM_NODE_PAGE(pm_node);
+      block_dirty_table[edit_block] ++;
+      ASSERT(block_dirty_table[edit_block] <= DATA_MAX_DIRTY_PAGES);
+      ASSERT(PAGE_IS_VALID(edit_block, edit_page));
+      PAGE_CLEAR_VALID(edit_block, edit_page);
+   }
+}
+
+
+static
+void pmt_resolve(PM_NODE_ADDR pm_node, LOG_BLOCK* block, PAGE_OFF* page)
+{
+   if (PM_NODE_IS_SHARED(pm_node) == TRUE)
+   {
+      SHARE_Search(PM_NODE_SHARE(pm_node), block, page);
+   }
+   else if (PM_NODE_IS_PATTERN(pm_node) == TRUE)
+   {
+      *block = PATTERN_BLOCK;
+      *page = PM_NODE_PATTERN(pm_node);
+   }
+   else if (pm_node != INVALID_PM_NODE)
+   {
+      *block = PM_NODE_BLOCK(pm_node);
+      *page = PM_NODE_PAGE(pm_node);
+   }
+   else
+   {
+      *block = INVALID_BLOCK;
+      *page = INVALID_PAGE;
+   }
+}
+
+
@@ -99,42 +99,21 @@ STATUS ROOT_Init()
       root_current_block = ROOT_BLOCK1;
    }
 
-   /* read out the latest valid page */
-   for (i=0; i<PAGE_PER_PHY_BLOCK; i++)
-   {
-      ret = UBI_Read(root_current_block, i, &root_table, footprint);
-      if (ret != STATUS_SUCCESS || footprint[0] == INVALID_INDEX)
-      {
-         break;
-      }
-   }
-
-   if (i == PAGE_PER_PHY_BLOCK)
-   {
-      ASSERT(ret == STATUS_SUCCESS);
-   }
-   else
-   {
-      ASSERT(ret != STATUS_SUCCESS);
-      ret = STATUS_SUCCESS;
-   }
+   /* find the first erased page, the latest valid page is before it */
+   i = UBI_FindErasedPage(root_current_block, 0, 1);
+   ASSERT(i > 0);
 
-   if (ret == STATUS_SUCCESS)
+   /* read out the valid table */
+   ret = UBI_Read(root_current_block, i-1, &root_table, footprint);
+   if (ret == STATUS_SUCCESS && footprint[0] == INVALID_INDEX)
    {
-      /* read out the valid table */
-      ret = UBI_Read(root_current_block,
-                     i-1,
-                     &root_table,
-                     NULL);
+      ret = STATUS_FAILURE;
    }
 
    if (ret == STATUS_SUCCESS)
    {
       root_current_page = i;
       root_edition = root_table.root_edition + 1;
-
-      /* skip one page for possible PLR issue */
-      (void)ROOT_Commit();
    }
 
    return ret;
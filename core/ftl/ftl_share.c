@@ -0,0 +1,305 @@
+/*********************************************************
+ * Module name: ftl_share.c
+ *
+ * Copyright 2010, 2011. All Rights Reserved, Crane Chu.
+ *
+ * This file is part of OpenNFM.
+ *
+ * OpenNFM is free software: you can redistribute it and/or 
+ * modify it under the terms of the GNU General Public 
+ * License as published by the Free Software Foundation, 
+ * either version 3 of the License, or (at your option) any 
+ * later version.
+ * 
+ * OpenNFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied 
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+ * PURPOSE. See the GNU General Public License for more 
+ * details.
+ *
+ * You should have received a copy of the GNU General Public 
+ * License along with OpenNFM. If not, see 
+ * <http://www.gnu.org/licenses/>.
+ *
+ * First written on 2010-01-01 by cranechu@gmail.com
+ *
+ * Module Description:
+ *    Share table of copied pages. A data page mapped by
+ *    several logical pages has a share entry, which
+ *    points to the page and counts the logical pages.
+ *    PMT maps these logical pages to the entry, so the
+ *    page is moved in reclaim by updating the entry only.
+ *
+ *********************************************************/
+
+
+#include <core\inc\cmn.h>
+#include <core\inc\ubi.h>
+
+#include <sys\sys.h>
+
+#include "ftl_inc.h"
+
+
+/* a shared page, and the count of logical pages mapping to it. The entry
+ * is free when no logical page maps to it. The first and the last logical
+ * pages are kept, to find the only one left, and map it to the page again
+ * in reclaim.
+ */
+typedef struct {
+   PM_NODE_ADDR   page;
+   UINT32         ref_count;
+   PGADDR         first_addr;
+   PGADDR         last_addr;
+} SHARE_ENTRY;
+
+
+static SHARE_ENTRY   share_table[SHARE_ENTRY_COUNT];
+static UINT32        share_used_count;
+static BOOL          share_changed;
+static PAGE_OFF      share_current_page;
+static LOG_BLOCK     share_current_block;
+
+
+STATUS SHARE_Format()
+{
+   STATUS   ret;
+
+   memset(share_table, 0, sizeof(share_table));
+   share_used_count = 0;
+
+   share_current_block = SHARE_BLOCK0;
+   share_current_page = 0;
+
+   ret = UBI_Erase(share_current_block, share_current_block);
+   if (ret == STATUS_SUCCESS)
+   {
+      /* write to UBI */
+      ret = SHARE_Commit(TRUE);
+   }
+
+   return ret;
+}
+
+
+STATUS SHARE_Init()
+{
+   UINT32      i;
+   STATUS      ret = STATUS_SUCCESS;
+
+   share_current_block = PM_NODE_BLOCK(root_table.share_current_journal);
+   share_current_page = PM_NODE_PAGE(root_table.share_current_journal);
+
+   /* read out the valid page of table */
+   ret = UBI_Read(share_current_block, share_current_page, share_table, NULL);
+   ASSERT(ret == STATUS_SUCCESS);
+
+   share_used_count = 0;
+   for (i=0; i<SHARE_ENTRY_COUNT; i++)
+   {
+      if (share_table[i].ref_count != 0)
+      {
+         share_used_count ++;
+      }
+   }
+
+   /* find the first erased page, or the block is full */
+   share_current_page = UBI_FindErasedPage(share_current_block,
+                                           share_current_page+1,
+                                           1);
+
+   share_changed = FALSE;
+
+   return ret;
+}
+
+
+STATUS SHARE_Commit(BOOL force)
+{
+   STATUS      ret = STATUS_SUCCESS;
+   LOG_BLOCK   next_block = INVALID_BLOCK;
+
+   if (force == TRUE || share_changed == TRUE)
+   {
+      if (share_current_page == PAGE_PER_PHY_BLOCK)
+      {
+         /* write data in another block */
+         next_block = share_current_block ^ 1;
+
+         /* erase the block before write the table */
+         ret = UBI_Erase(next_block, next_block);
+         if (ret == STATUS_SUCCESS)
+         {
+            share_current_page = 0;
+            share_current_block = next_block;
+         }
+      }
+
+      /* write the table in ram to UBI */
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = UBI_Write(share_current_block,
+                         share_current_page,
+                         share_table,
+                         NULL,
+                         FALSE);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         PM_NODE_SET_BLOCKPAGE(root_table.share_current_journal,
+                               share_current_block, share_current_page);
+         share_current_page ++;
+         share_changed = FALSE;
+      }
+   }
+
+   return ret;
+}
+
+
+UINT32 SHARE_Add(LOG_BLOCK block, PAGE_OFF page, PGADDR addr)
+{
+   UINT32   share = INVALID_SHARE;
+   UINT32   i;
+
+   for (i=0; i<SHARE_ENTRY_COUNT; i++)
+   {
+      if (share_table[i].ref_count == 0)
+      {
+         share = i;
+         break;
+      }
+   }
+
+   if (share != INVALID_SHARE)
+   {
+      PM_NODE_SET_BLOCKPAGE(share_table[share].page, block, page);
+      share_table[share].ref_count = 1;
+      share_table[share].first_addr = addr;
+      share_table[share].last_addr = addr;
+      share_used_count ++;
+      share_changed = TRUE;
+   }
+
+   return share;
+}
+
+
+void SHARE_AddRef(UINT32 share, PGADDR addr)
+{
+   ASSERT(share < SHARE_ENTRY_COUNT && share_table[share].ref_count > 0);
+
+   share_table[share].ref_count ++;
+   share_table[share].last_addr = addr;
+   share_changed = TRUE;
+}
+
+
+void SHARE_Release(UINT32 share)
+{
+   LOG_BLOCK   block;
+   PAGE_OFF    page;
+
+   ASSERT(share < SHARE_ENTRY_COUNT && share_table[share].ref_count > 0);
+
+   share_table[share].ref_count --;
+   share_changed = TRUE;
+
+   if (share_table[share].ref_count == 0)
+   {
+      /* no logical page maps to the page, it is dirty */
+      block = PM_NODE_BLOCK(share_table[share].page);
+      page = PM_NODE_PAGE(share_table[share].page);
+      block_dirty_table[block] ++;
+      ASSERT(block_dirty_table[block] <= DATA_MAX_DIRTY_PAGES);
+      ASSERT(PAGE_IS_VALID(block, page));
+      PAGE_CLEAR_VALID(block, page);
+
+      share_used_count --;
+   }
+}
+
+
+void SHARE_Update(UINT32 share, LOG_BLOCK block, PAGE_OFF page)
+{
+   LOG_BLOCK   edit_block;
+   PAGE_OFF    edit_page;
+
+   ASSERT(share < SHARE_ENTRY_COUNT && share_table[share].ref_count > 0);
+
+   /* the old page is dirty, as in PMT update */
+   edit_block = PM_NODE_BLOCK(share_table[share].page);
+   edit_page = PM_NODE_PAGE(share_table[share].page);
+   block_dirty_table[edit_block] ++;
+   ASSERT(block_dirty_table[edit_block] <= DATA_MAX_DIRTY_PAGES);
+   ASSERT(PAGE_IS_VALID(edit_block, edit_page));
+   PAGE_CLEAR_VALID(edit_block, edit_page);
+
+   PM_NODE_SET_BLOCKPAGE(share_table[share].page, block, page);
+   PAGE_SET_VALID(block, page);
+   share_changed = TRUE;
+}
+
+
+void SHARE_Search(UINT32 share, LOG_BLOCK* block, PAGE_OFF* page)
+{
+   ASSERT(share < SHARE_ENTRY_COUNT);
+
+   if (share_table[share].ref_count > 0)
+   {
+      *block = PM_NODE_BLOCK(share_table[share].page);
+      *page = PM_NODE_PAGE(share_table[share].page);
+   }
+   else
+   {
+      /* the page is released */
+      *block = INVALID_BLOCK;
+      *page = INVALID_PAGE;
+   }
+}
+
+
+UINT32 SHARE_Find(LOG_BLOCK block, PAGE_OFF page)
+{
+   PM_NODE_ADDR   pm_node;
+   UINT32         share = INVALID_SHARE;
+   UINT32         i;
+
+   if (share_used_count > 0)
+   {
+      PM_NODE_SET_BLOCKPAGE(pm_node, block, page);
+
+      for (i=0; i<SHARE_ENTRY_COUNT; i++)
+      {
+         if (share_table[i].ref_count != 0 && share_table[i].page == pm_node)
+         {
+            share = i;
+            break;
+         }
+      }
+   }
+
+   return share;
+}
+
+
+UINT32 SHARE_GetAddress(UINT32 share, PGADDR* first_addr, PGADDR* last_addr)
+{
+   ASSERT(share < SHARE_ENTRY_COUNT && share_table[share].ref_count > 0);
+
+   *first_addr = share_table[share].first_addr;
+   *last_addr = share_table[share].last_addr;
+
+   return share_table[share].ref_count;
+}
+
+
+void SHARE_Remove(UINT32 share)
+{
+   ASSERT(share < SHARE_ENTRY_COUNT && share_table[share].ref_count == 1);
+
+   share_table[share].ref_count = 0;
+   share_used_count --;
+   share_changed = TRUE;
+}
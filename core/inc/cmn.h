@@ -66,6 +66,7 @@ typedef int    BOOL;
 typedef unsigned char   UINT8;
 typedef unsigned short  UINT16;
 typedef unsigned int    UINT32;
+typedef unsigned long long UINT64;
 
 
 /* pointers to extern memory area */
@@ -75,8 +76,13 @@ typedef UINT32*  UINT32_PTR;
 
 
 /* logical layer */
-typedef UINT32          LSADDR;     /* logical sector address */
-typedef UINT32          PGADDR;     /* logical block number */
+typedef UINT64          LSADDR;     /* logical sector address */
+/* logical page number: the logical pages are less than the physical pages
+ * packed in a PM node, so it is never wider than 30 bits, bit 31 and 30 tag
+ * the pages of atomic writes and shared pages in data spares. The #error
+ * on the PM node in ftl_inc.h enforces it.
+ */
+typedef UINT32          PGADDR;
 
 /* extern block layer */
 typedef UINT32          PHY_BLOCK;     /* block number in MTD */
@@ -101,7 +107,20 @@ typedef UINT8           NAND_CHIP;
 #define MPP_SIZE_SHIFT              (SECTOR_SIZE_SHIFT+SECTOR_PER_MPP_SHIFT)
 #define MPP_SIZE                    (1<<MPP_SIZE_SHIFT)
 
+/* logical sector of host */
+#define LBA_SIZE                    (1<<LBA_SIZE_SHIFT)
+#define LBA_PER_MPP_SHIFT           (MPP_SIZE_SHIFT-LBA_SIZE_SHIFT)
+#define LBA_PER_MPP                 (1<<LBA_PER_MPP_SHIFT)
+
+#if (LBA_SIZE_SHIFT < 9 || LBA_SIZE_SHIFT > MPP_SIZE_SHIFT)
+#error "logical sector must be between 512B and MPP size!"
+#endif
+
+#ifdef CFG_PAGE_PER_BLOCK
+#define PAGE_PER_PHY_BLOCK          (CFG_PAGE_PER_BLOCK)
+#else
 #define PAGE_PER_PHY_BLOCK          (1<<PAGE_PER_BLOCK_SHIFT)
+#endif
 
 #define DIE_PER_CHIP                (1<<DIE_PER_CHIP_SHIFT)
 
@@ -126,7 +145,8 @@ typedef UINT8           NAND_CHIP;
 #define CFG_PHY_BLOCK_COUNT         (1<<CFG_PHY_BLOCK_COUNT_SHIFT)
 #define CFG_LOG_BLOCK_COUNT         (1<<CFG_LOG_BLOCK_COUNT_SHIFT)
 
-#define CFG_NAND_ROW_COUNT          (CFG_PHY_BLOCK_COUNT*PAGE_PER_PHY_BLOCK)
+/* rows in the address space, including the unused ones of blocks */
+#define CFG_NAND_ROW_COUNT          (CFG_PHY_BLOCK_COUNT<<PAGE_PER_BLOCK_SHIFT)
 
 #define CFG_TOTAL_SECTOR_SHIFT      (SECTOR_PER_PAGE_SHIFT +   \
                                      PAGE_PER_BLOCK_SHIFT +    \
@@ -147,10 +167,11 @@ typedef UINT8           NAND_CHIP;
 /* data buffer im MPP size */
 typedef UINT8           SECTOR[SECTOR_SIZE];
 typedef SECTOR          PAGE_BUFFER[SECTOR_PER_MPP];
+typedef UINT8           LBA_DATA[LBA_SIZE];
 
 
 /* meta data in spare area */
-#define SPARE_BYTES_IN_PAGE      (8)
+#define SPARE_BYTES_IN_PAGE      (12)
 #define SPARE_WORDS_IN_PAGE      (SPARE_BYTES_IN_PAGE/sizeof(UINT32))
 typedef UINT32          SPARE[SPARE_WORDS_IN_PAGE];
 
@@ -177,9 +198,12 @@ typedef enum {
    STATUS_BDT_INIT_FAIL,
    STATUS_ROOT_INIT_FAIL,
    STATUS_HDI_INIT_FAIL,
+   STATUS_JOURNAL_FULL,
+   STATUS_SHARE_FULL,
 
    /* UBI */
    STATUS_UBI_FORMAT_ERROR,
+   STATUS_BADPAGE,
 
 
    /* MTD */
@@ -269,6 +293,11 @@ extern FILE* foutput;
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+/* max of two value */
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
 
 /* uart for debug */
 #if (SIM_TEST == FALSE)
@@ -33,6 +33,13 @@
 #define _INC_FTL_H_
 
 
+/* no stream id from host, as stream 0 in SCSI/NVMe */
+#define FTL_STREAM_NONE       (0)
+
+/* the most pages in an atomic write, they fit in the free journal blocks */
+#define FTL_ATOMIC_MAX_PAGES  (PAGE_PER_PHY_BLOCK)
+
+
 /*********************************************************
  * Funcion Name: FTL_Format
  *
@@ -72,6 +79,48 @@ STATUS FTL_Format();
 STATUS FTL_Init();
 
 
+/*********************************************************
+ * Funcion Name: FTL_InitReadOnly
+ *
+ * Description:
+ *    Init FTL in read-only mode. Read tables from nand,
+ *    and rebuild maptable in RAM, without any program or
+ *    erase.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    N/A
+ *
+ * NOTES:
+ *    Write and trim fail, flush and background tasks do
+ *    nothing, until the next FTL_Init(), which also writes
+ *    the repair of Power Loss Recovery.
+ *
+ *********************************************************/
+STATUS FTL_InitReadOnly();
+
+
+/*********************************************************
+ * Funcion Name: FTL_IsReadOnly
+ *
+ * Description:
+ *    Check if FTL is inited in read-only mode.
+ *
+ * Return Value:
+ *    BOOL        TRUE if read-only
+ *
+ * Parameter List:
+ *    N/A
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+BOOL FTL_IsReadOnly();
+
+
 /*********************************************************
  * Funcion Name: FTL_Write
  *
@@ -95,6 +144,61 @@ STATUS FTL_Init();
 STATUS FTL_Write(PGADDR addr, void* buffer);
 
 
+/*********************************************************
+ * Funcion Name: FTL_WriteHint
+ *
+ * Description:
+ *    Write a page of data with a stream hint from host.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    addr        IN    the logical page address
+ *    buffer      IN    the data
+ *    stream_id   IN    the stream id from host, or
+ *                      FTL_STREAM_NONE to place the data
+ *                      by its temperature
+ *
+ * NOTES:
+ *    Data of the same stream id is written to the same
+ *    data stream. Stream ids more than DATA_STREAM_COUNT
+ *    share the data streams.
+ *    A page filled with one byte, or a duplicate page in
+ *    dedup, is mapped in PMT to the byte or to the data
+ *    page it duplicates. It is still written to journals
+ *    for replay, but never copied in reclaim.
+ *
+ *********************************************************/
+STATUS FTL_WriteHint(PGADDR addr, void* buffer, UINT32 stream_id);
+
+
+/*********************************************************
+ * Funcion Name: FTL_WriteAtomic
+ *
+ * Description:
+ *    Write continuous pages atomically: after power loss,
+ *    either all of the pages are written, or none.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    addr        IN    the logical address of the first page
+ *    page_count  IN    count of pages, FTL_ATOMIC_MAX_PAGES
+ *                      at most
+ *    buffers     IN    the data of each page
+ *
+ * NOTES:
+ *    The pages are written to the stream of the hottest
+ *    one, and there is no commit for the atomic write.
+ *    The pages are programmed when it returns, and the
+ *    buffers may be reused.
+ *
+ *********************************************************/
+STATUS FTL_WriteAtomic(PGADDR addr, UINT32 page_count, void* buffers[]);
+
+
 /*********************************************************
  * Funcion Name: FTL_Read
  *
@@ -115,6 +219,30 @@ STATUS FTL_Write(PGADDR addr, void* buffer);
 STATUS FTL_Read(PGADDR addr, void* buffer);
 
 
+/*********************************************************
+ * Funcion Name: FTL_Copy
+ *
+ * Description:
+ *    Copy continuous pages by mapping the destination to
+ *    the data pages of the source, without copying data.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    src_addr    IN    the first logical page to copy from
+ *    dst_addr    IN    the first logical page to copy to
+ *    page_count  IN    count of pages
+ *
+ * NOTES:
+ *    The regions may overlap. The copy is committed when
+ *    it returns. When the share table is full, the data
+ *    is copied in buffers allocated from BUF.
+ *
+ *********************************************************/
+STATUS FTL_Copy(PGADDR src_addr, PGADDR dst_addr, UINT32 page_count);
+
+
 /*********************************************************
  * Funcion Name: FTL_Trim
  *
@@ -139,6 +139,38 @@ STATUS MTD_Read(PHY_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare);
 STATUS MTD_Program(PHY_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare);
 
 
+/*********************************************************
+ * Funcion Name: MTD_CopyBack
+ *
+ * Description:
+ *    Copy a page to another block in the same die, without
+ *    transferring data to RAM.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    src_block   IN    source block number
+ *    src_page    IN    source page offset
+ *    dst_block   IN    target block number, in the same die
+ *    dst_page    IN    target page offset
+ *    spare       IN    new spare area, NULL to keep the
+ *                      source spare
+ *
+ * NOTES:
+ *    Return fail before programming, if the blocks are in
+ *    different dice, ECC error detected in the source page,
+ *    or the spare can not be rewritten. Copy through RAM in
+ *    these cases.
+ *
+ *********************************************************/
+STATUS MTD_CopyBack(PHY_BLOCK   src_block,
+                    PAGE_OFF    src_page,
+                    PHY_BLOCK   dst_block,
+                    PAGE_OFF    dst_page,
+                    SPARE       spare);
+
+
 /*********************************************************
  * Funcion Name: MTD_Erase
  *
@@ -158,6 +190,25 @@ STATUS MTD_Program(PHY_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare);
 STATUS MTD_Erase(PHY_BLOCK block);
 
 
+/*********************************************************
+ * Funcion Name: MTD_EraseAsync
+ *
+ * Description:
+ *    Start erasing an block, without waiting
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    block    IN    block number
+ *
+ * NOTES:
+ *    check the erase status by MTD_WaitReady, no retry.
+ *
+ *********************************************************/
+STATUS MTD_EraseAsync(PHY_BLOCK block);
+
+
 /*********************************************************
  * Funcion Name: MTD_CheckBlock
  *
@@ -106,6 +106,27 @@ STATUS UBI_Format();
 STATUS UBI_Init();
 
 
+/*********************************************************
+ * Funcion Name: UBI_InitReadOnly
+ *
+ * Description:
+ *    Buld UBI running context with data in MTD, without
+ *    any program or erase.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    N/A
+ *
+ * NOTES:
+ *    The repair of power loss is only done in RAM, and
+ *    is written in the next UBI_Init().
+ *
+ *********************************************************/
+STATUS UBI_InitReadOnly();
+
+
 /*********************************************************
  * Funcion Name: UBI_Read
  *
@@ -128,6 +149,58 @@ STATUS UBI_Init();
 STATUS UBI_Read(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare);
 
 
+/*********************************************************
+ * Funcion Name: UBI_ReadSpares
+ *
+ * Description:
+ *    Read the spare data of pages in different blocks,
+ *    reads in different dice are overlapped.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    count       IN       count of pages
+ *    blocks      IN       logical block number of pages
+ *    pages       IN       page in the blocks
+ *    spares      OUT      spare data buffers of pages
+ *
+ * NOTES:
+ *    The spare of a page failed to read is filled all
+ *    0xff, the same as an erased page.
+ *
+ *********************************************************/
+STATUS UBI_ReadSpares(UINT32      count,
+                      LOG_BLOCK   blocks[],
+                      PAGE_OFF    pages[],
+                      SPARE*      spares[]);
+
+
+/*********************************************************
+ * Funcion Name: UBI_FindErasedPage
+ *
+ * Description:
+ *    Find the first erased slot in a block, a slot is the
+ *    step pages from the page.
+ *
+ * Return Value:
+ *    PAGE_OFF    the first page of the erased slot, or
+ *                PAGE_PER_PHY_BLOCK if all slots are
+ *                programmed.
+ *
+ * Parameter List:
+ *    block       IN       logical block number
+ *    page        IN       the first page of the first slot
+ *    step        IN       pages in a slot
+ *
+ * NOTES:
+ *    The slots should be programmed in order, so it is a
+ *    binary search, only the first page of a slot is read.
+ *
+ *********************************************************/
+PAGE_OFF UBI_FindErasedPage(LOG_BLOCK block, PAGE_OFF page, PAGE_OFF step);
+
+
 /*********************************************************
  * Funcion Name: UBI_Write
  *
@@ -145,12 +218,72 @@ STATUS UBI_Read(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare);
  *    async       IN       interleave write flag
  *
  * NOTES:
- *    N/A
+ *    If an async page failed, it is programmed again in the
+ *    next page, and STATUS_BADPAGE is returned for writing
+ *    these pages until UBI_GetBadPage() is called.
  *
  *********************************************************/
 STATUS UBI_Write(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare, BOOL async);
 
 
+/*********************************************************
+ * Funcion Name: UBI_Copy
+ *
+ * Description:
+ *    Copy a page to another logical block.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    src_block   IN       source logical block number
+ *    src_page    IN       source page in the block
+ *    dst_block   IN       target logical block number
+ *    dst_page    IN       target page in the block
+ *    spare       IN       new spare data, NULL to keep the
+ *                         source spare
+ *    async       IN       interleave copy flag
+ *
+ * NOTES:
+ *    Copy back in nand if both blocks are in the same die,
+ *    otherwise copy through RAM. The source block should
+ *    not be erased before the async copy is flushed. The
+ *    failed async copy is handled as in UBI_Write().
+ *
+ *********************************************************/
+STATUS UBI_Copy(LOG_BLOCK  src_block,
+                PAGE_OFF   src_page,
+                LOG_BLOCK  dst_block,
+                PAGE_OFF   dst_page,
+                SPARE      spare,
+                BOOL       async);
+
+
+/*********************************************************
+ * Funcion Name: UBI_GetBadPage
+ *
+ * Description:
+ *    Get a failed async page, which has been programmed
+ *    again in the next page of the block.
+ *
+ * Return Value:
+ *    STATUS      S/F, STATUS_NO_DATA if no failed page.
+ *
+ * Parameter List:
+ *    block       OUT      logical block of the failed page
+ *    page        OUT      the failed page, its data is in
+ *                         the next page
+ *
+ * NOTES:
+ *    Before getting it, the failed page is read from the
+ *    next page. The block is kept, and its physical block
+ *    is put back to free blocks with a higher EC when it is
+ *    erased.
+ *
+ *********************************************************/
+STATUS UBI_GetBadPage(LOG_BLOCK* block, PAGE_OFF* page);
+
+
 /*********************************************************
  * Funcion Name: UBI_Erase
  *
@@ -172,6 +305,26 @@ STATUS UBI_Write(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare, BOOL
 STATUS UBI_Erase(LOG_BLOCK block, LOG_BLOCK die_index);
 
 
+/*********************************************************
+ * Funcion Name: UBI_EraseAhead
+ *
+ * Description:
+ *    Erase the free blocks of dice in parallel.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    die_mask    IN       one bit for each die to erase
+ *
+ * NOTES:
+ *    The next UBI_Erase on these dice takes the erased
+ *    block without waiting for another erase.
+ *
+ *********************************************************/
+STATUS UBI_EraseAhead(UINT32 die_mask);
+
+
 /*********************************************************
  * Funcion Name: UBI_Flush
  *
@@ -228,6 +381,46 @@ STATUS UBI_SWL();
  *********************************************************/
 STATUS UBI_ReadStatus(LOG_BLOCK block);
 
+
+/*********************************************************
+ * Funcion Name: UBI_GetReadyTime
+ *
+ * Description:
+ *    Get the time to wait before the die of the block is
+ *    ready.
+ *
+ * Return Value:
+ *    UINT32      time in us, 0 if the die is ready
+ *
+ * Parameter List:
+ *    block       IN    the block number
+ *
+ * NOTES:
+ *    Estimated from the operations issued to the die in
+ *    the typical timing, without reading the die status.
+ *
+ *********************************************************/
+UINT32 UBI_GetReadyTime(LOG_BLOCK block);
+
+
+/*********************************************************
+ * Funcion Name: UBI_GetDie
+ *
+ * Description:
+ *    Get the die index of the logical block.
+ *
+ * Return Value:
+ *    UINT32      the die index
+ *
+ * Parameter List:
+ *    block       IN    logical block number
+ *
+ * NOTES:
+ *    The die index can be changed by erasing the block.
+ *
+ *********************************************************/
+UINT32 UBI_GetDie(LOG_BLOCK block);
+
 #endif
 
 
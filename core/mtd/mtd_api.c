@@ -81,7 +81,6 @@ UINT32   TEST_total_page_program = 0;
 
 
 /* TODO: exploit other NAND feature 
- * - copy back for reclaim, read/write pages in the same plane/die
  * - cache read/write
  * - de-select CE when free
  * - ONFI2/3 ...
@@ -256,48 +255,118 @@ STATUS MTD_Program(PHY_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare)
 }
 
 
-STATUS MTD_Erase(PHY_BLOCK block)
+STATUS MTD_CopyBack(PHY_BLOCK   src_block,
+                    PAGE_OFF    src_page,
+                    PHY_BLOCK   dst_block,
+                    PAGE_OFF    dst_page,
+                    SPARE       spare)
 {
    NAND_ROW    row_addr;
-   NAND_CHIP   chip_addr = INVALID_CHIP;
+   NAND_CHIP   chip_addr = (NAND_CHIP)MTD_CHIP_NUM(src_block);
    UINT8       plane;
-   UINT8       retry_times = 0;
    STATUS      ret = STATUS_SUCCESS;
 
-   while (retry_times < MTD_MAX_RETRY_TIMES)
+   if (((src_block^dst_block)&(TOTAL_DIE_COUNT-1)) != 0)
    {
-      for (plane=0; plane<PLANE_PER_DIE; plane++)
+      /* copy back only in the same die */
+      ret = STATUS_FAILURE;
+   }
+
+#if (CFG_NAND_COPYBACK_SPARE == FALSE)
+   if (spare != NULL)
+   {
+      ret = STATUS_FAILURE;
+   }
+#endif
+
+   if (ret == STATUS_SUCCESS)
+   {
+      /* check status and wait ready of the DIE, avoid RWW issue */
+      (void)MTD_WaitReady(src_block);
+   }
+
+   /* read source pages to the page registers of all planes */
+   for (plane=0; plane<PLANE_PER_DIE; plane++)
+   {
+      if (ret == STATUS_SUCCESS)
       {
-         if (plane == 0)
-         {
-            row_addr = (NAND_ROW)MTD_ROW_ADDRESS(block, plane, 0);
-            chip_addr = (NAND_CHIP)MTD_CHIP_NUM(block);
+         row_addr = (NAND_ROW)MTD_ROW_ADDRESS(src_block, plane, src_page);
 
-            NAND_SelectChip(chip_addr);
+         NAND_SelectChip(chip_addr);
+         NAND_SendCMD(CMD_READ);
+         NAND_SendAddr(0, row_addr, CFG_NAND_COL_CYCLE, CFG_NAND_ROW_CYCLE);
+         NAND_SendCMD(CMD_READ_COPYBACK_COMMIT);
+         NAND_WaitRB(chip_addr);
 
-            NAND_SendCMD(CMD_BLOCK_ERASE);
-            NAND_SendAddr(0, row_addr, 0, CFG_NAND_ROW_CYCLE);
+         /* check data through ECC engine, but not keep it in RAM. Even a
+          * corrected error would be copied to the target page.
+          */
+         ret = NAND_ReceiveData(NULL, NULL);
+      }
+   }
+
+   /* program page registers to the target pages */
+   for (plane=0; plane<PLANE_PER_DIE; plane++)
+   {
+      if (ret == STATUS_SUCCESS)
+      {
+         row_addr = (NAND_ROW)MTD_ROW_ADDRESS(dst_block, plane, dst_page);
+
+         if (plane == 0)
+         {
+            NAND_SendCMD(CMD_COPYBACK_PROGRAM);
          }
          else
          {
-            row_addr = (NAND_ROW)MTD_ROW_ADDRESS(block, plane, 0);
-            chip_addr = (NAND_CHIP)MTD_CHIP_NUM(block);
-
-            /* TWO-plane erase */
+            /* TWO-plane program */
             ASSERT(PLANE_PER_DIE == 2);
 
-            NAND_SendCMD(CMD_BLOCK_ERASE);
-            NAND_SendAddr(0, row_addr, 0, CFG_NAND_ROW_CYCLE);
+            NAND_SendCMD(CMD_PROGRAM_FAKE_COMMIT);
+            NAND_SendCMD(CMD_PAGE_FAKE_PROGRAM);
+         }
+
+         NAND_SendAddr(0, row_addr, CFG_NAND_COL_CYCLE, CFG_NAND_ROW_CYCLE);
+
+         if (spare != NULL)
+         {
+            /* rewrite the spare area in page register */
+            NAND_SendCMD(CMD_RANDOM_DATA_IN);
+            NAND_SendAddr(PAGE_SIZE, row_addr, CFG_NAND_COL_CYCLE, 0);
+            NAND_SendData(NULL, spare);
          }
       }
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+#if (SIM_TEST == TRUE)
+      TEST_total_page_program ++;
+#endif
+
+      /* commit the whole copy, multi-plane or one-plane */
+      NAND_SendCMD(CMD_PAGE_PROGRAM_COMMIT);
+   }
 
-      NAND_SendCMD(CMD_BLOCK_ERASE_COMMIT);
+   return ret;
+}
 
-      ASSERT(chip_addr != INVALID_CHIP);
-      NAND_WaitRB(chip_addr);
 
-      /* check status */
-      ret = MTD_ReadStatus(block);
+STATUS MTD_Erase(PHY_BLOCK block)
+{
+   UINT8       retry_times = 0;
+   STATUS      ret = STATUS_SUCCESS;
+
+   while (retry_times < MTD_MAX_RETRY_TIMES)
+   {
+      ret = MTD_EraseAsync(block);
+      if (ret == STATUS_SUCCESS)
+      {
+         NAND_WaitRB((NAND_CHIP)MTD_CHIP_NUM(block));
+
+         /* check status */
+         ret = MTD_ReadStatus(block);
+      }
+
       if (ret != STATUS_SUCCESS)
       {
          /* try again */
@@ -314,6 +383,47 @@ STATUS MTD_Erase(PHY_BLOCK block)
 }
 
 
+STATUS MTD_EraseAsync(PHY_BLOCK block)
+{
+   NAND_ROW    row_addr;
+   NAND_CHIP   chip_addr = INVALID_CHIP;
+   UINT8       plane;
+   STATUS      ret = STATUS_SUCCESS;
+
+   for (plane=0; plane<PLANE_PER_DIE; plane++)
+   {
+      if (plane == 0)
+      {
+         row_addr = (NAND_ROW)MTD_ROW_ADDRESS(block, plane, 0);
+         chip_addr = (NAND_CHIP)MTD_CHIP_NUM(block);
+
+         NAND_SelectChip(chip_addr);
+
+         NAND_SendCMD(CMD_BLOCK_ERASE);
+         NAND_SendAddr(0, row_addr, 0, CFG_NAND_ROW_CYCLE);
+      }
+      else
+      {
+         row_addr = (NAND_ROW)MTD_ROW_ADDRESS(block, plane, 0);
+         chip_addr = (NAND_CHIP)MTD_CHIP_NUM(block);
+
+         /* TWO-plane erase */
+         ASSERT(PLANE_PER_DIE == 2);
+
+         NAND_SendCMD(CMD_BLOCK_ERASE);
+         NAND_SendAddr(0, row_addr, 0, CFG_NAND_ROW_CYCLE);
+      }
+   }
+
+   /* commit the erase, and check status later */
+   NAND_SendCMD(CMD_BLOCK_ERASE_COMMIT);
+
+   ASSERT(chip_addr != INVALID_CHIP);
+
+   return ret;
+}
+
+
 STATUS MTD_CheckBlock(PHY_BLOCK block)
 {
    UINT8       plane;
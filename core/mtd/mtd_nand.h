@@ -41,6 +41,7 @@ typedef UINT16       NAND_COL;
 typedef enum {
    CMD_READ                   = 0x00,
    CMD_READ_COMMIT            = 0x30,
+   CMD_READ_COPYBACK_COMMIT   = 0x35,
    CMD_READ_ID                = 0x90,
    CMD_RESET                  = 0xff,
    CMD_PAGE_PROGRAM           = 0x80,
@@ -50,6 +51,7 @@ typedef enum {
    CMD_BLOCK_ERASE            = 0x60,
    CMD_BLOCK_ERASE_COMMIT     = 0xd0,
    CMD_RANDOM_DATA_IN         = 0x85,
+   CMD_COPYBACK_PROGRAM       = 0x85,   /* the same as random data in */
    CMD_RANDOM_DATA_OUT        = 0x05,
    CMD_RANDOM_DATA_OUT_COMMIT = 0xe0,
    CMD_READ_STATUS            = 0x70,
@@ -56,9 +56,14 @@ typedef enum {
    STATE_ERASE,
    STATE_READID,
    STATE_READSTATUS,
-   STATE_RESET
+   STATE_RESET,
+   STATE_READ_COPYBACK,
+   STATE_PROGRAM_COPYBACK
 } NAND_STATE;
 
+/* the plane of a row address, to find its page register */
+#define SIM_PLANE(row)  (((row)>>PAGE_PER_BLOCK_SHIFT)&(PLANE_PER_DIE-1))
+
 
 /* 2 interchips * 2 chips */
 static SIM_CHIP        sim_nand[CFG_NAND_CHIP_COUNT];
@@ -84,6 +89,12 @@ static NAND_STATE    sim_nand_state;
 static UINT8         sim_nand_chip;
 static UINT16        sim_nand_col_addr;
 static UINT32        sim_nand_row_addr;
+/* page registers holding data in copy back */
+static SIM_COLUMN    sim_nand_page_register[PLANE_PER_DIE];
+
+
+static
+void nand_copyback_commit();
 
 
 void NAND_Init()
@@ -122,6 +133,14 @@ void NAND_SendCMD(NAND_CMD cmd)
                sim_nand_state = STATE_READ;
                break;
 
+      case CMD_READ_COPYBACK_COMMIT:
+               /* load the page to page register */
+               sim_nand_state = STATE_READ_COPYBACK;
+               memcpy(&(sim_nand_page_register[SIM_PLANE(sim_nand_row_addr)]),
+                      &(sim_nand[sim_nand_chip][sim_nand_row_addr]),
+                      sizeof(SIM_COLUMN));
+               break;
+
       case CMD_READ_ID:
                sim_nand_state = STATE_READID;
                break;
@@ -137,15 +156,30 @@ void NAND_SendCMD(NAND_CMD cmd)
                break;
 
       case CMD_PAGE_PROGRAM_COMMIT:
+               if (sim_nand_state == STATE_PROGRAM_COPYBACK)
+               {
+                  nand_copyback_commit();
+               }
                sim_nand_state = STATE_PROGRAM;
                break;
 
       case CMD_PROGRAM_FAKE_COMMIT:
-               sim_nand_state = STATE_PROGRAM;
+               if (sim_nand_state == STATE_PROGRAM_COPYBACK)
+               {
+                  /* commit the first plane, and continue copy back */
+                  nand_copyback_commit();
+               }
+               else
+               {
+                  sim_nand_state = STATE_PROGRAM;
+               }
                break;
 
       case CMD_PAGE_FAKE_PROGRAM:
-               sim_nand_state = STATE_PROGRAM;
+               if (sim_nand_state != STATE_PROGRAM_COPYBACK)
+               {
+                  sim_nand_state = STATE_PROGRAM;
+               }
                break;
 
       case CMD_BLOCK_ERASE:
@@ -157,7 +191,11 @@ void NAND_SendCMD(NAND_CMD cmd)
                break;
 
       case CMD_RANDOM_DATA_IN:
-               /* nothing to do */
+               /* the same cmd starts copy back program after reading */
+               if (sim_nand_state == STATE_READ_COPYBACK)
+               {
+                  sim_nand_state = STATE_PROGRAM_COPYBACK;
+               }
                break;
 
       case CMD_RANDOM_DATA_OUT:
@@ -188,7 +226,7 @@ void NAND_SendCMD(NAND_CMD cmd)
 void NAND_SendAddr(NAND_COL col, NAND_ROW row, UINT8 col_cycle, UINT8 row_cycle)
 {
    SIM_COLUMN*    col_ptr;
-   UINT8          i;
+   PAGE_OFF       i;
 
    sim_nand_col_addr = col;
    sim_nand_row_addr = row;
@@ -212,6 +250,17 @@ void NAND_SendData(unsigned char* buffer, SPARE spare_data)
 {
    SIM_COLUMN*    col;
 
+   if (sim_nand_state == STATE_PROGRAM_COPYBACK)
+   {
+      /* only the spare can be rewritten in page register */
+      ASSERT(buffer == NULL && spare_data != NULL);
+
+      col = &(sim_nand_page_register[SIM_PLANE(sim_nand_row_addr)]);
+      memcpy(col->spare_data, spare_data, SPARE_BYTES_IN_PAGE);
+
+      return;
+   }
+
    ASSERT(sim_nand_state == STATE_PROGRAM);
    ASSERT(sim_nand_row_addr < CFG_NAND_ROW_COUNT*CFG_NAND_CHIP_COUNT);
 
@@ -245,8 +294,13 @@ STATUS NAND_ReceiveData(unsigned char* buffer, SPARE spare_data)
    /* return fail when ECC check error */
    STATUS         ret = STATUS_SUCCESS;
 
-   ASSERT(sim_nand_state == STATE_READ || sim_nand_state == STATE_READSTATUS);
-   sim_nand_state = STATE_READ;
+   ASSERT(sim_nand_state == STATE_READ ||
+          sim_nand_state == STATE_READSTATUS ||
+          sim_nand_state == STATE_READ_COPYBACK);
+   if (sim_nand_state == STATE_READSTATUS)
+   {
+      sim_nand_state = STATE_READ;
+   }
 
    col = &(sim_nand[sim_nand_chip][sim_nand_row_addr]);
    
@@ -318,3 +372,24 @@ void NAND_WaitRB(NAND_CHIP chip)
 }
 
 
+static
+void nand_copyback_commit()
+{
+   SIM_COLUMN*    col;
+
+   ASSERT(sim_nand_row_addr < CFG_NAND_ROW_COUNT*CFG_NAND_CHIP_COUNT);
+
+   col = &(sim_nand[sim_nand_chip][sim_nand_row_addr]);
+   if (col->state != SIM_NAND_ERASED)
+   {
+      /* has programmed, fatal error */
+      ASSERT(FALSE);
+   }
+
+   /* program the page register */
+   memcpy(col,
+          &(sim_nand_page_register[SIM_PLANE(sim_nand_row_addr)]),
+          sizeof(SIM_COLUMN));
+}
+
+
@@ -40,6 +40,8 @@
 
 #include <sys\sys.h>
 
+#include <onfm.h>
+
 #if (SIM_TEST == FALSE)
 #include <drv_uart.h>
 #else
@@ -56,10 +58,20 @@
 #if (ONFM_RAMDISK == FALSE || SIM_TEST == TRUE)
 
 static
-int onfm_read_sector(unsigned long sector_addr, void* sector_data);
+STATUS onfm_check_range(LSADDR sector_addr, LSADDR sector_count);
+
+static
+int onfm_read_sector(LSADDR sector_addr, void* sector_data);
 
 static
-int onfm_write_sector(unsigned long sector_addr, void* sector_data);
+int onfm_write_sector(LSADDR        sector_addr,
+                      void*         sector_data,
+                      unsigned long stream_id);
+
+static
+int onfm_copy_sectors(LSADDR  src_sector,
+                      LSADDR  dst_sector,
+                      LSADDR  sector_count);
 
 
 #if defined(__ICCARM__)
@@ -69,6 +81,17 @@ static UINT8         onfm_read_buffer[MPP_SIZE];
 
 static LSADDR        read_buffer_start_sector;
 
+/* the pages of an atomic write, the partial tail page is merged in the
+ * buffer, and the head page in the read buffer. Copies merge pages in the
+ * buffer too.
+ */
+#if defined(__ICCARM__)
+#pragma data_alignment=DMA_BURST_BYTES
+#endif
+static UINT8         onfm_merge_buffer[MPP_SIZE];
+
+static void*         onfm_atomic_pages[FTL_ATOMIC_MAX_PAGES];
+
 
 /* called after failure init */
 int ONFM_Format()
@@ -89,17 +112,29 @@ int ONFM_Format()
 }
 
 
-int ONFM_Capacity()
+ONFM_LBA ONFM_Capacity()
 {
    PGADDR   page_count = FTL_Capacity() - 1;
-   int      ret;
+   ONFM_LBA ret;
 
-   ret = page_count << SECTOR_PER_MPP_SHIFT;
+   ret = ((ONFM_LBA)page_count) << LBA_PER_MPP_SHIFT;
 
    return ret;
 }
 
 
+unsigned long ONFM_SectorSize()
+{
+   return LBA_SIZE;
+}
+
+
+unsigned long ONFM_SectorPerPage()
+{
+   return LBA_PER_MPP;
+}
+
+
 int ONFM_Mount()
 {
    STATUS   ret;
@@ -121,7 +156,28 @@ int ONFM_Mount()
 }
 
 
-int ONFM_Read(unsigned long   sector_addr,
+int ONFM_MountReadOnly()
+{
+   STATUS   ret;
+
+   read_buffer_start_sector = INVALID_LSADDR;
+
+   BUF_Init();
+   MTD_Init();
+
+   ret = FTL_InitReadOnly();
+   if (ret == STATUS_SUCCESS)
+   {
+      return 0;
+   }
+   else
+   {
+      return -1;
+   }
+}
+
+
+int ONFM_Read(ONFM_LBA        sector_addr,
               unsigned long   sector_count,
               void*           sector_data)
 {
@@ -129,11 +185,18 @@ int ONFM_Read(unsigned long   sector_addr,
    STATUS         status;
    int            ret = 0;
 
+   status = onfm_check_range(sector_addr, sector_count);
+
    /* TODO: pre-read following page, pass back the pointer */
-   if (sector_addr%SECTOR_PER_MPP == 0 && sector_count == SECTOR_PER_MPP)
+   if (status != STATUS_SUCCESS)
+   {
+      ret = -1;
+   }
+   else if (sector_addr%LBA_PER_MPP == 0 && sector_count == LBA_PER_MPP)
    {
       /* read the full/aligned MPP directly, bypass the buffer read */
-      status = FTL_Read(sector_addr>>SECTOR_PER_MPP_SHIFT, sector_data);
+      status = FTL_Read((PGADDR)(sector_addr>>LBA_PER_MPP_SHIFT),
+                        sector_data);
       if (status == STATUS_SUCCESS)
       {
          ret = 0;
@@ -150,20 +213,32 @@ int ONFM_Read(unsigned long   sector_addr,
          if (ret == 0)
          {
             ret = onfm_read_sector(sector_addr+i,
-                                   ((UINT8*)sector_data)+SECTOR_SIZE*i);
+                                   ((UINT8*)sector_data)+LBA_SIZE*i);
          }
       }
    }
 
-   ASSERT(ret == 0);
+   ASSERT(ret == 0 || status == STATUS_ADDRESS_OVER);
 
    return ret;
 }
 
 
-int ONFM_Write(unsigned long  sector_addr,
+int ONFM_Write(ONFM_LBA       sector_addr,
                unsigned long  sector_count,
                void*          sector_data)
+{
+   return ONFM_WriteHint(sector_addr,
+                         sector_count,
+                         sector_data,
+                         FTL_STREAM_NONE);
+}
+
+
+int ONFM_WriteHint(ONFM_LBA       sector_addr,
+                   unsigned long  sector_count,
+                   void*          sector_data,
+                   unsigned long  stream_id)
 {
    unsigned long  i;
    STATUS         status;
@@ -172,10 +247,21 @@ int ONFM_Write(unsigned long  sector_addr,
    /* disable read buffer if something is written */
    read_buffer_start_sector = INVALID_LSADDR;
 
-   if (sector_addr%SECTOR_PER_MPP == 0 && sector_count == SECTOR_PER_MPP)
+   if (FTL_IsReadOnly() == TRUE)
+   {
+      /* nothing is merged in the buffer in read-only mode */
+      ret = -1;
+   }
+   else if (onfm_check_range(sector_addr, sector_count) != STATUS_SUCCESS)
+   {
+      ret = -1;
+   }
+   else if (sector_addr%LBA_PER_MPP == 0 && sector_count == LBA_PER_MPP)
    {
       /* write the full/aligned MPP directly, bypass the buffer merge */
-      status = FTL_Write(sector_addr>>SECTOR_PER_MPP_SHIFT, sector_data);
+      status = FTL_WriteHint((PGADDR)(sector_addr>>LBA_PER_MPP_SHIFT),
+                             sector_data,
+                             stream_id);
       if (status == STATUS_SUCCESS)
       {
          ret = 0;
@@ -192,7 +278,8 @@ int ONFM_Write(unsigned long  sector_addr,
          if (ret == 0)
          {
             ret = onfm_write_sector(sector_addr+i,
-                                    ((UINT8*)sector_data)+SECTOR_SIZE*i);
+                                    ((UINT8*)sector_data)+LBA_SIZE*i,
+                                    stream_id);
          }
          else
          {
@@ -203,7 +290,154 @@ int ONFM_Write(unsigned long  sector_addr,
       if (ret == 0)
       {
          /* flush the data in ram buffer */
-         ret = onfm_write_sector((unsigned long)(-1), NULL);
+         ret = onfm_write_sector(INVALID_LSADDR, NULL, stream_id);
+      }
+   }
+
+   return ret;
+}
+
+
+int ONFM_WriteAtomic(ONFM_LBA       sector_addr,
+                     unsigned long  sector_count,
+                     void*          sector_data)
+{
+   PGADDR         first_page = (PGADDR)(sector_addr>>LBA_PER_MPP_SHIFT);
+   UINT32         page_count = 0;
+   UINT32         i;
+   LSADDR         page_start;
+   LSADDR         start;
+   LSADDR         end;
+   UINT8*         buffer;
+   STATUS         status = STATUS_SUCCESS;
+   int            ret;
+
+   /* disable read buffer if something is written */
+   read_buffer_start_sector = INVALID_LSADDR;
+
+   status = onfm_check_range(sector_addr, sector_count);
+   if (status == STATUS_SUCCESS && sector_count > 0)
+   {
+      page_count = (UINT32)(((sector_addr+sector_count-1)>>
+                             LBA_PER_MPP_SHIFT)-first_page+1);
+   }
+
+   if (status == STATUS_SUCCESS &&
+       (FTL_IsReadOnly() == TRUE || sector_count == 0 ||
+        page_count > FTL_ATOMIC_MAX_PAGES))
+   {
+      status = STATUS_FAILURE;
+   }
+
+   for (i=0; i<page_count && status == STATUS_SUCCESS; i++)
+   {
+      page_start = ((LSADDR)(first_page+i))<<LBA_PER_MPP_SHIFT;
+      start = MAX(page_start, sector_addr);
+      end = MIN(page_start+LBA_PER_MPP, sector_addr+sector_count);
+
+      if (end-start == LBA_PER_MPP)
+      {
+         /* write the full page directly */
+         onfm_atomic_pages[i] = ((UINT8*)sector_data)+
+                                (start-sector_addr)*LBA_SIZE;
+      }
+      else
+      {
+         /* merge the sectors in the partial page with its old data */
+         buffer = (i == 0) ? onfm_read_buffer : onfm_merge_buffer;
+         status = FTL_Read(first_page+i, buffer);
+         if (status == STATUS_SUCCESS)
+         {
+            memcpy(buffer+(start-page_start)*LBA_SIZE,
+                   ((UINT8*)sector_data)+(start-sector_addr)*LBA_SIZE,
+                   (end-start)*LBA_SIZE);
+
+            onfm_atomic_pages[i] = buffer;
+         }
+      }
+   }
+
+   if (status == STATUS_SUCCESS)
+   {
+      status = FTL_WriteAtomic(first_page, page_count, onfm_atomic_pages);
+   }
+
+   if (status == STATUS_SUCCESS)
+   {
+      ret = 0;
+   }
+   else
+   {
+      ret = -1;
+   }
+
+   return ret;
+}
+
+
+int ONFM_Copy(ONFM_LBA        src_sector,
+              ONFM_LBA        dst_sector,
+              unsigned long   sector_count)
+{
+   LSADDR         starts[3];
+   LSADDR         counts[3];
+   UINT32         i;
+   UINT32         part;
+   STATUS         status = STATUS_SUCCESS;
+   int            ret = 0;
+
+   /* disable read buffer if something is written */
+   read_buffer_start_sector = INVALID_LSADDR;
+
+   /* split the sectors to the head, the whole pages and the tail. Whole
+    * pages are copied in FTL only if the sectors have the same offset in
+    * pages, otherwise all sectors are copied in data.
+    */
+   counts[0] = sector_count;
+   counts[1] = 0;
+   if (src_sector%LBA_PER_MPP == dst_sector%LBA_PER_MPP)
+   {
+      counts[0] = MIN((LBA_PER_MPP-dst_sector%LBA_PER_MPP)%LBA_PER_MPP,
+                      sector_count);
+      counts[1] = (sector_count-counts[0])&(~((LSADDR)LBA_PER_MPP-1));
+   }
+
+   starts[0] = 0;
+   starts[1] = counts[0];
+   starts[2] = counts[0]+counts[1];
+   counts[2] = sector_count-starts[2];
+
+   if (FTL_IsReadOnly() == TRUE ||
+       onfm_check_range(src_sector, sector_count) != STATUS_SUCCESS ||
+       onfm_check_range(dst_sector, sector_count) != STATUS_SUCCESS)
+   {
+      ret = -1;
+   }
+
+   for (i=0; i<3 && ret == 0; i++)
+   {
+      /* copy the tail first, if the destination overlaps the end of the
+       * source.
+       */
+      part = (dst_sector > src_sector) ? 2-i : i;
+
+      if (part == 1 && counts[part] > 0)
+      {
+         status = FTL_Copy((PGADDR)((src_sector+starts[part])>>
+                                    LBA_PER_MPP_SHIFT),
+                           (PGADDR)((dst_sector+starts[part])>>
+                                    LBA_PER_MPP_SHIFT),
+                           (UINT32)(counts[part]>>LBA_PER_MPP_SHIFT));
+         if (status != STATUS_SUCCESS)
+         {
+            ret = -1;
+         }
+      }
+      else if (counts[part] > 0)
+      {
+         ret = onfm_copy_sectors(src_sector+starts[part],
+                                 dst_sector+starts[part],
+                                 counts[part]);
       }
    }
 
@@ -230,24 +464,61 @@ int ONFM_Unmount()
 }
 
 
+int ONFM_BgTasks()
+{
+   int      onfm_ret;
+   STATUS   ret;
+
+   ret = FTL_BgTasks();
+   if (ret == STATUS_SUCCESS)
+   {
+      onfm_ret = 0;
+   }
+   else
+   {
+      onfm_ret = -1;
+   }
+
+   return onfm_ret;
+}
+
+
+static
+STATUS onfm_check_range(LSADDR sector_addr, LSADDR sector_count)
+{
+   LSADDR   capacity = ONFM_Capacity();
+   STATUS   ret = STATUS_SUCCESS;
+
+   /* a sector out of the volume fails, instead of being truncated to a
+    * page address of 32 bits, and aliased to a low page.
+    */
+   if (sector_addr > capacity || sector_count > capacity-sector_addr)
+   {
+      ret = STATUS_ADDRESS_OVER;
+   }
+
+   return ret;
+}
+
+
 static
-int onfm_read_sector(unsigned long sector_addr, void* sector_data)
+int onfm_read_sector(LSADDR sector_addr, void* sector_data)
 {
    PGADDR      page_addr;
    STATUS      ret = STATUS_SUCCESS;
 
    if (sector_addr >= read_buffer_start_sector &&
-       sector_addr < read_buffer_start_sector+SECTOR_PER_MPP)
+       sector_addr < read_buffer_start_sector+LBA_PER_MPP)
    {
       ;  /* no need to read from FTL, just get data from the read cache */
    }
    else
    {
-      page_addr = sector_addr>>SECTOR_PER_MPP_SHIFT;
+      page_addr = (PGADDR)(sector_addr>>LBA_PER_MPP_SHIFT);
       ret = FTL_Read(page_addr, onfm_read_buffer);
       if (ret == STATUS_SUCCESS)
       {
-         read_buffer_start_sector = page_addr<<SECTOR_PER_MPP_SHIFT;
+         read_buffer_start_sector = ((LSADDR)page_addr)<<LBA_PER_MPP_SHIFT;
       }
    }
 
@@ -255,8 +526,8 @@ int onfm_read_sector(unsigned long sector_addr, void* sector_data)
    {
       memcpy(sector_data,
              &(onfm_read_buffer[(sector_addr-read_buffer_start_sector)*
-                                SECTOR_SIZE]),
-             SECTOR_SIZE);
+                                LBA_SIZE]),
+             LBA_SIZE);
 
       return 0;
    }
@@ -270,10 +541,13 @@ int onfm_read_sector(unsigned long sector_addr, void* sector_data)
 
 
 static
-int onfm_write_sector(unsigned long sector_addr, void* sector_data)
+int onfm_write_sector(LSADDR        sector_addr,
+                      void*         sector_data,
+                      unsigned long stream_id)
 {
    static LSADDR        starting_sector = INVALID_LSADDR;
-   PGADDR               page_addr = sector_addr>>SECTOR_PER_MPP_SHIFT;
+   PGADDR               page_addr = (PGADDR)(sector_addr>>
+                                                 LBA_PER_MPP_SHIFT);
    STATUS               ret = STATUS_SUCCESS;
    void*                buffer = NULL;
 
@@ -281,7 +555,7 @@ int onfm_write_sector(unsigned long sector_addr, void* sector_data)
    {
       if (sector_data != NULL)
       {
-         starting_sector = page_addr<<SECTOR_PER_MPP_SHIFT;
+         starting_sector = ((LSADDR)page_addr)<<LBA_PER_MPP_SHIFT;
 
          /* write to buffer */
          BUF_PutSector(sector_addr, sector_data);
@@ -293,7 +567,7 @@ int onfm_write_sector(unsigned long sector_addr, void* sector_data)
       }
    }
    else if (sector_addr >= starting_sector &&
-            sector_addr < starting_sector+SECTOR_PER_MPP &&
+            sector_addr < starting_sector+LBA_PER_MPP &&
             sector_data != NULL)
    {
       /* write to buffer */
@@ -302,27 +576,27 @@ int onfm_write_sector(unsigned long sector_addr, void* sector_data)
    else
    {
       ASSERT(sector_data == NULL ||
-             sector_addr == starting_sector+SECTOR_PER_MPP);
+             sector_addr == starting_sector+LBA_PER_MPP);
 
       /* flush the sectors in page buffer */
       BUF_GetPage(&page_addr, &buffer);
 
       /* write to FTL */
-      ret = FTL_Write(page_addr, buffer);
+      ret = FTL_WriteHint(page_addr, buffer, stream_id);
       if (ret == STATUS_SUCCESS)
       {
          if (sector_data != NULL)
          {
             /* fill buffers with next sector */
-            page_addr = sector_addr>>SECTOR_PER_MPP_SHIFT;
-            starting_sector = page_addr<<SECTOR_PER_MPP_SHIFT;
+            page_addr = (PGADDR)(sector_addr>>LBA_PER_MPP_SHIFT);
+            starting_sector = ((LSADDR)page_addr)<<LBA_PER_MPP_SHIFT;
 
             /* write to buffer */
             BUF_PutSector(sector_addr, sector_data);
          }
          else
          {
-            ASSERT(sector_addr == (unsigned long)(-1));
+            ASSERT(sector_addr == INVALID_LSADDR);
             starting_sector = INVALID_LSADDR;
          }
       }
@@ -338,35 +612,132 @@ int onfm_write_sector(unsigned long sector_addr, void* sector_data)
    }
 }
 
+static
+int onfm_copy_sectors(LSADDR  src_sector,
+                      LSADDR  dst_sector,
+                      LSADDR  sector_count)
+{
+   LSADDR      copied = 0;
+   LSADDR      page_start;
+   LSADDR      start;
+   LSADDR      end;
+   LSADDR      i;
+   PGADDR      page_addr;
+   UINT8*      buffer;
+   STATUS      ret = STATUS_SUCCESS;
+
+   while (copied < sector_count && ret == STATUS_SUCCESS)
+   {
+      /* the sectors in a page of the destination, from the last page if
+       * the destination overlaps the end of the source.
+       */
+      if (dst_sector > src_sector)
+      {
+         end = dst_sector+sector_count-copied;
+         page_start = (end-1)&(~((LSADDR)LBA_PER_MPP-1));
+         start = MAX(page_start, dst_sector);
+      }
+      else
+      {
+         start = dst_sector+copied;
+         page_start = start&(~((LSADDR)LBA_PER_MPP-1));
+         end = MIN(page_start+LBA_PER_MPP, dst_sector+sector_count);
+      }
+
+      page_addr = (PGADDR)(page_start>>LBA_PER_MPP_SHIFT);
+
+      /* UBI may program the page again after returning, and releases the
+       * buffer when it is done.
+       */
+      buffer = BUF_Allocate();
+      ASSERT(buffer != NULL);
+
+      if (end-start < LBA_PER_MPP)
+      {
+         /* merge the sectors with the old data of the page */
+         ret = FTL_Read(page_addr, buffer);
+      }
+
+      /* read all source sectors before writing the page, they may be in
+       * the page.
+       */
+      for (i=start; i<end && ret == STATUS_SUCCESS; i++)
+      {
+         if (onfm_read_sector(src_sector+(i-dst_sector),
+                              buffer+(i-page_start)*LBA_SIZE) != 0)
+         {
+            ret = STATUS_FAILURE;
+         }
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = FTL_Write(page_addr, buffer);
+
+         /* the read buffer may hold the old data of the page */
+         read_buffer_start_sector = INVALID_LSADDR;
+         copied += end-start;
+      }
+      else
+      {
+         BUF_Free(buffer);
+      }
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      return 0;
+   }
+   else
+   {
+      return -1;
+   }
+}
+
 #else
 
 #include "sys\lpc313x\lib\lpc313x_chip.h"
 
-#define RAM_DISK_SECTOR_COUNT    (EXT_SDRAM_LENGTH/SECTOR_SIZE)
+#define RAM_DISK_SECTOR_COUNT    (EXT_SDRAM_LENGTH/LBA_SIZE)
 
-SECTOR*  ram_disk = (SECTOR*)(EXT_SDRAM_BASE);
+LBA_DATA*   ram_disk = (LBA_DATA*)(EXT_SDRAM_BASE);
 
 
 int ONFM_Format()
 {
-   memset(ram_disk, 0, RAM_DISK_SECTOR_COUNT*SECTOR_SIZE);
+   memset(ram_disk, 0, RAM_DISK_SECTOR_COUNT*LBA_SIZE);
 
    return 0;
 }
 
-int ONFM_Capacity()
+ONFM_LBA ONFM_Capacity()
 {
    return RAM_DISK_SECTOR_COUNT;
 }
 
+unsigned long ONFM_SectorSize()
+{
+   return LBA_SIZE;
+}
+
+unsigned long ONFM_SectorPerPage()
+{
+   return LBA_PER_MPP;
+}
+
 int ONFM_Mount()
 {
-   memset(ram_disk, 0, RAM_DISK_SECTOR_COUNT*SECTOR_SIZE);
+   memset(ram_disk, 0, RAM_DISK_SECTOR_COUNT*LBA_SIZE);
 
    return 0;
 }
 
-int ONFM_Read(unsigned long   sector_addr,
+int ONFM_MountReadOnly()
+{
+   return ONFM_Mount();
+}
+
+int ONFM_Read(ONFM_LBA        sector_addr,
               unsigned long   sector_count,
               void*           sector_data)
 {
@@ -374,12 +745,12 @@ int ONFM_Read(unsigned long   sector_addr,
 
    memcpy(sector_data,
           &(ram_disk[sector_addr][0]),
-          sector_count*SECTOR_SIZE);
+          sector_count*LBA_SIZE);
 
    return 0;
 }
 
-int ONFM_Write(unsigned long  sector_addr,
+int ONFM_Write(ONFM_LBA       sector_addr,
                unsigned long  sector_count,
                void*          sector_data)
 {
@@ -388,13 +759,42 @@ int ONFM_Write(unsigned long  sector_addr,
    /* loop to cause a slow write */
    memcpy(&(ram_disk[sector_addr][0]),
           sector_data,
-          sector_count*SECTOR_SIZE);
+          sector_count*LBA_SIZE);
 
    BUF_Free(sector_data);
 
    return 0;
 }
 
+int ONFM_WriteHint(ONFM_LBA       sector_addr,
+                   unsigned long  sector_count,
+                   void*          sector_data,
+                   unsigned long  stream_id)
+{
+   return ONFM_Write(sector_addr, sector_count, sector_data);
+}
+
+int ONFM_WriteAtomic(ONFM_LBA       sector_addr,
+                     unsigned long  sector_count,
+                     void*          sector_data)
+{
+   return ONFM_Write(sector_addr, sector_count, sector_data);
+}
+
+int ONFM_Copy(ONFM_LBA        src_sector,
+              ONFM_LBA        dst_sector,
+              unsigned long   sector_count)
+{
+   ASSERT(src_sector+sector_count <= RAM_DISK_SECTOR_COUNT &&
+          dst_sector+sector_count <= RAM_DISK_SECTOR_COUNT);
+
+   memmove(&(ram_disk[dst_sector][0]),
+           &(ram_disk[src_sector][0]),
+           sector_count*LBA_SIZE);
+
+   return 0;
+}
+
 int ONFM_Unmount()
 {
    return 0;
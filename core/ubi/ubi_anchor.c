@@ -98,7 +98,7 @@ STATUS ANCHOR_Format(PHY_BLOCK total_data_block)
 }
 
 
-STATUS ANCHOR_Init()
+STATUS ANCHOR_Init(BOOL read_only)
 {
    PHY_BLOCK      block;
    PHY_BLOCK      previous_block1 = INVALID_BLOCK;
@@ -153,7 +153,7 @@ STATUS ANCHOR_Init()
             }
 
             /* erase the out of date block */
-            if (old_block != INVALID_BLOCK)
+            if (old_block != INVALID_BLOCK && read_only == FALSE)
             {
                ret = MTD_Erase(old_block);
                if (ret != STATUS_SUCCESS)
@@ -50,13 +50,38 @@ typedef struct {
    PHY_BLOCK      phy_block;  /* INVALID_BLOCK for empty slot */
    ERASE_COUNT    ec;
    PAGE_OFF       page;
-   void*          buffer;
+   void*          buffer;     /* NULL for a copied page */
    SPARE          spare;
+   PHY_BLOCK      src_block;  /* source of a copied page */
+   PAGE_OFF       src_page;
 } DIE_HOLD_PAGE;
 
+/* a failed async page, programmed again in the next page */
+typedef struct {
+   LOG_BLOCK      log_block;  /* INVALID_BLOCK for empty slot */
+   PAGE_OFF       page;
+} DIE_BAD_PAGE;
+
+/* die index is in the low bits of PHY_BLOCK */
+#define UBI_DIE(phy_block)    ((phy_block)&(TOTAL_DIE_COUNT-1))
+
 static DIE_HOLD_PAGE dice_hold[TOTAL_DIE_COUNT];
+static DIE_BAD_PAGE  dice_bad_page[TOTAL_DIE_COUNT];
+static UINT32        bad_page_count = 0;
+/* the block with a failed page, put back with a higher ec when erased */
+static PHY_BLOCK     dice_marginal_block[TOTAL_DIE_COUNT];
 static UINT8         tmp_data_buffer[MPP_SIZE];
 
+/* die scheduler: the time in us when each die finishes its operation, on
+ * a model clock. The clock is not a timer, it is moved by bus transfers
+ * and by waiting dice, in the typical timing of CFG_NAND_XXX_US.
+ */
+static UINT32        ubi_clock = 0;
+static UINT32        dice_ready_time[TOTAL_DIE_COUNT];
+
+
+static
+STATUS ubi_init(BOOL read_only);
 
 static
 STATUS ubi_reclaim_badblock(LOG_BLOCK     log_block,
@@ -67,7 +92,32 @@ STATUS ubi_reclaim_badblock(LOG_BLOCK     log_block,
                             ERASE_COUNT*  new_ec);
 
 static
-UINT32 ubi_find_die_buffer(PHY_BLOCK block);
+STATUS ubi_flush_die(UINT32 die);
+
+static
+STATUS ubi_skip_bad_page(UINT32 die);
+
+static
+UINT32 ubi_find_bad_page(LOG_BLOCK block);
+
+static
+STATUS ubi_check_bad_page(LOG_BLOCK block, PAGE_OFF page);
+
+static
+STATUS ubi_flush_block(LOG_BLOCK block);
+
+static
+void ubi_die_issue(UINT32 die, UINT32 bus_time, UINT32 busy_time);
+
+static
+void ubi_die_wait(UINT32 die);
+
+static
+STATUS ubi_copy_page(PHY_BLOCK   src_block,
+                     PAGE_OFF    src_page,
+                     PHY_BLOCK   dst_block,
+                     PAGE_OFF    dst_page,
+                     SPARE       spare);
 
 
 STATUS UBI_Format()
@@ -80,7 +130,7 @@ STATUS UBI_Format()
    STATUS      ret = STATUS_SUCCESS;
 
    /* try to read out only the anchor table first for bad block table */
-   ret = ANCHOR_Init();
+   ret = ANCHOR_Init(FALSE);
    if (ret != STATUS_SUCCESS)
    {
       PHY_BLOCK   block;
@@ -146,6 +196,19 @@ STATUS UBI_Format()
 
 
 STATUS UBI_Init()
+{
+   return ubi_init(FALSE);
+}
+
+
+STATUS UBI_InitReadOnly()
+{
+   return ubi_init(TRUE);
+}
+
+
+static
+STATUS ubi_init(BOOL read_only)
 {
    AREA        area;
    AREA        updating_area;
@@ -155,13 +218,14 @@ STATUS UBI_Init()
    ERASE_COUNT updating_block_ec = INVALID_EC;
    STATUS      ret;
 
-   ret = ANCHOR_Init();
+   ret = ANCHOR_Init(read_only);
    if (ret == STATUS_SUCCESS)
    {
       /* init/plr index table, and get the plr info of area update */
       ret = INDEX_Init(&updating_logical_block,
                        &updating_origin_block,
-                       &updating_block_ec);
+                       &updating_block_ec,
+                       read_only);
    }
 
    if (ret == STATUS_SUCCESS)
@@ -188,7 +252,7 @@ STATUS UBI_Init()
                if (AREA_CheckUpdatePLR(updating_logical_block,
                                        updating_origin_block,
                                        updating_block_ec)
-                   == TRUE)
+                   == TRUE && read_only == FALSE)
                {
                   /* continue to update the area table */
                   INDEX_Update_AreaUpdate(updating_logical_block,
@@ -210,7 +274,12 @@ STATUS UBI_Init()
       for (die=0; die<TOTAL_DIE_COUNT; die++)
       {
          dice_hold[die].phy_block = INVALID_BLOCK;
+         dice_bad_page[die].log_block = INVALID_BLOCK;
+         dice_marginal_block[die] = INVALID_BLOCK;
+         dice_ready_time[die] = ubi_clock;
       }
+
+      bad_page_count = 0;
    }
 
    return ret;
@@ -220,6 +289,7 @@ STATUS UBI_Init()
 STATUS UBI_Read(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare)
 {
    PHY_BLOCK   phy_block;
+   UINT32      die;
    STATUS      ret = STATUS_SUCCESS;
 
    if (block != INVALID_BLOCK && page != INVALID_PAGE)
@@ -227,8 +297,23 @@ STATUS UBI_Read(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare)
       phy_block = AREA_GetBlock(block);
       ASSERT(phy_block != INVALID_BLOCK);
 
+      /* the failed page is in the next page, until FTL gets it */
+      die = ubi_find_bad_page(block);
+      if (die < TOTAL_DIE_COUNT && page == dice_bad_page[die].page)
+      {
+         page ++;
+      }
+
       /* TODO: handle the read fail issue, or ECC danger issue */
       ret = MTD_Read(phy_block, page, buffer, spare);
+
+      /* MTD_Read waits the die before and after reading */
+      ubi_die_issue(UBI_DIE(phy_block), 0, CFG_NAND_TR_US);
+      ubi_die_wait(UBI_DIE(phy_block));
+      if (buffer != NULL)
+      {
+         ubi_clock += CFG_NAND_TXFER_US;
+      }
    }
    else
    {
@@ -242,63 +327,133 @@ STATUS UBI_Read(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare)
 }
 
 
-STATUS UBI_Write(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare, BOOL async)
+STATUS UBI_ReadSpares(UINT32      count,
+                      LOG_BLOCK   blocks[],
+                      PAGE_OFF    pages[],
+                      SPARE*      spares[])
 {
-   ERASE_COUNT phy_block_ec;
-   ERASE_COUNT new_ec;
+   UINT32      i;
+   UINT32      die;
    PHY_BLOCK   phy_block;
-   PHY_BLOCK   new_phy_block = INVALID_BLOCK;
+   PAGE_OFF    page;
+   BOOL        dice_read[TOTAL_DIE_COUNT];
    STATUS      ret;
-   UINT32      die_index = 0;
 
-   phy_block = AREA_GetBlock(block);
-   phy_block_ec = AREA_GetEC(block);
-   ASSERT(phy_block != INVALID_BLOCK);
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      dice_read[die] = FALSE;
+   }
 
-   /* check the last page status on the same die */
-   ret = MTD_WaitReady(phy_block);
-   while (ret == STATUS_BADBLOCK)
+   for (i=0; i<count; i++)
    {
-      /* find the buffer in the same die */
-      die_index = ubi_find_die_buffer(phy_block);
+      phy_block = AREA_GetBlock(blocks[i]);
+      ASSERT(phy_block != INVALID_BLOCK);
 
-      ASSERT(dice_hold[die_index].phy_block != INVALID_BLOCK);
+      page = pages[i];
+      die = ubi_find_bad_page(blocks[i]);
+      if (die < TOTAL_DIE_COUNT && page == dice_bad_page[die].page)
+      {
+         page ++;
+      }
 
-      /* reclaim earlier pages */
-      ret = ubi_reclaim_badblock(dice_hold[die_index].log_block,
-                                 dice_hold[die_index].phy_block,
-                                 dice_hold[die_index].ec,
-                                 dice_hold[die_index].page,
-                                 &new_phy_block,
-                                 &new_ec);
-      if (ret == STATUS_SUCCESS &&
-          dice_hold[die_index].phy_block != INVALID_BLOCK)
+      ret = MTD_Read(phy_block, page, NULL, *(spares[i]));
+      if (ret != STATUS_SUCCESS)
+      {
+         memset(*(spares[i]), 0xff, sizeof(SPARE));
+      }
+
+      /* queue the read in its die without waiting other dice, so reads
+       * in different dice are overlapped, and the time is the longest
+       * queue of all dice.
+       */
+      die = UBI_DIE(phy_block);
+      if (dice_ready_time[die] - ubi_clock >= MAX_UINT32/2)
       {
-         dice_hold[die_index].phy_block = new_phy_block;
-         dice_hold[die_index].ec = new_ec;
+         /* the die is ready */
+         dice_ready_time[die] = ubi_clock;
+      }
+
+      dice_ready_time[die] += CFG_NAND_TR_US;
+      dice_read[die] = TRUE;
+   }
 
-         /* write last page in die buffer */
-         ret = MTD_Program(new_phy_block,
-                           dice_hold[die_index].page,
-                           dice_hold[die_index].buffer,
-                           dice_hold[die_index].spare);
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      if (dice_read[die] == TRUE)
+      {
+         ubi_die_wait(die);
       }
+   }
+
+   return STATUS_SUCCESS;
+}
 
+
+PAGE_OFF UBI_FindErasedPage(LOG_BLOCK block, PAGE_OFF page, PAGE_OFF step)
+{
+   PAGE_OFF    low = 0;
+   PAGE_OFF    high = 0;
+   PAGE_OFF    mid;
+   PAGE_OFF    slots;
+   STATUS      ret;
+
+   if (page < PAGE_PER_PHY_BLOCK)
+   {
+      high = (PAGE_PER_PHY_BLOCK-page)/step;
+   }
+
+   /* slots before low are programmed, and slots from high are erased */
+   slots = high;
+   while (low < high)
+   {
+      mid = (low+high)/2;
+      ret = UBI_Read(block, page+mid*step, NULL, NULL);
       if (ret == STATUS_SUCCESS)
       {
-         ret = MTD_WaitReady(new_phy_block);
+         low = mid+1;
+      }
+      else
+      {
+         high = mid;
       }
    }
 
-   if (ret == STATUS_SUCCESS &&
-       dice_hold[die_index].phy_block != INVALID_BLOCK)
+   if (low == slots)
+   {
+      /* all slots are programmed */
+      page = PAGE_PER_PHY_BLOCK;
+   }
+   else
    {
-      ASSERT(dice_hold[die_index].buffer != NULL);
+      page = page+low*step;
+   }
 
-      /* release the die buffer */
-      BUF_Free(dice_hold[die_index].buffer);
-      dice_hold[die_index].buffer = NULL;
-      dice_hold[die_index].phy_block = INVALID_BLOCK;
+   return page;
+}
+
+
+STATUS UBI_Write(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare, BOOL async)
+{
+   ERASE_COUNT phy_block_ec;
+   ERASE_COUNT new_ec;
+   PHY_BLOCK   phy_block;
+   PHY_BLOCK   new_phy_block = INVALID_BLOCK;
+   STATUS      ret;
+   UINT32      die_index = 0;
+
+   /* check the last page status on the same die */
+   ret = ubi_flush_block(block);
+   if (ret == STATUS_SUCCESS)
+   {
+      phy_block = AREA_GetBlock(block);
+      phy_block_ec = AREA_GetEC(block);
+      ASSERT(phy_block != INVALID_BLOCK);
+      die_index = UBI_DIE(phy_block);
+   }
+
+   if (ret == STATUS_SUCCESS && page != INVALID_PAGE)
+   {
+      ret = ubi_check_bad_page(block, page);
    }
 
    if (ret == STATUS_SUCCESS && page != INVALID_PAGE)
@@ -307,6 +462,7 @@ STATUS UBI_Write(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare, BOOL
 
       /* write current page */
       ret = MTD_Program(phy_block, page, buffer, spare);
+      ubi_die_issue(die_index, CFG_NAND_TXFER_US, CFG_NAND_TPROG_US);
    }
 
    if (ret == STATUS_SUCCESS && page != INVALID_PAGE)
@@ -326,18 +482,22 @@ STATUS UBI_Write(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare, BOOL
                                        &new_ec);
             if (ret == STATUS_SUCCESS)
             {
+               phy_block = new_phy_block;
+               phy_block_ec = new_ec;
+
                /* write last page in die buffer */
-               ret = MTD_Program(new_phy_block, page, buffer, spare);
+               ret = MTD_Program(phy_block, page, buffer, spare);
             }
 
             if (ret == STATUS_SUCCESS)
             {
-               ret = MTD_WaitReady(new_phy_block);
+               ret = MTD_WaitReady(phy_block);
             }
          }
 
          ASSERT(ret == STATUS_SUCCESS);
          BUF_Free(buffer);
+         ubi_die_wait(die_index);
       }
       else
       {
@@ -347,8 +507,9 @@ STATUS UBI_Write(LOG_BLOCK block, PAGE_OFF page, void* buffer, SPARE spare, BOOL
          dice_hold[die_index].ec = phy_block_ec;
          dice_hold[die_index].page = page;
          dice_hold[die_index].buffer = buffer;
-         dice_hold[die_index].spare[0] = spare[0];
-         dice_hold[die_index].spare[1] = spare[1];
+         memcpy(dice_hold[die_index].spare, spare, sizeof(SPARE));
+         dice_hold[die_index].src_block = INVALID_BLOCK;
+         dice_hold[die_index].src_page = INVALID_PAGE;
       }
    }
 
@@ -366,11 +527,128 @@ STATUS UBI_Flush()
       if (ret == STATUS_SUCCESS)
       {
          /* check the status of a write buffer in one die */
-         ret = UBI_Write(dice_hold[i].log_block,
-                         INVALID_PAGE,
-                         NULL,
-                         NULL,
-                         TRUE);
+         ret = ubi_flush_die(i);
+      }
+   }
+
+   return ret;
+}
+
+
+STATUS UBI_Copy(LOG_BLOCK  src_block,
+                PAGE_OFF   src_page,
+                LOG_BLOCK  dst_block,
+                PAGE_OFF   dst_page,
+                SPARE      spare,
+                BOOL       async)
+{
+   ERASE_COUNT dst_phy_block_ec = INVALID_EC;
+   ERASE_COUNT new_ec;
+   PHY_BLOCK   src_phy_block = INVALID_BLOCK;
+   PHY_BLOCK   dst_phy_block = INVALID_BLOCK;
+   PHY_BLOCK   new_phy_block = INVALID_BLOCK;
+   UINT32      die_index = 0;
+   STATUS      ret;
+
+   /* check the last page status on the target die */
+   ret = ubi_flush_block(dst_block);
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = ubi_check_bad_page(dst_block, dst_page);
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      src_phy_block = AREA_GetBlock(src_block);
+      dst_phy_block = AREA_GetBlock(dst_block);
+      dst_phy_block_ec = AREA_GetEC(dst_block);
+      ASSERT(src_phy_block != INVALID_BLOCK);
+      ASSERT(dst_phy_block != INVALID_BLOCK);
+      die_index = UBI_DIE(dst_phy_block);
+
+      ret = ubi_copy_page(src_phy_block,
+                          src_page,
+                          dst_phy_block,
+                          dst_page,
+                          spare);
+   }
+
+   if (ret == STATUS_SUCCESS && async == TRUE)
+   {
+      /* save in dice_hold, copy from the source again if failed */
+      dice_hold[die_index].log_block = dst_block;
+      dice_hold[die_index].phy_block = dst_phy_block;
+      dice_hold[die_index].ec = dst_phy_block_ec;
+      dice_hold[die_index].page = dst_page;
+      dice_hold[die_index].buffer = NULL;
+      dice_hold[die_index].src_block = src_phy_block;
+      dice_hold[die_index].src_page = src_page;
+
+      if (spare != NULL)
+      {
+         memcpy(dice_hold[die_index].spare, spare, sizeof(SPARE));
+      }
+      else
+      {
+         (void)MTD_Read(src_phy_block,
+                        src_page,
+                        NULL,
+                        dice_hold[die_index].spare);
+      }
+   }
+   else if (ret == STATUS_SUCCESS)
+   {
+      ret = MTD_WaitReady(dst_phy_block);
+      while (ret == STATUS_BADBLOCK)
+      {
+         ret = ubi_reclaim_badblock(dst_block,
+                                    dst_phy_block,
+                                    dst_phy_block_ec,
+                                    dst_page,
+                                    &new_phy_block,
+                                    &new_ec);
+         if (ret == STATUS_SUCCESS)
+         {
+            /* the source page is not changed, copy it again */
+            dst_phy_block = new_phy_block;
+            dst_phy_block_ec = new_ec;
+
+            ret = ubi_copy_page(src_phy_block,
+                                src_page,
+                                dst_phy_block,
+                                dst_page,
+                                spare);
+         }
+
+         if (ret == STATUS_SUCCESS)
+         {
+            ret = MTD_WaitReady(dst_phy_block);
+         }
+      }
+
+      ubi_die_wait(die_index);
+   }
+
+   return ret;
+}
+
+
+STATUS UBI_GetBadPage(LOG_BLOCK* block, PAGE_OFF* page)
+{
+   UINT32      die;
+   STATUS      ret = STATUS_NO_DATA;
+
+   for (die=0; die<TOTAL_DIE_COUNT && bad_page_count > 0; die++)
+   {
+      if (dice_bad_page[die].log_block != INVALID_BLOCK)
+      {
+         *block = dice_bad_page[die].log_block;
+         *page = dice_bad_page[die].page;
+
+         dice_bad_page[die].log_block = INVALID_BLOCK;
+         bad_page_count --;
+         ret = STATUS_SUCCESS;
+         break;
       }
    }
 
@@ -381,12 +659,13 @@ STATUS UBI_Flush()
 STATUS UBI_Erase(LOG_BLOCK block, LOG_BLOCK die_index)
 {
    STATUS         ret = STATUS_SUCCESS;
-   UINT32         die = die_index%TOTAL_DIE_COUNT;
    PHY_BLOCK      phy_block = INVALID_BLOCK;
    ERASE_COUNT    ec = INVALID_EC;
+   PHY_BLOCK      old_phy_block;
+   ERASE_COUNT    old_ec;
 
-   /* flush the program on the same die with the block to erase */
-   ret = UBI_Write(dice_hold[die].log_block, INVALID_PAGE, NULL, NULL, TRUE);
+   /* flush the programs on all dice, the tables are written later */
+   ret = UBI_Flush();
    if (ret == STATUS_SUCCESS)
    {
       ret = INDEX_FreeBlock_Get(die_index%TOTAL_DIE_COUNT, &phy_block, &ec);
@@ -396,7 +675,16 @@ STATUS UBI_Erase(LOG_BLOCK block, LOG_BLOCK die_index)
    {
       ASSERT(block != INVALID_BLOCK && ec != INVALID_EC);
 
-      INDEX_FreeBlock_Put(AREA_GetBlock(block), AREA_GetEC(block));
+      old_phy_block = AREA_GetBlock(block);
+      old_ec = AREA_GetEC(block);
+      if (dice_marginal_block[UBI_DIE(old_phy_block)] == old_phy_block)
+      {
+         /* a page failed in the block, prevent using it soon */
+         old_ec += STATIC_WL_THRESHOLD;
+         dice_marginal_block[UBI_DIE(old_phy_block)] = INVALID_BLOCK;
+      }
+
+      INDEX_FreeBlock_Put(old_phy_block, old_ec);
       INDEX_Update_AreaUpdate(block, phy_block, ec);
       ret = INDEX_Update_Commit();
    }
@@ -405,6 +693,38 @@ STATUS UBI_Erase(LOG_BLOCK block, LOG_BLOCK die_index)
 }
 
 
+STATUS UBI_EraseAhead(UINT32 die_mask)
+{
+   UINT32         die;
+   STATUS         ret;
+
+   ASSERT(TOTAL_DIE_COUNT <= 32);
+
+   /* erase blocks with the dice idle, no program to check later */
+   ret = UBI_Flush();
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = INDEX_FreeBlock_EraseAhead(die_mask);
+   }
+
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      if ((die_mask & (1<<die)) != 0)
+      {
+         ubi_die_issue(die, 0, CFG_NAND_TBERS_US);
+      }
+   }
+
+   /* all erases are waited */
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      ubi_die_wait(die);
+   }
+
+   return ret;
+}
+
+
 STATUS UBI_SWL()
 {
    BLOCK_OFF      min_block_offset;
@@ -415,20 +735,22 @@ STATUS UBI_SWL()
    PHY_BLOCK      logical_block;
    PAGE_OFF       i;
    STATUS         ret = STATUS_SUCCESS;
-   SPARE          spare;
 
    /* static wear leveling (SWL):
     * pooling one area, and get the block with min EC in the area,
     * exchange it with the max EC block in FBT, if their EC
     * difference is larger than a threshold.
     */
+   ret = UBI_Flush();
+
    min_block_offset = AREA_FindMinECBlock(anchor_table.swl_current_area,
                                           &min_physical_block,
                                           &min_block_ec);
    INDEX_FreeBlock_GetMaxECBlock(&max_physical_block, &max_block_ec);
 
    /* check if SWL is required */
-   if (max_physical_block != min_physical_block &&
+   if (ret == STATUS_SUCCESS &&
+       max_physical_block != min_physical_block &&
        max_physical_block != INVALID_BLOCK &&
        min_physical_block != INVALID_BLOCK &&
        max_block_ec != INVALID_EC &&
@@ -444,9 +766,11 @@ STATUS UBI_SWL()
       {
          if (ret == STATUS_SUCCESS)
          {
-            /* may read erased page, so acceptable error happen */
-            (void)MTD_Read(min_physical_block, i, tmp_data_buffer, spare);
-            ret = MTD_Program(max_physical_block, i, tmp_data_buffer, spare);
+            ret = ubi_copy_page(min_physical_block,
+                                i,
+                                max_physical_block,
+                                i,
+                                NULL);
          }
 
          if (ret == STATUS_SUCCESS)
@@ -512,11 +836,47 @@ STATUS UBI_ReadStatus(LOG_BLOCK block)
    ASSERT(phy_block != INVALID_BLOCK);
 
    ret = MTD_ReadStatus(phy_block);
+   if (ret != STATUS_DIE_BUSY &&
+       UBI_GetReadyTime(block) > 0)
+   {
+      /* the die is ready earlier than the model */
+      dice_ready_time[UBI_DIE(phy_block)] = ubi_clock;
+   }
 
    return ret;
 }
 
 
+UINT32 UBI_GetReadyTime(LOG_BLOCK block)
+{
+   PHY_BLOCK   phy_block;
+   UINT32      remaining;
+
+   phy_block = AREA_GetBlock(block);
+   ASSERT(phy_block != INVALID_BLOCK);
+
+   /* the ready time in the past looks like a huge number */
+   remaining = dice_ready_time[UBI_DIE(phy_block)] - ubi_clock;
+   if (remaining > MAX_UINT32/2)
+   {
+      remaining = 0;
+   }
+
+   return remaining;
+}
+
+
+UINT32 UBI_GetDie(LOG_BLOCK block)
+{
+   PHY_BLOCK   phy_block;
+
+   phy_block = AREA_GetBlock(block);
+   ASSERT(phy_block != INVALID_BLOCK);
+
+   return UBI_DIE(phy_block);
+}
+
+
 static
 STATUS ubi_reclaim_badblock(LOG_BLOCK     log_block,
                             PHY_BLOCK     phy_block,
@@ -529,7 +889,6 @@ STATUS ubi_reclaim_badblock(LOG_BLOCK     log_block,
    ERASE_COUNT new_ec;
    PAGE_OFF    i;
    STATUS      ret = STATUS_SUCCESS;
-   SPARE       spare;
 
    /* Reclaim Bad Block:
     * - get another free block, if none, return fail
@@ -549,8 +908,7 @@ STATUS ubi_reclaim_badblock(LOG_BLOCK     log_block,
       {
          if (ret == STATUS_SUCCESS)
          {
-            (void)MTD_Read(phy_block, i, tmp_data_buffer, spare);
-            ret = MTD_Program(new_block, i, tmp_data_buffer, spare);
+            ret = ubi_copy_page(phy_block, i, new_block, i, NULL);
          }
 
          if (ret == STATUS_SUCCESS)
@@ -591,23 +949,257 @@ STATUS ubi_reclaim_badblock(LOG_BLOCK     log_block,
 
 
 static
-UINT32 ubi_find_die_buffer(PHY_BLOCK block)
+STATUS ubi_flush_die(UINT32 die)
 {
-   UINT32   i;
-   UINT32   die_index = block>>BLOCK_PER_PLANE_SHIFT;
+   DIE_HOLD_PAGE* hold = &(dice_hold[die]);
+   ERASE_COUNT    new_ec;
+   PHY_BLOCK      new_phy_block = INVALID_BLOCK;
+   STATUS         ret = STATUS_SUCCESS;
 
-   for (i=0; i<TOTAL_DIE_COUNT; i++)
+   if (hold->phy_block != INVALID_BLOCK)
+   {
+      ASSERT(UBI_DIE(hold->phy_block) == die);
+
+      ret = MTD_WaitReady(hold->phy_block);
+      if (ret == STATUS_BADBLOCK)
+      {
+         /* skip the failed page instead of reclaiming the block */
+         ret = ubi_skip_bad_page(die);
+      }
+
+      while (ret == STATUS_BADBLOCK)
+      {
+         /* reclaim earlier pages */
+         ret = ubi_reclaim_badblock(hold->log_block,
+                                    hold->phy_block,
+                                    hold->ec,
+                                    hold->page,
+                                    &new_phy_block,
+                                    &new_ec);
+         if (ret == STATUS_SUCCESS)
+         {
+            hold->phy_block = new_phy_block;
+            hold->ec = new_ec;
+
+            /* write last page in die buffer, or copy it again */
+            if (hold->buffer != NULL)
+            {
+               ret = MTD_Program(hold->phy_block,
+                                 hold->page,
+                                 hold->buffer,
+                                 hold->spare);
+            }
+            else
+            {
+               ret = ubi_copy_page(hold->src_block,
+                                   hold->src_page,
+                                   hold->phy_block,
+                                   hold->page,
+                                   hold->spare);
+            }
+         }
+
+         if (ret == STATUS_SUCCESS)
+         {
+            ret = MTD_WaitReady(hold->phy_block);
+         }
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ubi_die_wait(die);
+
+         /* release the die buffer */
+         if (hold->buffer != NULL)
+         {
+            BUF_Free(hold->buffer);
+            hold->buffer = NULL;
+         }
+
+         hold->phy_block = INVALID_BLOCK;
+      }
+   }
+
+   return ret;
+}
+
+
+static
+STATUS ubi_skip_bad_page(UINT32 die)
+{
+   DIE_HOLD_PAGE* hold = &(dice_hold[die]);
+   STATUS         ret = STATUS_BADBLOCK;
+
+   /* program the failed page again in the next page. Only one failed page
+    * in a die is kept for FTL, and the last page is kept for the link of
+    * FTL journals, otherwise reclaim the block.
+    */
+   if (dice_bad_page[die].log_block == INVALID_BLOCK &&
+       hold->page+1 < PAGE_PER_PHY_BLOCK-1)
    {
-      if ((dice_hold[i].phy_block) != INVALID_BLOCK &&
-          ((dice_hold[i].phy_block)>>BLOCK_PER_PLANE_SHIFT) == die_index)
+      if (hold->buffer != NULL)
       {
-         break;
+         ret = MTD_Program(hold->phy_block,
+                           hold->page+1,
+                           hold->buffer,
+                           hold->spare);
+         ubi_die_issue(die, CFG_NAND_TXFER_US, CFG_NAND_TPROG_US);
+      }
+      else
+      {
+         ret = ubi_copy_page(hold->src_block,
+                             hold->src_page,
+                             hold->phy_block,
+                             hold->page+1,
+                             hold->spare);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         ret = MTD_WaitReady(hold->phy_block);
+      }
+
+      if (ret == STATUS_SUCCESS)
+      {
+         dice_bad_page[die].log_block = hold->log_block;
+         dice_bad_page[die].page = hold->page;
+         dice_marginal_block[die] = hold->phy_block;
+         bad_page_count ++;
+      }
+   }
+
+   return ret;
+}
+
+
+static
+UINT32 ubi_find_bad_page(LOG_BLOCK block)
+{
+   UINT32      die = TOTAL_DIE_COUNT;
+
+   if (bad_page_count > 0)
+   {
+      for (die=0; die<TOTAL_DIE_COUNT; die++)
+      {
+         if (dice_bad_page[die].log_block == block)
+         {
+            break;
+         }
+      }
+   }
+
+   return die;
+}
+
+
+static
+STATUS ubi_check_bad_page(LOG_BLOCK block, PAGE_OFF page)
+{
+   UINT32      die;
+   STATUS      ret = STATUS_SUCCESS;
+
+   /* the pages are taken by the failed page and its data */
+   die = ubi_find_bad_page(block);
+   if (die < TOTAL_DIE_COUNT && page <= dice_bad_page[die].page+1)
+   {
+      ret = STATUS_BADPAGE;
+   }
+
+   return ret;
+}
+
+
+static
+STATUS ubi_flush_block(LOG_BLOCK block)
+{
+   UINT32      die;
+   STATUS      ret;
+
+   /* the block may be moved to another die when flushing a bad block */
+   do
+   {
+      die = UBI_DIE(AREA_GetBlock(block));
+      ret = ubi_flush_die(die);
+   } while (ret == STATUS_SUCCESS &&
+            die != UBI_DIE(AREA_GetBlock(block)));
+
+   return ret;
+}
+
+
+static
+STATUS ubi_copy_page(PHY_BLOCK   src_block,
+                     PAGE_OFF    src_page,
+                     PHY_BLOCK   dst_block,
+                     PAGE_OFF    dst_page,
+                     SPARE       spare)
+{
+   SPARE       src_spare;
+   STATUS      ret;
+
+   /* copy back in the same die, without moving data on the bus */
+   ret = MTD_CopyBack(src_block, src_page, dst_block, dst_page, spare);
+   if (ret == STATUS_SUCCESS)
+   {
+      ubi_die_issue(UBI_DIE(dst_block),
+                    0,
+                    CFG_NAND_TR_US+CFG_NAND_TPROG_US);
+   }
+   else
+   {
+      /* copy through RAM, across dice or the data requires ECC. It may
+       * read erased page, so acceptable error happen.
+       */
+      ret = MTD_Read(src_block, src_page, tmp_data_buffer, src_spare);
+
+      ubi_die_issue(UBI_DIE(src_block), 0, CFG_NAND_TR_US);
+      ubi_die_wait(UBI_DIE(src_block));
+      ubi_clock += CFG_NAND_TXFER_US;
+
+      if (ret != STATUS_SUCCESS && spare == NULL &&
+          src_spare[0] == MAX_UINT32 && src_spare[1] == MAX_UINT32)
+      {
+         /* leave the erased page erased, it is programmed later by FTL */
+         ret = STATUS_SUCCESS;
+      }
+      else
+      {
+         if (spare == NULL)
+         {
+            spare = src_spare;
+         }
+
+         ret = MTD_Program(dst_block, dst_page, tmp_data_buffer, spare);
+         ubi_die_issue(UBI_DIE(dst_block),
+                       CFG_NAND_TXFER_US,
+                       CFG_NAND_TPROG_US);
       }
    }
 
-   ASSERT(i != TOTAL_DIE_COUNT);
+   return ret;
+}
+
 
-   return i;
+static
+void ubi_die_issue(UINT32 die, UINT32 bus_time, UINT32 busy_time)
+{
+   /* the die is waited before issuing. Move data on the bus, then the die
+    * is busy.
+    */
+   ubi_die_wait(die);
+   ubi_clock += bus_time;
+   dice_ready_time[die] = ubi_clock + busy_time;
+}
+
+
+static
+void ubi_die_wait(UINT32 die)
+{
+   /* move the clock to the ready time, if it is in the future */
+   if (dice_ready_time[die] - ubi_clock < MAX_UINT32/2)
+   {
+      ubi_clock = dice_ready_time[die];
+   }
 }
 
 
@@ -47,6 +47,10 @@ static PAGE_OFF      area_offset_table[AREA_TABLE_SIZE];
 static AREA_BLOCK    cached_area_table[CFG_PHY_BLOCK_PER_AREA];
 static AREA          cached_area_number;
 
+/* the area update not finished before PL, fixed in RAM until it is written */
+static LOG_BLOCK     plr_logical_block = INVALID_BLOCK;
+static AREA_BLOCK    plr_area_block;
+
 
 STATUS AREA_Init(AREA area_index)
 {
@@ -59,6 +63,12 @@ STATUS AREA_Init(AREA area_index)
    /* find the offset of the area table */
    cached_area_number = INVALID_AREA;
    area_offset_table[area_index] = INVALID_PAGE;
+   if (plr_logical_block != INVALID_BLOCK &&
+       AREA_INDEX(plr_logical_block) == area_index)
+   {
+      plr_logical_block = INVALID_BLOCK;
+   }
+
    ret = AREA_Read(area_index);
 
    return ret;
@@ -222,6 +232,9 @@ BOOL AREA_CheckUpdatePLR(PHY_BLOCK     logical_block,
       cached_area_table[block_offset].physical_block = origin_block;
       cached_area_table[block_offset].physical_block_ec = block_ec;
 
+      plr_logical_block = logical_block;
+      plr_area_block = cached_area_table[block_offset];
+
       need_plr = TRUE;
    }
 
@@ -261,6 +274,13 @@ STATUS AREA_Update(PHY_BLOCK      logical_block,
    {
       ASSERT(page != INVALID_PAGE);
       area_offset_table[area] = page;
+
+      if (plr_logical_block != INVALID_BLOCK &&
+          AREA_INDEX(plr_logical_block) == area)
+      {
+         /* the fixed area table is written */
+         plr_logical_block = INVALID_BLOCK;
+      }
    }
    else if (ret == STATUS_BADBLOCK)
    {
@@ -323,6 +343,14 @@ STATUS AREA_Read(AREA area)
       ret = TABLE_Read(index_table.area_index_table[area],
                        &(area_offset_table[area]),
                        &(cached_area_table[0]));
+
+      if (ret == STATUS_SUCCESS && plr_logical_block != INVALID_BLOCK &&
+          AREA_INDEX(plr_logical_block) == area)
+      {
+         /* fix the area update not written yet */
+         cached_area_table[BLOCK_OFFSET_AREA(plr_logical_block)] =
+                                                         plr_area_block;
+      }
    }
 
    if (ret == STATUS_SUCCESS)
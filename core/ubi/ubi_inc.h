@@ -137,6 +137,8 @@ extern ANCHOR_TABLE anchor_table;
  *                         AREA updating PLR info
  *    block_ec       OUT   erase count of the origin
  *                         block.
+ *    read_only      IN    not to repair the index
+ *                         table on MTD
  *
  * NOTES:
  *    In index table, we store the updating AREA table
@@ -151,7 +153,8 @@ extern ANCHOR_TABLE anchor_table;
  ***************************************************/
 STATUS INDEX_Init(PHY_BLOCK*        logical_block,
                   PHY_BLOCK*        origin_block,
-                  ERASE_COUNT*      block_ec);
+                  ERASE_COUNT*      block_ec,
+                  BOOL              read_only);
 
 
 /***************************************************
@@ -341,6 +344,27 @@ void INDEX_FreeBlock_Put(PHY_BLOCK dirty_block, ERASE_COUNT dirty_block_ec);
 STATUS INDEX_FreeBlock_Get(DIE_INDEX die, PHY_BLOCK* block, ERASE_COUNT* ec);
 
 
+/***************************************************
+ * Funcion Name: INDEX_FreeBlock_EraseAhead
+ *
+ * Description:
+ *    erase the next free block of dice in parallel.
+ *
+ * Return Value:
+ *    STATUS      S/F
+ *
+ * Parameter List:
+ *    die_mask IN       one bit for each die
+ *
+ * NOTES:
+ *    INDEX_FreeBlock_Get takes the erased block without
+ *    erasing it again. Failed blocks are erased again
+ *    when getting them.
+ *
+ ***************************************************/
+STATUS INDEX_FreeBlock_EraseAhead(UINT32 die_mask);
+
+
 /***************************************************
  * Funcion Name: AREA_Init
  *
@@ -478,6 +502,8 @@ BLOCK_OFF AREA_FindMinECBlock(AREA           area,
  *    If area table is NOT integrity with index table,
  *    the area table should be written again during
  *    init with updated origin block number and ec.
+ *    Until then, the area table in RAM is fixed each
+ *    time it is read.
  *
  ***************************************************/
 BOOL AREA_CheckUpdatePLR(PHY_BLOCK     logical_block,
@@ -635,13 +661,14 @@ STATUS ANCHOR_Format(PHY_BLOCK total_data_block);
  *    STATUS         S/F
  *
  * Parameter List:
- *    N/A
+ *    read_only         IN    not to erase the out of
+ *                            date anchor block
  *
  * NOTES:
  *    N/A
  *
  ***************************************************/
-STATUS ANCHOR_Init();
+STATUS ANCHOR_Init(BOOL read_only);
 
 
 /***************************************************
@@ -55,6 +55,9 @@
 static
 STATUS index_update();
 
+static
+void index_clear_erased(PHY_BLOCK block);
+
 
 INDEX_TABLE index_table;
 
@@ -65,6 +68,11 @@ static PAGE_OFF      index_next_page;
 
 static BOOL          is_updating_area = FALSE;
 
+/* the free block erased ahead in each die, or INVALID_BLOCK. Only kept in
+ * RAM, the block is erased again after power loss.
+ */
+static PHY_BLOCK     erased_free_block[TOTAL_DIE_COUNT];
+
 
 PHY_BLOCK INDEX_Format(PHY_BLOCK total_block, PHY_BLOCK fmt_current_block)
 {
@@ -172,13 +180,20 @@ PHY_BLOCK INDEX_Format(PHY_BLOCK total_block, PHY_BLOCK fmt_current_block)
 
 STATUS INDEX_Init(PHY_BLOCK*      logical_block,
                   PHY_BLOCK*      origin_block,
-                  ERASE_COUNT*    block_ec)
+                  ERASE_COUNT*    block_ec,
+                  BOOL            read_only)
 {
+   UINT32      die;
    PAGE_OFF    page_offset = INVALID_OFFSET;
    STATUS      ret = STATUS_FAILURE;
 
    is_updating_area = FALSE;
 
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      erased_free_block[die] = INVALID_BLOCK;
+   }
+
    /* PLR of index block reclaim: try to read new block first */
    ASSERT(anchor_table.index_new_block != INVALID_BLOCK);
    ret = TABLE_Read(anchor_table.index_new_block, &page_offset, &index_table);
@@ -190,7 +205,10 @@ STATUS INDEX_Init(PHY_BLOCK*      logical_block,
       index_next_page = page_offset + 1;
 
       /* this page may be written before PL, just write it to overwrite it */
-      (void)index_update();
+      if (read_only == FALSE)
+      {
+         (void)index_update();
+      }
    }
    else
    {
@@ -207,7 +225,10 @@ STATUS INDEX_Init(PHY_BLOCK*      logical_block,
          index_next_page = PAGE_PER_PHY_BLOCK;
 
          /* update index table to new block */
-         ret = index_update();
+         if (read_only == FALSE)
+         {
+            ret = index_update();
+         }
       }
    }
 
@@ -353,6 +374,8 @@ void INDEX_FreeBlock_SwapMaxECBlock(PHY_BLOCK      min_ec_block,
 {
    UINT32   i;
 
+   index_clear_erased(min_ec_block);
+
    /* swap for SWL:
     * - find the max ec good block in free block,
     * - re-sort and inset the min ec block
@@ -455,12 +478,19 @@ STATUS INDEX_FreeBlock_Get(DIE_INDEX die, PHY_BLOCK* block, ERASE_COUNT* ec)
          *block = index_table.free_block_table[0];
       }
 
-      if (*block != INVALID_BLOCK)
+      if (*block != INVALID_BLOCK &&
+          *block == erased_free_block[(*block)%TOTAL_DIE_COUNT])
+      {
+         /* erased ahead with other dice */
+         erased_free_block[(*block)%TOTAL_DIE_COUNT] = INVALID_BLOCK;
+         ret = STATUS_SUCCESS;
+      }
+      else if (*block != INVALID_BLOCK)
       {
          ASSERT(i < FREE_BLOCK_COUNT);
 
-         /* no background erase. Erase block before using it. Most of erase
-          * would happen in background reclaim.
+         /* Erase block before using it. Most of erase would happen in
+          * background reclaim.
           */
          ret = MTD_Erase(*block);
       }
@@ -507,10 +537,65 @@ STATUS INDEX_FreeBlock_Get(DIE_INDEX die, PHY_BLOCK* block, ERASE_COUNT* ec)
 }
 
 
+STATUS INDEX_FreeBlock_EraseAhead(UINT32 die_mask)
+{
+   PHY_BLOCK   erasing_block[TOTAL_DIE_COUNT];
+   DIE_INDEX   die;
+   UINT32      i;
+   STATUS      ret = STATUS_SUCCESS;
+
+   /* start erasing the block INDEX_FreeBlock_Get would take in each die */
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      erasing_block[die] = INVALID_BLOCK;
+
+      if ((die_mask & (1<<die)) != 0 &&
+          erased_free_block[die] == INVALID_BLOCK)
+      {
+         for (i=0; i<FREE_BLOCK_COUNT; i++)
+         {
+            if (index_table.free_block_table[i] == INVALID_BLOCK)
+            {
+               break;
+            }
+            else if ((index_table.free_block_table[i]%TOTAL_DIE_COUNT) == die)
+            {
+               erasing_block[die] = index_table.free_block_table[i];
+               break;
+            }
+         }
+      }
+
+      if (erasing_block[die] != INVALID_BLOCK)
+      {
+         ret = MTD_EraseAsync(erasing_block[die]);
+         if (ret != STATUS_SUCCESS)
+         {
+            break;
+         }
+      }
+   }
+
+   /* wait all dice even if failed, failed blocks are erased again later */
+   for (die=0; die<TOTAL_DIE_COUNT; die++)
+   {
+      if (erasing_block[die] != INVALID_BLOCK &&
+          MTD_WaitReady(erasing_block[die]) == STATUS_SUCCESS)
+      {
+         erased_free_block[die] = erasing_block[die];
+      }
+   }
+
+   return ret;
+}
+
+
 void INDEX_FreeBlock_Put(PHY_BLOCK dirty_block, ERASE_COUNT dirty_block_ec)
 {
    UINT32   i;
 
+   index_clear_erased(dirty_block);
+
    /* the last item of FBT will be discarded to insert the new free block */
    for (i=FREE_BLOCK_COUNT-2; i>0; i--)
    {
@@ -625,3 +710,14 @@ STATUS index_update()
 }
 
 
+static
+void index_clear_erased(PHY_BLOCK block)
+{
+   /* the block is dirty again when putting it back to FBT */
+   if (erased_free_block[block%TOTAL_DIE_COUNT] == block)
+   {
+      erased_free_block[block%TOTAL_DIE_COUNT] = INVALID_BLOCK;
+   }
+}
+
+
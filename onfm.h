@@ -33,22 +33,57 @@
 #ifndef _ONFM_HEADER_H_
 #define _ONFM_HEADER_H_
 
+/* sector address, 64-bit for more than 2TB of sectors */
+typedef unsigned long long    ONFM_LBA;
+
 int ONFM_Format();
 
-int ONFM_Capacity();
+ONFM_LBA ONFM_Capacity();
+
+/* geometry for the transport: bytes of a logical sector, and the sectors
+ * of a flash page. Writes of aligned whole pages bypass the merge buffer.
+ */
+unsigned long ONFM_SectorSize();
+
+unsigned long ONFM_SectorPerPage();
 
 int ONFM_Mount();
 
-int ONFM_Read(unsigned long   sector_addr,
+/* mount without any program or erase, writes fail until the next mount */
+int ONFM_MountReadOnly();
+
+int ONFM_Read(ONFM_LBA        sector_addr,
               unsigned long   sector_count,
               void*           sector_data);
 
-int ONFM_Write(unsigned long  sector_addr,
+int ONFM_Write(ONFM_LBA       sector_addr,
                unsigned long  sector_count,
                void*          sector_data);
 
+/* write with the stream id from host, 0 for no stream */
+int ONFM_WriteHint(ONFM_LBA       sector_addr,
+                   unsigned long  sector_count,
+                   void*          sector_data,
+                   unsigned long  stream_id);
+
+/* all sectors are written, or none after power loss. The sectors should be
+ * in the pages of a flash block.
+ */
+int ONFM_WriteAtomic(ONFM_LBA       sector_addr,
+                     unsigned long  sector_count,
+                     void*          sector_data);
+
+/* copy sectors, the regions may overlap. Whole pages at the same offset in
+ * pages are copied by mapping, without copying the data.
+ */
+int ONFM_Copy(ONFM_LBA        src_sector,
+              ONFM_LBA        dst_sector,
+              unsigned long   sector_count);
+
 int ONFM_Unmount();
 
+int ONFM_BgTasks();
+
 #endif
 
 
@@ -56,10 +56,10 @@ extern void USB_EndPoint0 (UNS_32 event);
 
 
 #pragma data_alignment=DMA_BURST_BYTES
-unsigned char sector_buffer[SECTOR_SIZE];
+unsigned char sector_buffer[LBA_SIZE];
 
 #pragma data_alignment=DMA_BURST_BYTES
-unsigned char read_sector_buffer[SECTOR_SIZE];
+unsigned char read_sector_buffer[LBA_SIZE];
 
 #pragma data_alignment=DMA_BURST_BYTES
 UINT8 write_page_buffer[MPP_SIZE];
@@ -256,13 +256,13 @@ void test_onfm()
       /* seed the randome: no seed to freeze the test case */
       srand(rand()+i+rand_seed);
 
-      start_sector = (unsigned long)(rand()%USER_SPACE_SECTOR_COUNT) & (~(SECTOR_PER_MPP-1));
+      start_sector = (unsigned long)(rand()%USER_SPACE_SECTOR_COUNT) & (~(LBA_PER_MPP-1));
       rand_seed = (unsigned long)(rand()%(USER_SPACE_SECTOR_COUNT-start_sector));
       write_data   = (UINT8)(rand()%((UINT8)-1));
       sector_count = 8;
 
       /* set data */
-      memset(sector_buffer, (unsigned char)start_sector, SECTOR_SIZE);
+      memset(sector_buffer, (unsigned char)start_sector, LBA_SIZE);
 
       /* write */
       ret = ONFM_Write(start_sector, sector_count, sector_buffer);
@@ -272,7 +272,7 @@ void test_onfm()
          ret = ONFM_Read(start_sector, sector_count, read_sector_buffer);
          if (ret == 0)
          {
-            ret = memcmp(sector_buffer, read_sector_buffer, SECTOR_SIZE);
+            ret = memcmp(sector_buffer, read_sector_buffer, LBA_SIZE);
          }
       }
 
@@ -314,6 +314,20 @@ void usb_user_task_loop()
             LED_CLR(LED2);
 
          }
+         else if (ut_list[ut_pop].type == UT_COPY)
+         {
+            LED_SET(LED2);
+
+            PRINTF("copy: %d, %d, %d \n", ut_list[ut_pop].source,
+                                          ut_list[ut_pop].offset,
+                                          ut_list[ut_pop].length);
+
+            ONFM_Copy(ut_list[ut_pop].source,
+                      ut_list[ut_pop].offset,
+                      ut_list[ut_pop].length);
+
+            LED_CLR(LED2);
+         }
          else if (ut_list[ut_pop].type == UT_READ)
          {
             if (Read_BulkLen == 0)
@@ -350,6 +364,11 @@ void usb_user_task_loop()
          /* next write operation */
          ut_pop = (ut_pop+1)%UT_LIST_SIZE;
       }
+      else
+      {
+         /* no task from usb, reclaim in background */
+         ONFM_BgTasks();
+      }
    }
 }
 
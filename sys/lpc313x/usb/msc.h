@@ -101,6 +101,7 @@ typedef struct _MSC_CSW MSC_CSW;
 #define SCSI_READ10                     0x28
 #define SCSI_WRITE10                    0x2A
 #define SCSI_VERIFY10                   0x2F
+#define SCSI_EXTENDED_COPY              0x83
 #define SCSI_READ12                     0xA8
 #define SCSI_WRITE12                    0xAA
 #define SCSI_MODE_SELECT10              0x55
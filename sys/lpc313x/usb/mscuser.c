@@ -17,6 +17,7 @@
  * Adaption to LPCxxxx, Copyright (c) 2009 NXP.
  *--------------------------------------------------------------------------
  * History:
+ *          V1.30 Added SCSI_EXTENDED_COPY, block to block segments only
  *          V1.20 Added SCSI_READ12, SCSI_WRITE12
  *          V1.00 Initial Version
  *--------------------------------------------------------------------------*/
@@ -72,6 +73,7 @@ UNS_32         merge_count;
 
 static UNS_32 DataIn_Format(void);
 static void DataIn_Transfer(void);
+static UNS_32 ExtendedCopy_Segment(UNS_8* segment);
 
 
 void MSC_Init()
@@ -122,7 +124,7 @@ void MSC_MemoryRead(void)
    if (DevStatusFS2HS)
    {
       /* read sectors aligned to a MPP */
-      n = MIN(SECTOR_PER_MPP-(Offset%SECTOR_PER_MPP), Length);
+      n = MIN(LBA_PER_MPP-(Offset%LBA_PER_MPP), Length);
 
       if ((Offset + n) > MSC_BlockCount)
       {
@@ -177,8 +179,8 @@ void MSC_MemoryWrite(void)
 
       /* log the write operation to ut_list */
       ut_list[ut_push].type   = UT_WRITE;
-      ut_list[ut_push].offset = Offset&(~(SECTOR_PER_MPP-1));
-      ut_list[ut_push].length = SECTOR_PER_MPP;
+      ut_list[ut_push].offset = Offset&(~(LBA_PER_MPP-1));
+      ut_list[ut_push].length = LBA_PER_MPP;
       ut_list[ut_push].buffer = BulkBuf;
 
       /* handle ONFM read/write in user tasks */
@@ -211,6 +213,93 @@ void MSC_MemoryVerify(void)
 }
 
 
+/* EXTENDED COPY (LID1) parameter list: a 16-byte header, the target
+ * descriptors, and the segment descriptors. The only LUN is both the source
+ * and the destination, so target descriptors are not checked. Each block to
+ * block segment is copied by ONFM in user tasks, other segments fail the
+ * command.
+ */
+#define XCOPY_HEADER_SIZE           (16)
+#define XCOPY_SEGMENT_BLOCK_BLOCK   (0x02)
+#define XCOPY_SEGMENT_SIZE          (28)
+
+void MSC_ExtendedCopy(void)
+{
+   UNS_32   target_len;
+   UNS_32   segment_len;
+   UNS_32   i;
+   UNS_32   free_count;
+   UNS_32   n;
+   UNS_32   status = CSW_CMD_FAILED;
+   UNS_8*   segment;
+
+   target_len = (CMD_BulkBuf[2] <<  8) |
+                (CMD_BulkBuf[3] <<  0);
+   segment_len = (CMD_BulkBuf[ 8] << 24) |
+                 (CMD_BulkBuf[ 9] << 16) |
+                 (CMD_BulkBuf[10] <<  8) |
+                 (CMD_BulkBuf[11] <<  0);
+   segment = CMD_BulkBuf+XCOPY_HEADER_SIZE+target_len;
+
+   /* all segments should be valid, and fit in the ut_list */
+   free_count = UT_LIST_SIZE-1-(ut_push+UT_LIST_SIZE-ut_pop)%UT_LIST_SIZE;
+   if (BulkLen < XCOPY_HEADER_SIZE ||
+       XCOPY_HEADER_SIZE+target_len+segment_len > BulkLen ||
+       segment_len%XCOPY_SEGMENT_SIZE != 0 ||
+       segment_len/XCOPY_SEGMENT_SIZE > free_count)
+   {
+      n = 0;
+   }
+   else
+   {
+      n = segment_len/XCOPY_SEGMENT_SIZE;
+      for (i=0; i<segment_len; i+=XCOPY_SEGMENT_SIZE)
+      {
+         if (ExtendedCopy_Segment(segment+i) == FALSE)
+         {
+            break;
+         }
+      }
+
+      if (i == segment_len)
+      {
+         status = CSW_CMD_PASSED;
+      }
+      else
+      {
+         n = 0;
+      }
+   }
+
+   for (i=0; i<n; i++, segment+=XCOPY_SEGMENT_SIZE)
+   {
+      /* log the copy operation to ut_list */
+      ut_list[ut_push].type   = UT_COPY;
+      ut_list[ut_push].source = (segment[16] << 24) |
+                                (segment[17] << 16) |
+                                (segment[18] <<  8) |
+                                (segment[19] <<  0);
+      ut_list[ut_push].offset = (segment[24] << 24) |
+                                (segment[25] << 16) |
+                                (segment[26] <<  8) |
+                                (segment[27] <<  0);
+      ut_list[ut_push].length = (segment[10] <<  8) |
+                                (segment[11] <<  0);
+      ut_list[ut_push].buffer = NULL;
+
+      /* handle ONFM copy in user tasks */
+      ut_push = (ut_push+1)%UT_LIST_SIZE;
+      /* the ut_list should not be full */
+      ASSERT(ut_push != ut_pop);
+   }
+
+   CSW.dDataResidue -= BulkLen;
+   CSW.bStatus = status;
+
+   MSC_SetCSW();
+}
+
+
 UNS_32 MSC_RWSetup(void)
 {
    UNS_32 n;
@@ -533,6 +622,19 @@ fail:
                   }
                }
                break;
+            case SCSI_EXTENDED_COPY:
+               /* the parameter list is received in the command buffer */
+               if ((CBW.bmFlags & 0x80) == 0 &&
+                   CBW.dDataLength != 0 &&
+                   CBW.dDataLength <= MSC_BlockSize)
+               {
+                  BulkStage = MSC_BS_DATA_OUT;
+               }
+               else
+               {
+                  goto fail;
+               }
+               break;
             case SCSI_VERIFY10:
                if ((CBW.CB[1] & 0x02) == 0)
                {
@@ -646,7 +748,14 @@ void MSC_BulkOutNak(void)
 
    if (DevStatusFS2HS)
    {
-      if (BulkStage == MSC_BS_DATA_OUT)
+      if (BulkStage == MSC_BS_DATA_OUT && CBW.CB[0] == SCSI_EXTENDED_COPY)
+      {
+         /* receive the parameter list of EXTENDED COPY */
+         BulkBuf = CMD_BulkBuf;
+         buffer = BulkBuf;
+         bulkout_len = CBW.dDataLength;
+      }
+      else if (BulkStage == MSC_BS_DATA_OUT)
       {
          if (merge_stage == MERGE_START)
          {
@@ -656,7 +765,7 @@ void MSC_BulkOutNak(void)
          }
          else if (merge_stage == MERGE_FINISH)
          {
-            buffer = BulkBuf+(Offset%SECTOR_PER_MPP)*MSC_BlockSize;
+            buffer = BulkBuf+(Offset%LBA_PER_MPP)*MSC_BlockSize;
             bulkout_len = merge_count*MSC_BlockSize;
 
             merge_stage = MERGE_NONE;
@@ -671,15 +780,15 @@ void MSC_BulkOutNak(void)
             if (BulkBuf != NULL)
             {
                /* sector counts to write in MPP aligned */
-               n = MIN(SECTOR_PER_MPP-(Offset%SECTOR_PER_MPP), Length);
+               n = MIN(LBA_PER_MPP-(Offset%LBA_PER_MPP), Length);
 
                /* merge non-aligned or non-full bulk */
-               if (n != SECTOR_PER_MPP)
+               if (n != LBA_PER_MPP)
                {
                   /* log the read-for-merge operation to ut_list */
                   ut_list[ut_push].type   = UT_MERGE;
-                  ut_list[ut_push].offset = Offset&(~(SECTOR_PER_MPP-1));
-                  ut_list[ut_push].length = SECTOR_PER_MPP;
+                  ut_list[ut_push].offset = Offset&(~(LBA_PER_MPP-1));
+                  ut_list[ut_push].length = LBA_PER_MPP;
                   ut_list[ut_push].buffer = BulkBuf;
 
                   /* handle ONFM read/write in user tasks */
@@ -751,6 +860,9 @@ void MSC_BulkOut(void)
             case SCSI_VERIFY10:
                MSC_MemoryVerify();
                break;
+            case SCSI_EXTENDED_COPY:
+               MSC_ExtendedCopy();
+               break;
          }
          break;
       case MSC_BS_CSW:
@@ -799,3 +911,35 @@ void DataIn_Transfer(void)
 }
 
 
+static
+UNS_32 ExtendedCopy_Segment(UNS_8* segment)
+{
+   UNS_32   src;
+   UNS_32   dst;
+   UNS_32   n;
+
+   /* sector addresses are 32 bits in USB transactions */
+   src = (segment[16] << 24) |
+         (segment[17] << 16) |
+         (segment[18] <<  8) |
+         (segment[19] <<  0);
+   dst = (segment[24] << 24) |
+         (segment[25] << 16) |
+         (segment[26] <<  8) |
+         (segment[27] <<  0);
+   n = (segment[10] <<  8) |
+       (segment[11] <<  0);
+
+   if (segment[0] != XCOPY_SEGMENT_BLOCK_BLOCK ||
+       (segment[12] | segment[13] | segment[14] | segment[15]) != 0 ||
+       (segment[20] | segment[21] | segment[22] | segment[23]) != 0 ||
+       src > MSC_BlockCount || n > MSC_BlockCount - src ||
+       dst > MSC_BlockCount || n > MSC_BlockCount - dst)
+   {
+      return (FALSE);
+   }
+
+   return (TRUE);
+}
+
+
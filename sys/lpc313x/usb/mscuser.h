@@ -29,7 +29,7 @@
 /* Mass Storage Memory Layout */
 /* MSC Disk Image Definitions */
 /* Mass Storage Memory Layout */
-#define MSC_BlockSize         (SECTOR_SIZE)
+#define MSC_BlockSize         (LBA_SIZE)
 
 /* Max In/Out Packet Size */
 #define MSC_FS_MAX_PACKET     (64)
@@ -45,6 +45,7 @@ typedef enum {
    UT_WRITE,
    UT_MERGE,
    UT_PREREAD, 
+   UT_COPY,
 } UT_TYPE;
 
 typedef enum {
@@ -58,6 +59,7 @@ typedef struct {
    UNS_32   offset;
    UNS_32   length;
    UNS_8*   buffer;
+   UNS_32   source;     /* source sector of UT_COPY */
 } USB_TRANSCATION;
 
 #define UT_LIST_SIZE       (BUFFER_COUNT*2)
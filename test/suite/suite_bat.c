@@ -51,7 +51,7 @@
 static UINT32  USER_SPACE_SECTOR_COUNT;
 
 /* whole virtual disk image for testing */
-static SECTOR*          volumn_image;
+static LBA_DATA*        volumn_image;
 
 static unsigned long    start_list[LARGE_TEST_CYCLE];
 static unsigned long    count_list[LARGE_TEST_CYCLE];
@@ -61,7 +61,7 @@ static UINT8            data_list[LARGE_TEST_CYCLE];
 #if defined(__ICCARM__)
 #pragma data_alignment=16
 #endif
-SECTOR   check_data_buffer;
+LBA_DATA check_data_buffer;
 
 static
 int bat_check_volumn_image()
@@ -74,7 +74,7 @@ int bat_check_volumn_image()
       ret = ONFM_Read(i, 1, check_data_buffer);
       ASSERT(ret == 0);
 
-      if (memcmp(check_data_buffer, volumn_image[i], SECTOR_SIZE) != 0)
+      if (memcmp(check_data_buffer, volumn_image[i], LBA_SIZE) != 0)
       {
          ret = -1;
          break;
@@ -100,18 +100,19 @@ void TC_BAT_RandomReadWrite(CuTest* tc)
    BOOL     debug_mode = FALSE;
    UINT32   i;
    UINT32   j;
+   UINT32   sector;
    float    sector_written = 0;
    float    page_written = 0;
    float    wa = 1;
    int      ret;
 
    USER_SPACE_SECTOR_COUNT = ONFM_Capacity();
-   volumn_image = (SECTOR*)malloc(SECTOR_SIZE*USER_SPACE_SECTOR_COUNT);
+   volumn_image = (LBA_DATA*)malloc(LBA_SIZE*USER_SPACE_SECTOR_COUNT);
 
    do
    {
       /* init ram image */
-      memset(&(volumn_image[0][0]), 0, SECTOR_SIZE*USER_SPACE_SECTOR_COUNT);
+      memset(&(volumn_image[0][0]), 0, LBA_SIZE*USER_SPACE_SECTOR_COUNT);
 
       /* init nand */
       ret = ONFM_Mount();
@@ -172,10 +173,14 @@ void TC_BAT_RandomReadWrite(CuTest* tc)
             }
          }
 
-         /* fill ram image with data */
+         /* fill ram image with data, and the sector number in the first
+          * bytes, so pages are not filled with one byte.
+          */
          for (j=0; j<sector_count; j++)
          {
-            memset(&volumn_image[start_sector+j], write_data, SECTOR_SIZE);
+            sector = start_sector+j;
+            memset(&volumn_image[sector], write_data, LBA_SIZE);
+            memcpy(&volumn_image[sector], &sector, sizeof(sector));
          }
 
          /* the program in format should be eliminated to calc WA */
@@ -188,7 +193,7 @@ void TC_BAT_RandomReadWrite(CuTest* tc)
             /* calcuate WA */
             page_written += TEST_total_page_program;
             sector_written += sector_count;
-            wa = page_written*SECTOR_PER_MPP/sector_written;
+            wa = page_written*LBA_PER_MPP/sector_written;
          }
          
          if(ret == 0 && i%0xfff == 0)
@@ -45,16 +45,167 @@
 #include "..\suites.h"
 
 
+/* pages in the atomic write test, on more than one die */
+#define ATOMIC_TEST_PAGES        (8)
+
+
+/* a local generator for random pages, rand() may have 15 bits only */
+static UINT32  ftl_random_seed = 1;
+
+
+static
+STATUS ftl_format();
+
+static
+PGADDR ftl_random_page(PGADDR start, PGADDR end);
+
+static
+STATUS ftl_check_image(CuTest* tc, UINT8* image, PGADDR page_count);
+
+
 void TC_FTL_BasicalValidation(CuTest* tc)
 {
    STATUS   ret;
    UINT8    buffer[MPP_SIZE];
 
-   MTD_Init();
+   ret = ftl_format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
 
-   ret = FTL_Format();
+   buffer[0] = 0x5a;
+   ret = FTL_Write(0, buffer);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   buffer[0] = 0x00;
+   ret = FTL_Read(0, buffer);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+   CuAssertTrue(tc, buffer[0] == 0x5a);
+}
+
+
+void TC_FTL_BackgroundReclaim(CuTest* tc)
+{
+   STATUS   ret;
+   PGADDR   addr;
+   PGADDR   page_count;
+   UINT32   i;
+   UINT8*   image;
+   UINT8    buffer[MPP_SIZE];
+
+   ret = ftl_format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   page_count = FTL_Capacity();
+   image = calloc(page_count, 1);
+   CuAssertTrue(tc, image != NULL);
+
+   /* overwrite random pages, and reclaim in background between writes */
+   for (i=0; i<page_count*2 && ret == STATUS_SUCCESS; i++)
+   {
+      addr = ftl_random_page(0, page_count);
+      buffer[0] = (UINT8)(i%0xff+1);
+      image[addr] = buffer[0];
+
+      ret = FTL_Write(addr, buffer);
+      if (ret == STATUS_SUCCESS && i%4 == 0)
+      {
+         ret = FTL_BgTasks();
+      }
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* the reclaimed pages are replayed after init */
+   ret = ftl_check_image(tc, image, page_count);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   free(image);
+}
+
+
+void TC_FTL_StreamHint(CuTest* tc)
+{
+   STATUS   ret;
+   PGADDR   addr;
+   PGADDR   page_count;
+   UINT32   i;
+   UINT8*   image;
+   UINT8    buffer[MPP_SIZE];
+
+   ret = ftl_format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   page_count = FTL_Capacity();
+   image = calloc(page_count, 1);
+   CuAssertTrue(tc, image != NULL);
+
+   /* overwrite random pages with stream ids, more than the data streams */
+   for (i=0; i<page_count*2 && ret == STATUS_SUCCESS; i++)
+   {
+      addr = ftl_random_page(0, page_count);
+      buffer[0] = (UINT8)(i%0xff+1);
+      image[addr] = buffer[0];
+
+      ret = FTL_WriteHint(addr, buffer, addr%(DATA_STREAM_COUNT+2));
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* pages of all streams are replayed after init */
+   ret = ftl_check_image(tc, image, page_count);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   free(image);
+}
+
+
+extern UINT32  TEST_total_page_program;
+
+void TC_FTL_ReadOnlyInit(CuTest* tc)
+{
+   STATUS   ret;
+   PGADDR   cluster_pages = MPP_SIZE/sizeof(UINT32);
+   UINT32   i;
+   UINT8    buffer[MPP_SIZE];
+
+   ret = ftl_format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* commit a page in the cluster after the cached ones */
+   buffer[0] = PMT_CACHE_COUNT+1;
+   ret = FTL_Write(PMT_CACHE_COUNT*cluster_pages, buffer);
    CuAssertTrue(tc, ret==STATUS_SUCCESS);
 
+   ret = FTL_Flush();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* fill all PMT caches with pages to replay */
+   for (i=0; i<PMT_CACHE_COUNT; i++)
+   {
+      buffer[0] = (UINT8)(i+1);
+      ret = FTL_Write(i*cluster_pages, buffer);
+      CuAssertTrue(tc, ret==STATUS_SUCCESS);
+   }
+
+   /* nothing is programmed in read-only init, and in reads */
+   TEST_total_page_program = 0;
+
+   ret = FTL_InitReadOnly();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (i=0; i<=PMT_CACHE_COUNT; i++)
+   {
+      buffer[0] = 0x00;
+      ret = FTL_Read(i*cluster_pages, buffer);
+      CuAssertTrue(tc, ret==STATUS_SUCCESS);
+      CuAssertTrue(tc, buffer[0] == i+1);
+   }
+
+   ret = FTL_Write(0, buffer);
+   CuAssertTrue(tc, ret!=STATUS_SUCCESS);
+
+   ret = FTL_Flush();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+   CuAssertTrue(tc, TEST_total_page_program == 0);
+
+   /* writable again after a normal init */
    ret = FTL_Init();
    CuAssertTrue(tc, ret==STATUS_SUCCESS);
 
@@ -62,10 +213,262 @@ void TC_FTL_BasicalValidation(CuTest* tc)
    ret = FTL_Write(0, buffer);
    CuAssertTrue(tc, ret==STATUS_SUCCESS);
 
-   buffer[0] = 0x00;
-   ret = FTL_Read(0, buffer);
+   for (i=0; i<=PMT_CACHE_COUNT; i++)
+   {
+      buffer[0] = 0x00;
+      ret = FTL_Read(i*cluster_pages, buffer);
+      CuAssertTrue(tc, ret==STATUS_SUCCESS);
+      CuAssertTrue(tc, buffer[0] == (i == 0 ? 0x5a : i+1));
+   }
+}
+
+
+void TC_FTL_Copy(CuTest* tc)
+{
+   STATUS   ret;
+   PGADDR   addr;
+   PGADDR   page_count;
+   PGADDR   copy_count = 0x100;
+   UINT32   i;
+   UINT8*   image;
+   UINT8    buffer[MPP_SIZE];
+
+   ret = ftl_format();
    CuAssertTrue(tc, ret==STATUS_SUCCESS);
-   CuAssertTrue(tc, buffer[0] == 0x5a);
+
+   page_count = FTL_Capacity();
+   image = calloc(page_count, 1);
+   CuAssertTrue(tc, image != NULL);
+
+   for (addr=0; addr<copy_count*2 && ret == STATUS_SUCCESS; addr++)
+   {
+      buffer[0] = (UINT8)(addr%0xff+1);
+      image[addr] = buffer[0];
+
+      ret = FTL_Write(addr, buffer);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* copy to an overlapped region, no data page is programmed */
+   TEST_total_page_program = 0;
+
+   ret = FTL_Copy(0, copy_count/2, copy_count);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+   CuAssertTrue(tc, TEST_total_page_program < copy_count/8);
+
+   memmove(&image[copy_count/2], &image[0], copy_count);
+
+   /* overwrite the source, and reclaim the shared pages */
+   buffer[0] = 0x5a;
+   image[copy_count/2] = buffer[0];
+   ret = FTL_Write(copy_count/2, buffer);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (i=0; i<page_count*2 && ret == STATUS_SUCCESS; i++)
+   {
+      addr = ftl_random_page(copy_count*2, page_count);
+      buffer[0] = (UINT8)(i%0xff+1);
+      image[addr] = buffer[0];
+
+      ret = FTL_Write(addr, buffer);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   ret = ftl_check_image(tc, image, page_count);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   free(image);
+}
+
+
+void TC_FTL_PatternPage(CuTest* tc)
+{
+   STATUS   ret;
+   PGADDR   addr;
+   UINT32   i;
+   UINT8    buffer[MPP_SIZE];
+
+   ret = ftl_format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* write data pages, and commit them */
+   for (addr=0; addr<0x100 && ret == STATUS_SUCCESS; addr++)
+   {
+      memset(buffer, (UINT8)addr, MPP_SIZE);
+      buffer[MPP_SIZE-1] = (UINT8)(addr+1);
+
+      ret = FTL_Write(addr, buffer);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   ret = FTL_Flush();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* overwrite some of them with patterns, and write data after them */
+   for (addr=0; addr<0x100 && ret == STATUS_SUCCESS; addr+=2)
+   {
+      memset(buffer, (UINT8)addr, MPP_SIZE);
+      ret = FTL_Write(addr, buffer);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   memset(buffer, 0x01, MPP_SIZE);
+   buffer[MPP_SIZE-1] = 0x02;
+   ret = FTL_Write(0x101, buffer);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* patterns are replayed in order after init, without a flush */
+   ret = FTL_Init();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (addr=0; addr<0x102 && ret == STATUS_SUCCESS; addr++)
+   {
+      if (addr == 0x100)
+      {
+         continue;
+      }
+
+      ret = FTL_Read(addr, buffer);
+      for (i=0; i<MPP_SIZE-1; i++)
+      {
+         CuAssertTrue(tc, buffer[i] == (UINT8)addr);
+      }
+
+      CuAssertTrue(tc, buffer[MPP_SIZE-1] ==
+                       (UINT8)(addr%2 == 0 ? addr : addr+1));
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+}
+
+
+void TC_FTL_Dedup(CuTest* tc)
+{
+   STATUS   ret;
+   PGADDR   addr;
+   UINT32   i;
+   UINT8    buffer[MPP_SIZE];
+
+   ret = ftl_format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (i=0; i<MPP_SIZE; i++)
+   {
+      buffer[i] = (UINT8)i;
+   }
+
+   ret = FTL_Write(0, buffer);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   ret = FTL_Flush();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* the same data is shared with the first page, in the same PMT page */
+   for (addr=1; addr<0x40 && ret == STATUS_SUCCESS; addr++)
+   {
+      ret = FTL_Write(addr, buffer);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* overwrite the first page, the others keep the data */
+   buffer[0] = 0xa5;
+   ret = FTL_Write(0, buffer);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* the shared pages are replayed in order after init, without a flush */
+   ret = FTL_Init();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (addr=0; addr<0x40 && ret == STATUS_SUCCESS; addr++)
+   {
+      ret = FTL_Read(addr, buffer);
+      CuAssertTrue(tc, buffer[0] == (addr == 0 ? 0xa5 : 0x00));
+      for (i=1; i<MPP_SIZE; i++)
+      {
+         CuAssertTrue(tc, buffer[i] == (UINT8)i);
+      }
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+}
+
+
+void TC_FTL_WriteAtomic(CuTest* tc)
+{
+   STATUS   ret;
+   PGADDR   addr;
+   UINT32   i;
+   UINT8*   buffers[ATOMIC_TEST_PAGES];
+
+   ret = ftl_format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (i=0; i<ATOMIC_TEST_PAGES; i++)
+   {
+      buffers[i] = malloc(MPP_SIZE);
+      CuAssertTrue(tc, buffers[i] != NULL);
+   }
+
+   /* the old data, committed */
+   for (addr=0; addr<ATOMIC_TEST_PAGES && ret == STATUS_SUCCESS; addr++)
+   {
+      memset(buffers[addr], 0x11, MPP_SIZE);
+      ret = FTL_Write(addr, buffers[addr]);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   ret = FTL_Flush();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* a completed atomic write, the buffers are reused at once */
+   for (i=0; i<ATOMIC_TEST_PAGES; i++)
+   {
+      memset(buffers[i], 0x22, MPP_SIZE);
+   }
+
+   ret = FTL_WriteAtomic(0, ATOMIC_TEST_PAGES, (void**)buffers);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (i=0; i<ATOMIC_TEST_PAGES; i++)
+   {
+      memset(buffers[i], 0x33, MPP_SIZE);
+   }
+
+   ret = FTL_Init();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (addr=0; addr<ATOMIC_TEST_PAGES && ret == STATUS_SUCCESS; addr++)
+   {
+      ret = FTL_Read(addr, buffers[addr]);
+      CuAssertTrue(tc, buffers[addr][0] == 0x22);
+      CuAssertTrue(tc, buffers[addr][MPP_SIZE-1] == 0x22);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* power loss in the middle of an atomic write, none of it is kept */
+   for (i=0; i<ATOMIC_TEST_PAGES; i++)
+   {
+      memset(buffers[i], 0x33, MPP_SIZE);
+   }
+
+   MTD_TestPLR(ATOMIC_TEST_PAGES/2);
+   ret = FTL_WriteAtomic(0, ATOMIC_TEST_PAGES, (void**)buffers);
+   CuAssertTrue(tc, ret==STATUS_SimulatedPowerLoss);
+   MTD_TestReset();
+
+   ret = FTL_Init();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (addr=0; addr<ATOMIC_TEST_PAGES && ret == STATUS_SUCCESS; addr++)
+   {
+      ret = FTL_Read(addr, buffers[addr]);
+      CuAssertTrue(tc, buffers[addr][0] == 0x22);
+      CuAssertTrue(tc, buffers[addr][MPP_SIZE-1] == 0x22);
+   }
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   for (i=0; i<ATOMIC_TEST_PAGES; i++)
+   {
+      free(buffers[i]);
+   }
 }
 
 
@@ -74,9 +477,70 @@ CuSuite* TestSuite_FTL()
    CuSuite* suite = CuSuiteNew();
 
    SUITE_ADD_TEST(suite, TC_FTL_BasicalValidation);
+   SUITE_ADD_TEST(suite, TC_FTL_BackgroundReclaim);
+   SUITE_ADD_TEST(suite, TC_FTL_StreamHint);
+   SUITE_ADD_TEST(suite, TC_FTL_ReadOnlyInit);
+   SUITE_ADD_TEST(suite, TC_FTL_Copy);
+   SUITE_ADD_TEST(suite, TC_FTL_PatternPage);
+   SUITE_ADD_TEST(suite, TC_FTL_WriteAtomic);
+#if (DEDUP_ENABLE == TRUE)
+   SUITE_ADD_TEST(suite, TC_FTL_Dedup);
+#endif
 
    return suite;
 }
 
 
+static
+STATUS ftl_format()
+{
+   STATUS   ret;
+
+   MTD_Init();
+
+   ret = FTL_Format();
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = FTL_Init();
+   }
+
+   return ret;
+}
+
+
+static
+PGADDR ftl_random_page(PGADDR start, PGADDR end)
+{
+   ftl_random_seed = ftl_random_seed*1103515245+12345;
+
+   return start+(PGADDR)((ftl_random_seed>>8)%(end-start));
+}
+
+
+static
+STATUS ftl_check_image(CuTest* tc, UINT8* image, PGADDR page_count)
+{
+   PGADDR   addr;
+   UINT8    buffer[MPP_SIZE];
+   STATUS   ret;
 
+   /* the records logged after the last data page are programmed in idle
+    * time. Then init again, and check the first byte of the written pages.
+    */
+   ret = FTL_BgTasks();
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = FTL_Init();
+   }
+
+   for (addr=0; addr<page_count && ret == STATUS_SUCCESS; addr++)
+   {
+      if (image[addr] != 0)
+      {
+         ret = FTL_Read(addr, buffer);
+         CuAssertTrue(tc, buffer[0] == image[addr]);
+      }
+   }
+
+   return ret;
+}
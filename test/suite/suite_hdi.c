@@ -0,0 +1,302 @@
+/*********************************************************
+ * Module name: suite_hdi.c
+ *
+ * Copyright 2010, 2011. All Rights Reserved, Crane Chu.
+ *
+ * This file is part of OpenNFM.
+ *
+ * OpenNFM is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * OpenNFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with OpenNFM. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * First written on 2010-01-01 by cranechu@gmail.com
+ *
+ * Module Description:
+ *    HDI accuracy evaluation: replay a trace of page
+ *    writes, and compare the temperature to the real
+ *    rewrite interval of pages.
+ *
+ *********************************************************/
+
+
+#include <core\inc\cmn.h>
+#include <core\inc\ftl.h>
+#include <core\inc\mtd.h>
+#include <core\ftl\ftl_inc.h>
+
+#include <sys\sys.h>
+
+#include <assert.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "..\cutest-1.5\CuTest.h"
+#include "..\suites.h"
+
+
+/* the trace is read from the file (a page address per line) if exists,
+ * or a hot/cold mix is generated.
+ */
+#define HDI_TRACE_FILE        "hdi_trace.txt"
+#define HDI_TRACE_LENGTH      (0x20000)
+
+/* a write is hot if the page is written again in the interval */
+#define HDI_HOT_INTERVAL      (0x400)
+
+/* temperatures from the grade are taken as hot */
+#define HDI_HOT_GRADE         (1)
+
+/* generated trace: a few hot pages and more warm pages get most of the
+ * writes, the other pages are written sequentially.
+ */
+#define HDI_HOT_PERCENT       (40)
+#define HDI_HOT_PAGES         (64)
+#define HDI_WARM_PERCENT      (30)
+#define HDI_WARM_PAGES        (0x800)
+
+/* the seed of the local generator, the trace is the same on all platforms */
+#define HDI_TRACE_SEED        (544)
+
+static PGADDR  trace_addr[HDI_TRACE_LENGTH];
+static UINT32  trace_next[HDI_TRACE_LENGTH];
+static UINT32  trace_length;
+static BOOL    trace_from_file;
+
+extern UINT32  TEST_total_page_program;
+
+
+static
+UINT32 hdi_random(UINT32* seed)
+{
+   *seed = *seed*1103515245+12345;
+
+   return (*seed>>16)&0x7fff;
+}
+
+
+static
+void hdi_load_trace(PGADDR capacity)
+{
+   FILE*          trace_file;
+   unsigned long  addr;
+   PGADDR         cold_addr = HDI_HOT_PAGES+HDI_WARM_PAGES;
+   UINT32         seed = HDI_TRACE_SEED;
+   UINT32         percent;
+   UINT32*        last_write;
+   UINT32         i;
+
+   trace_length = 0;
+
+   trace_file = fopen(HDI_TRACE_FILE, "r");
+   trace_from_file = (trace_file != NULL);
+   if (trace_file != NULL)
+   {
+      while (trace_length < HDI_TRACE_LENGTH &&
+             fscanf(trace_file, "%lu", &addr) == 1)
+      {
+         trace_addr[trace_length++] = (PGADDR)(addr%capacity);
+      }
+
+      fclose(trace_file);
+   }
+   else
+   {
+      for (trace_length=0; trace_length<HDI_TRACE_LENGTH; trace_length++)
+      {
+         percent = hdi_random(&seed)%100;
+         if (percent < HDI_HOT_PERCENT)
+         {
+            /* hot pages are spread in the whole space */
+            trace_addr[trace_length] = (hdi_random(&seed)%HDI_HOT_PAGES)*
+                                       (capacity/HDI_HOT_PAGES);
+         }
+         else if (percent < HDI_HOT_PERCENT+HDI_WARM_PERCENT)
+         {
+            trace_addr[trace_length] = HDI_HOT_PAGES+
+                                       hdi_random(&seed)%HDI_WARM_PAGES;
+         }
+         else
+         {
+            trace_addr[trace_length] = cold_addr;
+            if (++cold_addr == capacity)
+            {
+               cold_addr = HDI_HOT_PAGES+HDI_WARM_PAGES;
+            }
+         }
+      }
+   }
+
+   /* find the next write of each page, from the end of trace */
+   last_write = (UINT32*)malloc(capacity*sizeof(UINT32));
+   ASSERT(last_write != NULL);
+
+   memset(last_write, 0xff, capacity*sizeof(UINT32));
+   for (i=trace_length; i>0; i--)
+   {
+      trace_next[i-1] = last_write[trace_addr[i-1]];
+      last_write[trace_addr[i-1]] = i-1;
+   }
+
+   free(last_write);
+}
+
+
+static
+BOOL hdi_is_hot(UINT32 i)
+{
+   return (trace_next[i] != MAX_UINT32 &&
+           trace_next[i]-i <= HDI_HOT_INTERVAL);
+}
+
+
+static
+STATUS hdi_write_trace(UINT32 stream_id, double* wa)
+{
+   UINT8    buffer[MPP_SIZE];
+   UINT32   i;
+   STATUS   ret;
+
+   MTD_Init();
+
+   ret = FTL_Format();
+   if (ret == STATUS_SUCCESS)
+   {
+      ret = FTL_Init();
+   }
+
+   if (ret == STATUS_SUCCESS)
+   {
+      hdi_load_trace(FTL_Capacity());
+   }
+
+   memset(buffer, 0, MPP_SIZE);
+
+   TEST_total_page_program = 0;
+   for (i=0; i<trace_length && ret==STATUS_SUCCESS; i++)
+   {
+      buffer[0] = (UINT8)i;
+      ret = FTL_WriteHint(trace_addr[i], buffer, stream_id);
+   }
+
+   *wa = (double)TEST_total_page_program/trace_length;
+
+   return ret;
+}
+
+
+void TC_HDI_Accuracy(CuTest* tc)
+{
+   STATUS   ret;
+   UINT32   grade_count[DATA_STREAM_COUNT] = {0};
+   UINT32   grade_hot[DATA_STREAM_COUNT] = {0};
+   UINT32   true_hot = 0;
+   UINT32   predicted_hot = 0;
+   UINT32   hit = 0;
+   UINT32   temperature;
+   UINT32   i;
+   double   precision;
+   double   recall;
+
+   MTD_Init();
+
+   ret = FTL_Format();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   ret = FTL_Init();
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   hdi_load_trace(FTL_Capacity());
+
+   /* grade the trace with a fresh HDI */
+   for (i=0; i<trace_length; i++)
+   {
+      temperature = HDI_GetTemperature(trace_addr[i]);
+      ASSERT(temperature < DATA_STREAM_COUNT);
+
+      grade_count[temperature] ++;
+
+      if (hdi_is_hot(i) == TRUE)
+      {
+         grade_hot[temperature] ++;
+         true_hot ++;
+      }
+
+      if (temperature >= HDI_HOT_GRADE)
+      {
+         predicted_hot ++;
+         if (hdi_is_hot(i) == TRUE)
+         {
+            hit ++;
+         }
+      }
+   }
+
+   precision = predicted_hot == 0 ? 0 : (double)hit/predicted_hot;
+   recall = true_hot == 0 ? 0 : (double)hit/true_hot;
+
+   printf("HDI: %u writes, precision %.3f, recall %.3f\n\r",
+          trace_length, precision, recall);
+   for (i=0; i<DATA_STREAM_COUNT; i++)
+   {
+      printf("     temperature %u: %u writes, %u hot\n\r",
+             i, grade_count[i], grade_hot[i]);
+   }
+
+   /* only the generated trace has known accuracy */
+   if (trace_from_file == FALSE)
+   {
+      CuAssertTrue(tc, precision >= 0.9);
+      CuAssertTrue(tc, recall >= 0.8);
+   }
+}
+
+
+void TC_HDI_WriteAmplification(CuTest* tc)
+{
+   STATUS   ret;
+   double   hdi_wa;
+   double   single_wa;
+
+   /* the streams are chosen by HDI */
+   ret = hdi_write_trace(FTL_STREAM_NONE, &hdi_wa);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* the same trace in one stream, as without HDI */
+   ret = hdi_write_trace(1, &single_wa);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   printf("HDI: %u writes, WA = %.3f, %.3f in one stream\n\r",
+          trace_length, hdi_wa, single_wa);
+
+   /* hot and cold data are apart in the generated trace */
+   if (trace_from_file == FALSE)
+   {
+      CuAssertTrue(tc, hdi_wa < single_wa);
+   }
+}
+
+
+CuSuite* TestSuite_HDI()
+{
+   CuSuite* suite = CuSuiteNew();
+
+   SUITE_ADD_TEST(suite, TC_HDI_Accuracy);
+   SUITE_ADD_TEST(suite, TC_HDI_WriteAmplification);
+
+   return suite;
+}
+
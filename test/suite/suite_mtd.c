@@ -111,6 +111,55 @@ void TC_MTD_ReadEmptyPage(CuTest* tc)
 }
 
 
+void TC_MTD_CopyBack(CuTest* tc)
+{
+   STATUS   ret;
+   UINT8    buffer[MPP_SIZE];
+   SPARE    spare;
+
+   MTD_Init();
+
+   /* prepare the buffer and data */
+   memset(buffer, 0x5a, MPP_SIZE);
+   spare[0] = 0x3c;
+   spare[1] = 0xa5;
+
+   ret = MTD_Program(1, 2, buffer, spare);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* copy back in the same die, with new spare */
+   spare[1] = 0x96;
+   ret = MTD_CopyBack(1, 2, 1+TOTAL_DIE_COUNT, 0, spare);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* copy back in the same die, and keep the spare */
+   ret = MTD_CopyBack(1, 2, 1+TOTAL_DIE_COUNT, 1, NULL);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+
+   /* can not copy back across dice, or from an empty page */
+   ret = MTD_CopyBack(1, 2, 2, 0, NULL);
+   CuAssertTrue(tc, ret==STATUS_FAILURE);
+   ret = MTD_CopyBack(1, 3, 1+TOTAL_DIE_COUNT, 2, NULL);
+   CuAssertTrue(tc, ret==STATUS_FAILURE);
+
+   /* read back and check */
+   memset(buffer, 0, MPP_SIZE);
+   ret = MTD_Read(1+TOTAL_DIE_COUNT, 0, buffer, spare);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+   CuAssertTrue(tc, spare[0]==0x3c);
+   CuAssertTrue(tc, spare[1]==0x96);
+   CuAssertTrue(tc, buffer[1]==0x5a);
+   CuAssertTrue(tc, buffer[MPP_SIZE-1]==0x5a);
+
+   ret = MTD_Read(1+TOTAL_DIE_COUNT, 1, buffer, spare);
+   CuAssertTrue(tc, ret==STATUS_SUCCESS);
+   CuAssertTrue(tc, spare[1]==0xa5);
+
+   ret = MTD_Read(1+TOTAL_DIE_COUNT, 2, buffer, spare);
+   CuAssertTrue(tc, ret==STATUS_FAILURE);
+}
+
+
 CuSuite* TestSuite_MTD()
 {
    CuSuite* suite = CuSuiteNew();
@@ -119,6 +168,7 @@ CuSuite* TestSuite_MTD()
    SUITE_ADD_TEST(suite, TC_MTD_ReadID);
    SUITE_ADD_TEST(suite, TC_MTD_WriteOnePage);
    SUITE_ADD_TEST(suite, TC_MTD_ReadEmptyPage);
+   SUITE_ADD_TEST(suite, TC_MTD_CopyBack);
 
    return suite;
 }
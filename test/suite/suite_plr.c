@@ -263,7 +263,7 @@ STATUS plr_init()
    if (ret == STATUS_SUCCESS)
    {
       /* find the updated cfg table */
-      ret = ANCHOR_Init();
+      ret = ANCHOR_Init(FALSE);
    }
 
    if (ret == STATUS_SUCCESS)
@@ -146,6 +146,25 @@ CuSuite* TestSuite_UBI();
  *********************************************************/
 CuSuite* TestSuite_FTL();
 
+
+/*********************************************************
+ * Funcion Name: TestSuite_HDI
+ *
+ * Description:
+ *    Test suite for the accuracy of HDI.
+ *
+ * Return Value:
+ *    CuSuite
+ *
+ * Parameter List:
+ *    N/A
+ *
+ * NOTES:
+ *    N/A
+ *
+ *********************************************************/
+CuSuite* TestSuite_HDI();
+
 #endif
 
 
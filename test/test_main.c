@@ -55,6 +55,7 @@ void RunAllTests()
    CuSuiteAddSuite(suite, TestSuite_MTD());
    CuSuiteAddSuite(suite, TestSuite_UBI());
    CuSuiteAddSuite(suite, TestSuite_FTL());
+   CuSuiteAddSuite(suite, TestSuite_HDI());
    CuSuiteAddSuite(suite, TestSuite_BAT());
 
    CuSuiteRun(suite);